@@ -0,0 +1,77 @@
+/*
+  This example shows how to check several voltages in one pass using a MeasurementBatch
+
+  Each call to testVoltage, testVCC or verifyVoltage waits for the voltage to settle and then
+  averages the ADC readings. measureBatch does all of the channels together: the channels share
+  a single settle window and the ADC conversions are interleaved across the channels.
+
+  Select Mega2560 from the boards list
+*/
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h" //Click here to get the library: http://librarymanager/All#SparkFun_Jalapeno_2
+//The FJ library depends on the CapSense library that can be obtained here: http://librarymanager/All#CapacitiveSensor_Arduino
+FlyingJalapeno2 FJ2(FJ2_STAT_LED, 3.3); //Blink status msgs on STAT LED. Board should have VCC jumper set to 3.3V.
+
+MeasurementBatch batch; // The list of channels to measure
+
+int interrupt_pin = A1;  // The board interrupt pin - connected to A1 on the FJ2
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println("FJ2 measurement batch example.");
+
+  //FJ2.enableDebugging(); //Uncomment this line to enable helpful debug messages on Serial
+
+  FJ2.reset(); // Set up the FJ2 pins. Turn everything off - including the LEDs
+
+  batch.addVCC(); // Check VCC (using the 3.3V zener connected to A0 on the FJ2)
+  batch.addV1(); // Check V1. The expected voltage comes from setVoltageV1
+  batch.addPin(interrupt_pin, 1.65, 10); // Voltage on the interrupt pin is 3.3V split by two 10Ks. Should be 1.65V. Check for 10%
+}
+
+void loop()
+{
+  Serial.println(F("Checking for a short on V1"));
+  if (FJ2.isV1Shorted() == true)
+  {
+    Serial.println(F("FAIL! Short detected on V1"));
+  }
+  else
+  {
+    FJ2.setVoltageV1(3.3); // Get ready to set V1 to 3.3V
+    FJ2.enableV1(); // Enable V1
+
+    unsigned long startTime = millis();
+    boolean result = FJ2.measureBatch(batch); // Measure all of the channels in one pass
+    unsigned long duration = millis() - startTime;
+
+    for (uint8_t i = 0; i < batch.size(); i++)
+    {
+      FJ2_BatchChannel *channel = batch.result(i);
+      Serial.print(F("Pin "));
+      Serial.print(channel->pin);
+      Serial.print(F(": reading "));
+      Serial.print(channel->rawMean);
+      Serial.print(F(" = "));
+      Serial.print(channel->volts, 2);
+      Serial.print(F("V (expected "));
+      Serial.print(channel->expectedVoltage, 2);
+      Serial.print(F("V) : "));
+      Serial.println(channel->pass ? F("pass") : F("FAIL"));
+    }
+
+    Serial.print(F("The batch took "));
+    Serial.print(duration);
+    Serial.println(F("ms"));
+
+    if (result)
+      Serial.println(F("*** PASS ***"));
+    else
+      Serial.println(F("*** FAIL ***"));
+  }
+
+  FJ2.reset(false); // Turn everything off except the LEDs
+  Serial.println();
+  delay(2000);
+}
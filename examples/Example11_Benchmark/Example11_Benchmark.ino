@@ -0,0 +1,180 @@
+/*
+  This example measures how long the library takes to test a board
+
+  It runs the library calls from three of the other examples and reports the time taken by each call and by each cycle:
+    Shorts:   the calls from Example3_TestForShorts
+    V1andV2:  the calls from Example7_TestV1andV2
+    FullTest: the calls from Example8_FullTest (without the button press and without the delays the sketch itself adds)
+
+  Each cycle time is compared against a budget. If a cycle is more than regressionPercent slower than its budget, the benchmark fails.
+  The budgets below were measured on the simulated FJ2 (see extras/host). If you run this on a real FJ2, re-measure them first.
+
+  On the simulated FJ2 the timings are exact and repeatable. See extras/host/README.md for how to build and run it.
+  When run on the simulated FJ2, the exit code is non-zero if the benchmark fails.
+
+  Select Mega2560 from the boards list
+*/
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h" //Click here to get the library: http://librarymanager/All#SparkFun_Jalapeno_2
+//The FJ library depends on the CapSense library that can be obtained here: http://librarymanager/All#CapacitiveSensor_Arduino
+FlyingJalapeno2 FJ2(FJ2_STAT_LED, 3.3); //Blink status msgs on STAT LED. Board should have VCC jumper set to 3.3V.
+
+int interrupt_pin = A1;  // The board interrupt pin - connected to A1 on the FJ2
+
+// ************************************************************************************************
+// ----- Budgets -----
+
+const unsigned long shortsBudgetMicros = 410000; // Example3_TestForShorts
+const unsigned long v1AndV2BudgetMicros = 820000; // Example7_TestV1andV2
+const unsigned long fullTestBudgetMicros = 830000; // Example8_FullTest (the I2C scan runs at the default 100kHz)
+const unsigned long regressionPercent = 10; // Fail if a cycle is more than this much slower than its budget
+
+// ************************************************************************************************
+// ----- Timing -----
+
+unsigned long callStartMicros; // When the current call started
+unsigned long cycleMicros; // The total for the current cycle
+
+void startCall()
+{
+  callStartMicros = micros();
+}
+
+void endCall(const __FlashStringHelper *name)
+{
+  unsigned long duration = micros() - callStartMicros;
+  cycleMicros += duration;
+  Serial.print(F("  "));
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(duration);
+  Serial.println(F("us"));
+}
+
+//Print the cycle time. Returns true if the cycle is within its budget (plus regressionPercent)
+bool checkCycle(const __FlashStringHelper *name, unsigned long budgetMicros)
+{
+  unsigned long limit = budgetMicros + (budgetMicros / 100 * regressionPercent);
+  bool ok = (cycleMicros <= limit);
+  Serial.print(name);
+  Serial.print(F(" cycle: "));
+  Serial.print(cycleMicros);
+  Serial.print(F("us (budget "));
+  Serial.print(budgetMicros);
+  Serial.print(F("us) : "));
+  Serial.println(ok ? F("OK") : F("REGRESSION"));
+  Serial.println();
+  return (ok);
+}
+
+// ************************************************************************************************
+// ----- The cycles -----
+
+bool benchmarkShorts()
+{
+  Serial.println(F("Shorts (Example3_TestForShorts):"));
+  cycleMicros = 0;
+  startCall(); FJ2.reset(false); endCall(F("reset"));
+  startCall(); FJ2.setVoltageV1(3.3); endCall(F("setVoltageV1"));
+  startCall(); FJ2.setVoltageV2(3.3); endCall(F("setVoltageV2"));
+  startCall(); FJ2.isV1Shorted(); endCall(F("isV1Shorted"));
+  startCall(); FJ2.isV2Shorted(); endCall(F("isV2Shorted"));
+  return (checkCycle(F("Shorts"), shortsBudgetMicros));
+}
+
+bool benchmarkV1AndV2()
+{
+  Serial.println(F("V1andV2 (Example7_TestV1andV2):"));
+  cycleMicros = 0;
+  startCall(); FJ2.reset(false); endCall(F("reset"));
+  startCall(); FJ2.testVCC(); endCall(F("testVCC"));
+  startCall(); FJ2.setVoltageV1(3.3); endCall(F("setVoltageV1"));
+  startCall(); FJ2.setVoltageV2(3.3); endCall(F("setVoltageV2"));
+  startCall(); FJ2.isV1Shorted(); endCall(F("isV1Shorted"));
+  startCall(); FJ2.isV2Shorted(); endCall(F("isV2Shorted"));
+  startCall(); FJ2.enableV1(); endCall(F("enableV1"));
+  startCall(); FJ2.enableV2(); endCall(F("enableV2"));
+  startCall(); FJ2.testVoltage(1); endCall(F("testVoltage(1)"));
+  startCall(); FJ2.testVoltage(2); endCall(F("testVoltage(2)"));
+  startCall(); FJ2.reset(false); endCall(F("reset"));
+  return (checkCycle(F("V1andV2"), v1AndV2BudgetMicros));
+}
+
+bool benchmarkFullTest()
+{
+  Serial.println(F("FullTest (Example8_FullTest):"));
+  cycleMicros = 0;
+  startCall(); FJ2.reset(false); endCall(F("reset"));
+  startCall(); FJ2.testVCC(); endCall(F("testVCC"));
+  startCall(); FJ2.reset(); endCall(F("reset"));
+  startCall(); FJ2.isV1Shorted(); endCall(F("isV1Shorted"));
+  startCall(); FJ2.isV2Shorted(); endCall(F("isV2Shorted"));
+  startCall(); FJ2.setVoltageV1(3.3); endCall(F("setVoltageV1"));
+  startCall(); FJ2.enableV1(); endCall(F("enableV1"));
+  startCall(); FJ2.testVoltage(1); endCall(F("testVoltage(1)"));
+  startCall(); FJ2.setVoltageV2(4.2); endCall(F("setVoltageV2"));
+  startCall(); FJ2.enableV2(); endCall(F("enableV2"));
+  startCall(); FJ2.enableI2CBuffer(); endCall(F("enableI2CBuffer"));
+  Wire.begin(); // Begin the I2C bus
+  startCall(); FJ2.verifyI2Cdevice(0); endCall(F("verifyI2Cdevice(0)"));
+  startCall(); FJ2.verifyVoltage(interrupt_pin, 1.65, 10); endCall(F("verifyVoltage"));
+  startCall(); FJ2.reset(false); endCall(F("reset"));
+  Wire.end(); //Stop I2C
+  return (checkCycle(F("FullTest"), fullTestBudgetMicros));
+}
+
+// ************************************************************************************************
+// ----- User Reset -----
+
+void FlyingJalapeno2::userReset(boolean resetLEDs) // YOU CAN IGNORE THE COMPILER WARNING: unused parameter 'resetLEDs'
+{
+  pinMode(interrupt_pin, INPUT); // Make the FJ2 pin conected to the board's interrupt pin an input
+}
+
+// ************************************************************************************************
+// ----- setup and loop -----
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println(F("FJ2 benchmark"));
+  Serial.println();
+
+  //The static RAM used by the FJ2 object. This depends on the configuration - e.g. FJ2_NO_CAP_SENSE in the library header
+  Serial.print(F("FlyingJalapeno2 RAM: "));
+  Serial.print(sizeof(FJ2));
+  Serial.println(F(" bytes (no heap)"));
+  Serial.println();
+
+  //FJ2.enableDebugging(); //Uncomment this line to see how much time the debug messages add
+  //FJ2.enableDebugging(Serial, true); //Or uncomment this line to see how much time the buffered debug messages add
+
+  FJ2.reset(); // Set up the FJ2 pins. Turn everything off - including the LEDs
+
+  delay(100); // Let Serial finish
+}
+
+void loop()
+{
+  bool pass = true;
+
+  pass &= benchmarkShorts();
+  pass &= benchmarkV1AndV2();
+  pass &= benchmarkFullTest();
+
+  //FJ2.dumpStats(); //Uncomment this line (and #define FJ2_ENABLE_STATS in the library header) to see the statistics for each operation
+
+  FJ2.flushDebug(); // Print any buffered debug messages
+
+  if (pass)
+    Serial.println(F("*** BENCHMARK PASS ***"));
+  else
+    Serial.println(F("*** BENCHMARK FAIL ***"));
+  Serial.println();
+
+#ifdef FJ2_HOST_SIM
+  exit(pass ? 0 : 1); // Let the host build report the result
+#endif
+
+  delay(5000);
+}
@@ -0,0 +1,129 @@
+/*
+  This example shows how to run a test procedure from a TestSequence
+
+  Example8 runs its tests from a switch/case in the main loop. Here the same tests are
+  described by a table of steps - a TestSequence - and run by FJ2.runSequence.
+  runSequence records the result and the time taken for each step. It can stop at the first
+  failure (fail-fast, the default) or run all of the steps. It always calls FJ2.reset(false) at the end,
+  so the board under test is left powered down whatever happens.
+
+  Select Mega2560 from the boards list
+*/
+
+// ************************************************************************************************
+// ----- Includes -----
+
+//The FJ2 library includes Wire.h for us. We don't need to include it again here
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h" //Click here to get the library: http://librarymanager/All#SparkFun_Jalapeno_2
+//The FJ library depends on the CapSense library that can be obtained here: http://librarymanager/All#CapacitiveSensor_Arduino
+FlyingJalapeno2 FJ2(FJ2_STAT_LED, 3.3); //Blink status msgs on STAT LED. Board should have VCC jumper set to 3.3V.
+
+// ************************************************************************************************
+// ----- Globals -----
+
+TestSequence sequence; // The test steps. These are added in setup
+
+int failures = 0; //Number of failures
+
+// ************************************************************************************************
+// ----- Define any extra FJ2 Pins which are connected to the board under test -----
+
+int interrupt_pin = A1;  // The board interrupt pin - connected to A1 on the FJ2
+
+// ************************************************************************************************
+// ----- User Reset -----
+
+// This function overwrites userReset in the FJ2 library
+// It will be called automatically whenever we call FJ2.reset() - including at the start and end of each sequence
+// Do not use Serial prints in userReset as Serial may not have been begun when FJ2.reset is called during the class instantiation
+void FlyingJalapeno2::userReset(boolean resetLEDs) // YOU CAN IGNORE THE COMPILER WARNING: unused parameter 'resetLEDs'
+{
+  pinMode(interrupt_pin, INPUT); // Make the FJ2 pin conected to the board's interrupt pin an input
+}
+
+// ************************************************************************************************
+// ----- Custom steps -----
+
+// A custom step is a function which returns true if the step passed
+// context is the pointer passed to addCustom. We don't need it here
+boolean startI2C(void *context)
+{
+  FJ2.enableI2CBuffer();
+  Wire.begin(); // Begin the I2C bus
+  delay(1000); // Give the I2C bus time to power up
+  return (true);
+}
+
+// ************************************************************************************************
+// ----- setup -----
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println("FJ2 test sequence example.");
+
+  //FJ2.enableDebugging(); //Uncomment this line to enable helpful debug messages on Serial
+
+  //The test steps. These are the same tests as Example8
+  sequence.addTestVCC(F("Check VCC is 3.3V"));
+  sequence.addShortTestV1(550, F("Check for a short on V1"));
+  sequence.addShortTestV2(550, F("Check for a short on V2"));
+  sequence.addSetVoltageV1(3.3);
+  sequence.addEnableV1();
+  sequence.addTestVoltage(1, F("Check V1 is 3.3V"));
+  sequence.addSetVoltageV2(4.2);
+  sequence.addEnableV2();
+  sequence.addCustom(startI2C, NULL, F("Start I2C"));
+  sequence.addVerifyI2Cdevice(0, F("I2C scan")); // Address 0: any device will do
+  sequence.addVerifyVoltage(interrupt_pin, 1.65, 10, F("Check the interrupt pin is 1.65V"));
+
+  //sequence.setPolicy(FJ2_SEQUENCE_RUN_ALL); //Uncomment this line to run all of the steps, even after a failure. (The sequence always stops if a short is detected)
+
+  FJ2.reset(); // Set up the FJ2 pins. Turn everything off - including the LEDs. This will call userReset too
+}
+
+// ************************************************************************************************
+// ----- loop -----
+
+void loop()
+{
+  Serial.println();
+  Serial.println(F("Press a button to start the test"));
+
+  int button = 0;
+  while (button == 0) // Keep checking the buttons until we get a valid press and release
+  {
+    button = FJ2.waitForButtonPressRelease();
+  }
+
+  FJ2.reset(); // Turn everything off including the LEDs
+  FJ2.dash(); // Blink the FJ2_STAT_LED
+
+  boolean passed = FJ2.runSequence(sequence); // Run the test steps
+
+  Wire.end(); //Stop I2C
+
+  sequence.printResults(); // Print the result and time of each step
+
+  if (passed)
+  {
+    Serial.println(F("*** Tests complete - PASS ***"));
+    if (button == 1)
+      digitalWrite(FJ2_LED_PROGRAM_AND_TEST_PASS, HIGH); // Turn on the PROGRAM_AND_PASS LED
+    else
+      digitalWrite(FJ2_LED_TEST_PASS, HIGH); // Turn on the PASS LED
+  }
+  else
+  {
+    failures++; // Increment the number of failures
+
+    Serial.print(F("*** TEST FAILED at step ")); // Do not use !!! - it crashes avrdude!
+    Serial.print(sequence.getFailedStep() + 1);
+    Serial.print(F(". The number of failures so far is "));
+    Serial.print(failures);
+    Serial.println(F(" ***"));
+
+    digitalWrite(FJ2_LED_FAIL, HIGH); // Turn on the FAIL LED
+  }
+}
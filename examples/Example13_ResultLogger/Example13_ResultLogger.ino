@@ -0,0 +1,181 @@
+/*
+  This example shows how to log the test results to the microSD card on the test jig
+
+  The tests are the same as Example12 (a TestSequence). After each board, the result and time of each step
+  are logged by an FJ2_ResultLogger: as 32 byte binary records, written a 512 byte sector at a time to a
+  preallocated file. Logging a board only copies its records into RAM. The sector is written (flushed)
+  while the jig is waiting for the next button press - so logging does not slow the tests down.
+
+  A new file (RESULT00.BIN, RESULT01.BIN, ...) is created each time the jig is powered on.
+  To convert a file to CSV: python3 extras/tools/fj2_results_to_csv.py RESULT00.BIN RESULT00.csv
+
+  Select Mega2560 from the boards list
+*/
+
+// ************************************************************************************************
+// ----- Includes -----
+
+//The FJ2 library includes Wire.h for us. We don't need to include it again here
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h" //Click here to get the library: http://librarymanager/All#SparkFun_Jalapeno_2
+//The FJ library depends on the CapSense library that can be obtained here: http://librarymanager/All#CapacitiveSensor_Arduino
+FlyingJalapeno2 FJ2(FJ2_STAT_LED, 3.3); //Blink status msgs on STAT LED. Board should have VCC jumper set to 3.3V.
+
+#include <SPI.h> // Needed for microSD
+
+#include <SdFat.h> // Needed for microSD. Click here to get the latest library: http://librarymanager/All#sdFat_exFAT
+#define SD_CONFIG SdSpiConfig(FJ2_MICROSD_CS, SHARED_SPI, SD_SCK_MHZ(4)) // 4 MHz
+SdFat32 sd;
+File32 file;
+
+#include "FJ2_ResultLogger.h" // The result logger is part of the FJ2 library. Include it after SdFat
+FJ2_ResultLogger<File32> logger; // Log to a File32
+
+#define MAX_RECORDS 32000 // Preallocate 1MB - enough for ~2500 boards with 12 records each
+
+// ************************************************************************************************
+// ----- Globals -----
+
+TestSequence sequence; // The test steps. These are added in setup
+
+uint32_t serialNumber = 1; // The serial number logged with each board. Replace this with the real serial number if the board has one
+
+boolean logging = false; // True if the log file is open
+
+// ************************************************************************************************
+// ----- Define any extra FJ2 Pins which are connected to the board under test -----
+
+int interrupt_pin = A1;  // The board interrupt pin - connected to A1 on the FJ2
+
+// ************************************************************************************************
+// ----- User Reset -----
+
+// This function overwrites userReset in the FJ2 library
+// It will be called automatically whenever we call FJ2.reset() - including at the start and end of each sequence
+// Do not use Serial prints in userReset as Serial may not have been begun when FJ2.reset is called during the class instantiation
+void FlyingJalapeno2::userReset(boolean resetLEDs) // YOU CAN IGNORE THE COMPILER WARNING: unused parameter 'resetLEDs'
+{
+  pinMode(interrupt_pin, INPUT); // Make the FJ2 pin conected to the board's interrupt pin an input
+}
+
+// ************************************************************************************************
+// ----- Custom steps -----
+
+boolean startI2C(void *context)
+{
+  FJ2.enableI2CBuffer();
+  Wire.begin(); // Begin the I2C bus
+  delay(1000); // Give the I2C bus time to power up
+  return (true);
+}
+
+// ************************************************************************************************
+// ----- setup -----
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println("FJ2 result logger example.");
+
+  FJ2.reset(); // Set up the FJ2 pins. Turn everything off - including the LEDs. This will call userReset too
+
+  //Start the microSD card. keepMicroSDEnabled stops FJ2.reset from turning it off again
+  FJ2.keepMicroSDEnabled();
+  FJ2.enableMicroSDBuffer(); //Enable the microSD buffer by pulling FJ2_MICROSD_EN high
+  delay(1);
+  FJ2.enableMicroSDPower(); //Enable power for the microSD card
+  delay(100);
+
+  if (!sd.begin(SD_CONFIG))
+  {
+    Serial.println(F("Could not begin the microSD card. The results will not be logged"));
+  }
+  else
+  {
+    //Find a file name which has not been used yet
+    char fileName[] = "RESULT00.BIN";
+    for (int i = 0; i < 100; i++)
+    {
+      fileName[6] = '0' + (i / 10);
+      fileName[7] = '0' + (i % 10);
+      if (!sd.exists(fileName))
+        break;
+    }
+
+    if (file.open(fileName, O_RDWR | O_CREAT | O_TRUNC) && logger.begin(file, MAX_RECORDS))
+    {
+      Serial.print(F("Logging the results to "));
+      Serial.println(fileName);
+      logging = true;
+    }
+    else
+    {
+      Serial.println(F("Could not create the log file. The results will not be logged"));
+    }
+  }
+
+  //The test steps. These are the same tests as Example12
+  sequence.addTestVCC();
+  sequence.addShortTestV1();
+  sequence.addShortTestV2();
+  sequence.addSetVoltageV1(3.3);
+  sequence.addEnableV1();
+  sequence.addTestVoltage(1);
+  sequence.addSetVoltageV2(4.2);
+  sequence.addEnableV2();
+  sequence.addCustom(startI2C, NULL, F("Start I2C"));
+  sequence.addVerifyI2Cdevice(0);
+  sequence.addVerifyVoltage(interrupt_pin, 1.65, 10);
+}
+
+// ************************************************************************************************
+// ----- loop -----
+
+void loop()
+{
+  if (logging)
+    logger.flush(); // Write the results of the previous board while we wait for the next one
+
+  Serial.println();
+  Serial.println(F("Press a button to start the test"));
+
+  int button = 0;
+  while (button == 0) // Keep checking the buttons until we get a valid press and release
+  {
+    button = FJ2.waitForButtonPressRelease();
+  }
+
+  FJ2.reset(); // Turn everything off including the LEDs
+
+  boolean passed = FJ2.runSequence(sequence); // Run the test steps
+
+  Wire.end(); //Stop I2C
+
+  if (logging)
+  {
+    unsigned long startMicros = micros();
+    if (!logger.logSequence(serialNumber, sequence)) // Copy the results into the logger's sector buffer
+      Serial.println(F("The log file is full!"));
+    unsigned long logMicros = micros() - startMicros;
+    Serial.print(F("Logging took "));
+    Serial.print(logMicros);
+    Serial.println(F("us"));
+  }
+  serialNumber++;
+
+  sequence.printResults(); // Print the result and time of each step
+
+  if (passed)
+  {
+    Serial.println(F("*** Tests complete - PASS ***"));
+    if (button == 1)
+      digitalWrite(FJ2_LED_PROGRAM_AND_TEST_PASS, HIGH); // Turn on the PROGRAM_AND_PASS LED
+    else
+      digitalWrite(FJ2_LED_TEST_PASS, HIGH); // Turn on the PASS LED
+  }
+  else
+  {
+    Serial.println(F("*** TEST FAILED ***"));
+    digitalWrite(FJ2_LED_FAIL, HIGH); // Turn on the FAIL LED
+  }
+}
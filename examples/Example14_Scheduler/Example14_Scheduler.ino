@@ -0,0 +1,81 @@
+/*
+  This example shows how to use the FJ2 cooperative scheduler
+
+  FJ2.run() calls each task which is due and then returns. The library has built-in tasks for the
+  averaged reads, the LED patterns, the buffered debug messages and the buttons. You can add your own tasks too.
+  The blocking library functions (e.g. isV1Shorted, testVoltage, waitForButtonPress) call run() while they wait,
+  so your tasks keep going while the tests are running.
+
+  Tasks must not block. Each call does a little work and returns. A task can be written as a protothread
+  using the FJ2_TASK_ macros, so it carries on from where it left off. Here the heartbeat task blinks the STAT LED
+  without using delay, and the button task watches the buttons in the background.
+
+  Select Mega2560 from the boards list
+*/
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h" //Click here to get the library: http://librarymanager/All#SparkFun_Jalapeno_2
+
+//The FJ library depends on the CapSense library that can be obtained here: http://librarymanager/All#CapacitiveSensor_Arduino
+
+FlyingJalapeno2 FJ2(FJ2_STAT_LED, 3.3); //Blink status msgs on STAT LED. Board should have VCC jumper set to 3.3V.
+
+unsigned long heartbeats = 0; // Updated by the heartbeat task
+
+// A protothread task: blink the STAT LED once a second
+// Local variables are lost when the task sleeps, so keep any state in globals (or in the context)
+void heartbeatTask(FJ2_Task *task)
+{
+  FJ2_TASK_BEGIN(task);
+  while (true)
+  {
+    digitalWrite(FJ2_STAT_LED, HIGH);
+    FJ2_TASK_SLEEP(task, 100);
+    digitalWrite(FJ2_STAT_LED, LOW);
+    heartbeats++;
+    FJ2_TASK_SLEEP(task, 900);
+  }
+  FJ2_TASK_END(task);
+}
+
+// A periodic task: print the number of heartbeats every 10 seconds
+void reportTask(FJ2_Task *task)
+{
+  Serial.print(F("Heartbeats: "));
+  Serial.println(heartbeats);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println("FJ2 scheduler example");
+
+  //FJ2.enableDebugging(Serial, true); //Uncomment this line to enable buffered debug messages. They are printed by the debug task
+
+  FJ2.reset(); // Set up the FJ2 pins. Turn everything off - including the LEDs. This will call userReset too
+
+  FJ2.addTask(heartbeatTask); // The protothread sets its own deadlines
+  FJ2.addTask(reportTask, NULL, 10000); // Run every 10 seconds
+
+  FJ2.enableTask(FJ2_TASK_BUTTONS); // Watch the buttons in the background
+}
+
+void loop()
+{
+  FJ2.run(); // Run the tasks which are due
+
+  uint8_t button;
+  if (FJ2.getButtonEvent(&button) == FJ2_BUTTON_EVENT_PRESS_RELEASE)
+  {
+    Serial.print(F("Button "));
+    Serial.print(button);
+    Serial.println(F(" pressed. Testing V1 for a short"));
+
+    // isV1Shorted blocks until the test is complete. The heartbeat keeps going while it runs
+    if (FJ2.isV1Shorted())
+      Serial.println(F("V1 is shorted!"));
+    else
+      Serial.println(F("V1 is OK"));
+
+    FJ2.runFor(500); // Like delay - but the tasks keep going
+  }
+}
@@ -36,6 +36,8 @@ void setup()
 
   //FJ2.setAnalogReadSamples(50); //Uncomment this line to set the number of analog reads for averaging. Default is 25
 
+  //FJ2.setEarlyExit(true); //Uncomment this line to stop sampling as soon as the result is certain. Clearly good or clearly bad boards need fewer samples
+
   FJ2.setVoltageV1(3.3); //Get ready to set V1 to 3.3V
   FJ2.setVoltageV2(3.3); //Get ready to set V2 to 3.3V
 
@@ -51,6 +53,17 @@ void setup()
     while(1); // Do nothing more
   }
 
+  //Or test both rails at once. The power test network is only energised once, so this takes about half as long:
+  //FJ2_ShortTestResult shorts;
+  //if(FJ2.areV1V2Shorted(550, &shorts) == true)
+  //{
+  //  Serial.print("Whoa! Short detected. V1 reading: ");
+  //  Serial.print(shorts.v1Reading);
+  //  Serial.print(" V2 reading: ");
+  //  Serial.println(shorts.v2Reading);
+  //  while(1); // Do nothing more
+  //}
+
   Serial.println("No shorts detected!");
 
   //Now power up the target
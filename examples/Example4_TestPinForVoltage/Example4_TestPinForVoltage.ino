@@ -30,6 +30,10 @@ void setup()
 
   //FJ2.setAnalogReadSamples(50); //Uncomment this line to set the number of analog reads for averaging. Default is 25
 
+  //FJ2.configureADC(32, DEFAULT, true); //Uncomment this line to run the ADC 4x faster (26us per conversion, with a little less accuracy) and discard the first conversion of each reading
+
+  //FJ2.setVCCCalibration(FJ2_VCC_FROM_BANDGAP); //Uncomment this line to measure the actual VCC (after each reset) so the voltage tests don't depend on the USB supply
+
   FJ2.setVoltageV1(3.3); //Get ready to set V1 to 3.3V
   FJ2.setVoltageV2(3.3); //Get ready to set V2 to 3.3V
 
@@ -57,6 +61,11 @@ void loop()
   //This demonstrates the extended call to the function
   //You can omit the tolerance is you want to
   boolean result = FJ2.verifyVoltage(A0, 3.3, 15); //A0, 3.3V, within 15%
+
+  //verifyVoltage works out the ADC window for 3.3V +/- 15% each time it is called. To save time, the window can be
+  //worked out once - by the compiler - and then tested with verifyCounts. The last parameter is the FJ2 VCC:
+  //const FJ2_AdcWindow window = FJ2_adcWindow(3.3, 15, 3.3);
+  //boolean result = FJ2.verifyCounts(A0, window); //Uncomment these lines (and comment the verifyVoltage line) to use the integer test
   
   if(result == true)
   {
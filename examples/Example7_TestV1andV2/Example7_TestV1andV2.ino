@@ -26,6 +26,8 @@ void setup()
 
   //FJ2.setAnalogReadSamples(50); //Uncomment this line to set the number of analog reads for averaging. Default is 25
 
+  //FJ2.setAnalogFilter(FJ2_FILTER_TRIMMED_MEAN, 2); //Uncomment this line to discard the two highest and two lowest samples before averaging. Glitches have less effect
+
   if(FJ2.testVCC() == false)
   {
     while(1) // Stay in this loop until reset
@@ -78,6 +80,29 @@ void setup()
   }
 
   Serial.println("V1 and V2 are OK!");
+
+  //Or, instead of enableV1 and testVoltage(1), enable V1 and watch it rise. If V1 does not rise (e.g. because of a heavy load)
+  //it is turned off again within 5ms. The ramp, rise time and final reading are stored in ramp:
+  //FJ2_RampCapture ramp;
+  //if(FJ2.enableV1WithCapture(&ramp) == false)
+  //{
+  //  Serial.print("Whoa! V1 did not ramp up. Final reading: ");
+  //  Serial.println(ramp.finalReading);
+  //}
+
+  //To characterise the V2 regulator, step it through all of its settings without turning it off (VCC must be 5V to verify 4.2V and 5.0V):
+  //const float settings[] = { 3.3, 3.7, 4.2, 5.0 };
+  //FJ2_SweepResult results[4];
+  //FJ2.sweepV2(settings, results, 4);
+  //for (int i = 0; i < 4; i++)
+  //{
+  //  Serial.print(results[i].setting);
+  //  Serial.print("V setting measured ");
+  //  Serial.print(results[i].volts);
+  //  Serial.print("V. Settled in ");
+  //  Serial.print(results[i].settleMillis);
+  //  Serial.println("ms");
+  //}
 }
 
 void loop()
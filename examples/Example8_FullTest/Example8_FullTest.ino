@@ -67,13 +67,20 @@ void setup()
   Serial.println("FJ2 full test example.");
 
   //FJ2.enableDebugging(); //Uncomment this line to enable helpful debug messages on Serial
+  //FJ2.enableDebugging(Serial, true); //Or uncomment this line to buffer the debug messages. They are printed while the FJ2 is waiting, so they don't slow the tests down
 
   //FJ2.setCapSenseThreshold(1000); //Uncomment this line to set the cap sense threshold to 1000. Default is 2000
 
   //FJ2.setCapSenseSamples(20); //Uncomment this line to set the number of cap sense samples to 20. Default is 30
 
+  //FJ2.enableIncrementalCapSense(); //Uncomment this line to take a few cap sense samples per button check and track the button baselines
+
   //FJ2.setAnalogReadSamples(50); //Uncomment this line to set the number of analog reads for averaging. Default is 25
 
+  //FJ2.setSettleMode(true); //Uncomment this line to use adaptive settle detection instead of the fixed 200ms settle delay
+
+  //FJ2.setEarlyExit(true); //Uncomment this line to stop sampling as soon as the result is certain. Clearly good or clearly bad boards need fewer samples
+
   FJ2.reset(); // Set up the FJ2 pins. Turn everything off - including the LEDs. This will call userReset too
 }
 
@@ -91,7 +98,7 @@ void loop()
     {
       FJ2.reset(false); // Turn everything off except the LEDs
 
-      delay(100);
+      FJ2.runFor(100); // Like delay(100) - but the SOS pattern (if it is playing) keeps going
       Serial.println();
       Serial.println(F("Step 1: Check VCC"));
       Serial.println();
@@ -100,11 +107,13 @@ void loop()
       if (!FJ2.testVCC())
       {
         Serial.println(F("Step 1: FAIL! VCC appears to be 5V! Please change VCC to 3.3V. Sending an SOS..."));
-        FJ2.SOS(FJ2_LED_FAIL); // Blink SOS on the FJ2_LED_FAIL
+        if (!FJ2.isPlaying(FJ2_LED_FAIL))
+          FJ2.playPattern(FJ2_LED_FAIL, FJ2_PATTERN_SOS, FJ2_PATTERN_FOREVER); // Blink SOS on the FJ2_LED_FAIL - in the background
         //The code will keep going around step1 until VCC is changed
       }
       else
       {
+        FJ2.stopPattern(FJ2_LED_FAIL); // Stop the SOS (if it is playing)
         Serial.println(F("Step 1: pass. VCC is OK"));
         Serial.println();
         Serial.println(F("getButton: waiting for a button press"));
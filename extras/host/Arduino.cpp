@@ -0,0 +1,170 @@
+/*
+  Arduino.cpp - host (Linux) shim for the Flying Jalapeno 2 simulation backend
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+
+// ***** Print *****
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    if (write(*buffer++)) n++;
+    else break;
+  }
+  return (n);
+}
+
+size_t Print::print(long n, int base)
+{
+  if ((base == DEC) && (n < 0))
+  {
+    size_t t = print('-');
+    return (t + printNumber((unsigned long)(-n), DEC));
+  }
+  return (printNumber((unsigned long)n, (uint8_t)base));
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do
+  {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return (write(str));
+}
+
+//The same algorithm as the Arduino core, so the output matches the real thing
+size_t Print::printFloat(double number, uint8_t digits)
+{
+  size_t n = 0;
+  if (isnan(number)) return print("nan");
+  if (isinf(number)) return print("inf");
+  if (number > 4294967040.0) return print("ovf");
+  if (number < -4294967040.0) return print("ovf");
+  if (number < 0.0)
+  {
+    n += print('-');
+    number = -number;
+  }
+  double rounding = 0.5;
+  for (uint8_t i = 0; i < digits; ++i)
+    rounding /= 10.0;
+  number += rounding;
+  unsigned long int_part = (unsigned long)number;
+  double remainder = number - (double)int_part;
+  n += print(int_part);
+  if (digits > 0)
+    n += print('.');
+  while (digits-- > 0)
+  {
+    remainder *= 10.0;
+    unsigned int toPrint = (unsigned int)(remainder);
+    n += print(toPrint);
+    remainder -= toPrint;
+  }
+  return (n);
+}
+
+// ***** Serial *****
+
+HardwareSerial Serial;
+
+//Each byte takes 10 bits at the baud rate. Like the real thing, there is a 64 byte transmit buffer:
+//write only blocks (advances the clock) when the buffer is full
+static uint64_t _serialTxDoneMicros = 0; // When the transmit buffer will be empty
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  FJ2Sim.serialBytes++;
+  if (FJ2Sim.serialEcho && (FJ2Sim.serialRaw || (c != '\r')))
+    putchar(c);
+
+  if (_baud > 0)
+  {
+    uint64_t byteMicros = 10000000ULL / _baud;
+    uint64_t now = FJ2Sim.nowMicros;
+    if (_serialTxDoneMicros < now)
+      _serialTxDoneMicros = now;
+    _serialTxDoneMicros += byteMicros;
+    uint64_t bufferMicros = 64 * byteMicros;
+    if (_serialTxDoneMicros > (now + bufferMicros)) // Buffer full - wait
+      FJ2Sim.advanceMicros(_serialTxDoneMicros - now - bufferMicros);
+  }
+  return (1);
+}
+
+int HardwareSerial::availableForWrite()
+{
+  if (_baud == 0)
+    return (63);
+  uint64_t byteMicros = 10000000ULL / _baud;
+  uint64_t now = FJ2Sim.nowMicros;
+  if (_serialTxDoneMicros <= now)
+    return (63);
+  uint64_t queued = (_serialTxDoneMicros - now + byteMicros - 1) / byteMicros;
+  return ((queued >= 63) ? 0 : (int)(63 - queued));
+}
+
+// ***** Pins, ADC and time *****
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  FJ2Sim.pinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  FJ2Sim.digitalWrite(pin, val);
+}
+
+int digitalRead(uint8_t pin)
+{
+  return (FJ2Sim.digitalRead(pin));
+}
+
+int analogRead(uint8_t pin)
+{
+  return (FJ2Sim.analogRead(pin));
+}
+
+void analogReference(uint8_t mode)
+{
+  FJ2Sim.adcReference = mode;
+}
+
+//millis and micros cost a little time, so polling loops always make progress
+unsigned long millis(void)
+{
+  FJ2Sim.advanceMicros(1);
+  return ((unsigned long)(FJ2Sim.nowMicros / 1000));
+}
+
+unsigned long micros(void)
+{
+  FJ2Sim.advanceMicros(1);
+  return ((unsigned long)FJ2Sim.nowMicros);
+}
+
+void delay(unsigned long ms)
+{
+  FJ2Sim.delayMicrosTotal += (uint64_t)ms * 1000;
+  FJ2Sim.advanceMicros((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  FJ2Sim.delayMicrosTotal += us;
+  FJ2Sim.advanceMicros(us);
+}
@@ -0,0 +1,173 @@
+/*
+  Arduino.h - host (Linux) shim for the Flying Jalapeno 2 simulation backend
+
+  This provides the subset of the Arduino API used by the FJ2 library and its examples.
+  Every call is routed to the simulated board (FJ2SimBoard) which models the pin states,
+  the ADC, a virtual clock, the I2C bus and the cap sense buttons.
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#ifndef _FJ2_HOST_ARDUINO_H_
+#define _FJ2_HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef ARDUINO
+#define ARDUINO 10819
+#endif
+
+#ifndef FJ2_HOST_SIM
+#define FJ2_HOST_SIM // Lets sketches and the library know they are running on the simulated board
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+//The Mega2560 pin numbers
+#define NUM_DIGITAL_PINS 70
+#define LED_BUILTIN 13
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+#define A10 64
+#define A11 65
+#define A12 66
+#define A13 67
+#define A14 68
+#define A15 69
+
+//analogReference options (the Mega2560 values)
+#define DEFAULT 1
+#define EXTERNAL 0
+#define INTERNAL1V1 2
+#define INTERNAL2V56 3
+
+//Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_float(addr) (*(const float *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+//There are no interrupts on the host
+#define noInterrupts()
+#define interrupts()
+
+template <class T> static inline T constrain(T amt, T low, T high) { return (amt < low) ? low : ((amt > high) ? high : amt); }
+#ifndef min
+template <class T, class U> static inline T min(T a, U b) { return (a < (T)b) ? a : (T)b; }
+template <class T, class U> static inline T max(T a, U b) { return (a > (T)b) ? a : (T)b; }
+#endif
+
+static inline bool isPrintable(int c) { return ((c >= 0x20) && (c < 0x7F)); }
+
+// ***** Print and Stream *****
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return (str == NULL) ? 0 : write((const uint8_t *)str, strlen(str)); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper *ifsh) { return write(reinterpret_cast<const char *>(ifsh)); }
+    size_t print(const char str[]) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC) { return printNumber(n, (uint8_t)base); }
+    size_t print(double n, int digits = 2) { return printFloat(n, (uint8_t)digits); }
+
+    size_t println(void) { return write("\r\n"); }
+    template <class T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <class T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+  private:
+    size_t printNumber(unsigned long n, uint8_t base);
+    size_t printFloat(double number, uint8_t digits);
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+//Serial prints go to stdout. Each byte takes 10 bits of simulated time at the chosen baud rate (see Arduino.cpp)
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long baud) { _baud = baud; }
+    void end() { _baud = 0; }
+    size_t write(uint8_t c);
+    using Print::write;
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    int availableForWrite();
+    operator bool() { return true; }
+    unsigned long _baud = 0;
+};
+
+extern HardwareSerial Serial;
+
+// ***** Pins, ADC and time *****
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t mode);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+//The sketch functions
+void setup(void);
+void loop(void);
+
+#include "FJ2_SimBoard.h"
+
+#endif
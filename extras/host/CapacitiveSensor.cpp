@@ -0,0 +1,45 @@
+/*
+  CapacitiveSensor.cpp - host (Linux) shim for the Flying Jalapeno 2 simulation backend
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "CapacitiveSensor.h"
+
+//Like the real library, the constructor configures the send pin as an output and pulls it low
+CapacitiveSensor::CapacitiveSensor(uint8_t sendPin, uint8_t receivePin)
+{
+  _receivePin = receivePin;
+  leastTotal = 0x0FFFFFFFL;
+  CS_Timeout_Millis = 2000;
+  CS_AutocaL_Millis = 20000;
+  lastCal = 0;
+  total = 0;
+  pinMode(sendPin, OUTPUT);
+  pinMode(receivePin, INPUT);
+  digitalWrite(sendPin, LOW);
+}
+
+long CapacitiveSensor::capacitiveSensorRaw(uint8_t samples)
+{
+  total = 0;
+  if (samples == 0) return (0);
+  for (uint8_t i = 0; i < samples; i++)
+    total += FJ2Sim.capSenseSample(_receivePin);
+  return (total);
+}
+
+//The same auto-calibration as the real library
+long CapacitiveSensor::capacitiveSensor(uint8_t samples)
+{
+  capacitiveSensorRaw(samples);
+  if (samples == 0) return (0);
+  if ((millis() - lastCal > CS_AutocaL_Millis) && (labs((long)total - (long)leastTotal) < (long)(0.10 * (float)leastTotal)))
+  {
+    leastTotal = 0x0FFFFFFFL;
+    lastCal = millis();
+  }
+  if (total < leastTotal) leastTotal = total;
+  return (total - leastTotal);
+}
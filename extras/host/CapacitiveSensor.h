@@ -0,0 +1,35 @@
+/*
+  CapacitiveSensor.h - host (Linux) shim for the Flying Jalapeno 2 simulation backend
+
+  The charge-time samples come from the simulated cap sense buttons.
+  capacitiveSensor has the same auto-calibration as the real library
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#ifndef _FJ2_HOST_CAPACITIVE_SENSOR_H_
+#define _FJ2_HOST_CAPACITIVE_SENSOR_H_
+
+#include "Arduino.h"
+
+class CapacitiveSensor
+{
+  public:
+    CapacitiveSensor(uint8_t sendPin, uint8_t receivePin);
+    long capacitiveSensorRaw(uint8_t samples);
+    long capacitiveSensor(uint8_t samples);
+    void set_CS_Timeout_Millis(unsigned long timeout_millis) { CS_Timeout_Millis = timeout_millis; }
+    void reset_CS_AutoCal() { leastTotal = 0x0FFFFFFFL; }
+    void set_CS_AutocaL_Millis(unsigned long autoCal_millis) { CS_AutocaL_Millis = autoCal_millis; }
+
+  private:
+    uint8_t _receivePin;
+    unsigned long leastTotal;
+    unsigned long CS_Timeout_Millis;
+    unsigned long CS_AutocaL_Millis;
+    unsigned long lastCal;
+    unsigned long total;
+};
+
+#endif
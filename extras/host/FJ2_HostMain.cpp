@@ -0,0 +1,74 @@
+/*
+  FJ2_HostMain.cpp - runs an FJ2 sketch on the simulated board
+
+  Usage: <sketch> [options]
+    --loops N          Call loop() N times (default 100)
+    --seconds S        Stop after S seconds of simulated time (default 600)
+    --vcc V            Set the FJ2 VCC (3.3 or 5.0. Default 3.3)
+    --short-v1         Simulate a short on V1
+    --short-v2         Simulate a short on V2
+    --i2c ADDRESS      Add an I2C device at ADDRESS (e.g. 0x42). Can be repeated
+    --pin PIN VOLTS    Drive PIN (e.g. 55 for A1) from the board under test at VOLTS. Can be repeated
+    --press BUTTON     Press BUTTON (1 or 2) for 200ms every 2 seconds
+    --quiet            Do not copy Serial output to stdout
+    --raw              Copy Serial output to stdout byte for byte (e.g. for FJ2_TOKENIZED_DEBUG). Otherwise '\r' is dropped
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "Arduino.h"
+
+int main(int argc, char *argv[])
+{
+  unsigned long loops = 100;
+  double seconds = 600.0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "--loops") == 0) && (i + 1 < argc))
+      loops = strtoul(argv[++i], NULL, 0);
+    else if ((strcmp(argv[i], "--seconds") == 0) && (i + 1 < argc))
+      seconds = atof(argv[++i]);
+    else if ((strcmp(argv[i], "--vcc") == 0) && (i + 1 < argc))
+      FJ2Sim.vcc = atof(argv[++i]);
+    else if (strcmp(argv[i], "--short-v1") == 0)
+      FJ2Sim.v1Shorted = true;
+    else if (strcmp(argv[i], "--short-v2") == 0)
+      FJ2Sim.v2Shorted = true;
+    else if ((strcmp(argv[i], "--i2c") == 0) && (i + 1 < argc))
+      FJ2Sim.addI2CDevice((uint8_t)strtoul(argv[++i], NULL, 0));
+    else if ((strcmp(argv[i], "--pin") == 0) && (i + 2 < argc))
+    {
+      uint8_t pin = (uint8_t)strtoul(argv[++i], NULL, 0);
+      FJ2Sim.setPinVoltage(pin, atof(argv[++i]));
+    }
+    else if ((strcmp(argv[i], "--press") == 0) && (i + 1 < argc))
+      FJ2Sim.autoPressButton((uint8_t)strtoul(argv[++i], NULL, 0), 2000, 200);
+    else if (strcmp(argv[i], "--quiet") == 0)
+      FJ2Sim.serialEcho = false;
+    else if (strcmp(argv[i], "--raw") == 0)
+      FJ2Sim.serialRaw = true;
+    else
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return (2);
+    }
+  }
+
+  setup();
+
+  unsigned long loopCount = 0;
+  while ((loopCount < loops) && (((double)FJ2Sim.nowMicros / 1000000.0) < seconds))
+  {
+    loop();
+    loopCount++;
+  }
+
+  fflush(stdout);
+  fprintf(stderr, "\nFJ2Sim: %lu loops in %.3f simulated seconds\n", loopCount, (double)FJ2Sim.nowMicros / 1000000.0);
+  fprintf(stderr, "FJ2Sim: analogReads %lu, digitalOps %lu, capSenseSamples %lu, i2cTransmissions %lu, serialBytes %lu, delay %.3fs\n",
+          FJ2Sim.analogReads, FJ2Sim.digitalOps, FJ2Sim.capSenseSamples, FJ2Sim.i2cTransmissions, FJ2Sim.serialBytes,
+          (double)FJ2Sim.delayMicrosTotal / 1000000.0);
+  return (0);
+}
@@ -0,0 +1,357 @@
+/*
+  FJ2_SimBoard.cpp - a simulated Flying Jalapeno 2 (Mega2560) for host builds
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h"
+
+//The one simulated board
+FJ2SimBoard &FJ2SimBoard::instance()
+{
+  static FJ2SimBoard board;
+  return (board);
+}
+
+FJ2SimBoard::FJ2SimBoard()
+{
+  memset(_i2cDevices, 0, sizeof(_i2cDevices));
+  for (int i = 0; i < 2; i++)
+  {
+    _autoPeriodMillis[i] = 0;
+    _autoHoldMillis[i] = 0;
+    for (int j = 0; j < FJ2_SIM_MAX_PRESSES; j++)
+    {
+      _pressAt[i][j] = 0;
+      _releaseAt[i][j] = 0;
+    }
+  }
+  for (int pin = 0; pin < FJ2_SIM_NUM_PINS; pin++)
+    _externalVolts[pin] = -1.0;
+  powerOn();
+}
+
+//Return the board to its power-on state. The configuration and statistics are not changed
+void FJ2SimBoard::powerOn()
+{
+  nowMicros = 0;
+  for (int pin = 0; pin < FJ2_SIM_NUM_PINS; pin++)
+  {
+    _mode[pin] = INPUT;
+    _output[pin] = LOW;
+  }
+  for (int channel = 0; channel < 16; channel++)
+  {
+    _targetCounts[channel] = 0.0;
+    _startCounts[channel] = 0.0;
+    _tauMicros[channel] = 0.0;
+    _transitionMicros[channel] = 0;
+  }
+  _buttonPressed[0] = false;
+  _buttonPressed[1] = false;
+  i2cBegun = false;
+  i2cClockHz = 100000;
+  updateAnalogTargets();
+}
+
+//Zero the call counters
+void FJ2SimBoard::resetStatistics()
+{
+  analogReads = 0;
+  digitalOps = 0;
+  capSenseSamples = 0;
+  i2cTransmissions = 0;
+  serialBytes = 0;
+  delayMicrosTotal = 0;
+}
+
+// ***** The virtual clock *****
+
+void FJ2SimBoard::advanceMicros(uint64_t micros)
+{
+  nowMicros += micros;
+}
+
+// ***** The board configuration *****
+
+//Set an external (board under test) voltage on a pin. Negative clears it
+void FJ2SimBoard::setPinVoltage(uint8_t pin, float volts)
+{
+  if (pin >= FJ2_SIM_NUM_PINS)
+    return;
+  _externalVolts[pin] = volts;
+  updateAnalogTargets();
+}
+
+// ***** I2C *****
+
+void FJ2SimBoard::addI2CDevice(uint8_t address)
+{
+  if (address < 128)
+    _i2cDevices[address >> 3] |= (1 << (address & 7));
+}
+
+void FJ2SimBoard::removeI2CDevice(uint8_t address)
+{
+  if (address < 128)
+    _i2cDevices[address >> 3] &= ~(1 << (address & 7));
+}
+
+//True if the device is present and the I2C buffer is enabled
+bool FJ2SimBoard::isI2CDevicePresent(uint8_t address)
+{
+  if ((address >= 128) || (!i2cBegun))
+    return (false);
+  if ((_mode[FJ2_I2C_EN] != OUTPUT) || (_output[FJ2_I2C_EN] != HIGH))
+    return (false); // The buffer is disabled
+  return ((_i2cDevices[address >> 3] & (1 << (address & 7))) != 0);
+}
+
+// ***** Cap sense buttons *****
+
+void FJ2SimBoard::setButton(uint8_t button, bool pressed)
+{
+  if ((button == 1) || (button == 2))
+    _buttonPressed[button - 1] = pressed;
+}
+
+//Press button 1 or 2 at atMillis for holdMillis
+void FJ2SimBoard::scheduleButtonPress(uint8_t button, unsigned long atMillis, unsigned long holdMillis)
+{
+  if ((button != 1) && (button != 2))
+    return;
+  for (int i = 0; i < FJ2_SIM_MAX_PRESSES; i++)
+  {
+    if (_releaseAt[button - 1][i] <= (nowMicros / 1000)) // Is this slot free (or finished)?
+    {
+      _pressAt[button - 1][i] = atMillis;
+      _releaseAt[button - 1][i] = atMillis + holdMillis;
+      return;
+    }
+  }
+}
+
+//Press button 1 or 2 for holdMillis every periodMillis. 0 disables
+void FJ2SimBoard::autoPressButton(uint8_t button, unsigned long periodMillis, unsigned long holdMillis)
+{
+  if ((button != 1) && (button != 2))
+    return;
+  _autoPeriodMillis[button - 1] = periodMillis;
+  _autoHoldMillis[button - 1] = holdMillis;
+}
+
+bool FJ2SimBoard::isButtonPressed(uint8_t button)
+{
+  if ((button != 1) && (button != 2))
+    return (false);
+  unsigned long nowMillis = nowMicros / 1000;
+  int b = button - 1;
+  if (_buttonPressed[b])
+    return (true);
+  for (int i = 0; i < FJ2_SIM_MAX_PRESSES; i++)
+  {
+    if ((nowMillis >= _pressAt[b][i]) && (nowMillis < _releaseAt[b][i]))
+      return (true);
+  }
+  if ((_autoPeriodMillis[b] > 0) && (nowMillis >= _autoPeriodMillis[b]) && ((nowMillis % _autoPeriodMillis[b]) < _autoHoldMillis[b]))
+    return (true);
+  return (false);
+}
+
+//Take one cap sense sample on receivePin. Returns the count and advances the clock
+long FJ2SimBoard::capSenseSample(uint8_t receivePin)
+{
+  uint8_t button = (receivePin == FJ2_CAP_SENSE_BUTTON_2) ? 2 : 1;
+  long counts = isButtonPressed(button) ? capSenseCountsPressed : capSenseCountsReleased;
+  counts += (long)((capSenseDriftPerMinute * (int64_t)nowMicros) / 60000000);
+  _noiseSeed = _noiseSeed * 1103515245 + 12345;
+  counts += (long)((_noiseSeed >> 16) % 5) - 2; // +/- 2 counts
+  if (counts < 1) counts = 1;
+
+  capSenseSamples++;
+  advanceMicros(capSenseCycleMicros + (uint64_t)(2.0 * capSenseMicrosPerCount * counts)); // Charge and discharge
+  return (counts);
+}
+
+// ***** The pins *****
+
+void FJ2SimBoard::pinMode(uint8_t pin, uint8_t mode)
+{
+  digitalOps++;
+  advanceMicros(digitalOpMicros);
+  if (pin >= FJ2_SIM_NUM_PINS)
+    return;
+  _mode[pin] = (mode == OUTPUT) ? OUTPUT : INPUT;
+  if (mode == INPUT)
+    _output[pin] = LOW; // The AVR core clears the PORT bit (disables the pull-up)
+  else if (mode == INPUT_PULLUP)
+    _output[pin] = HIGH;
+  updateAnalogTargets();
+}
+
+void FJ2SimBoard::digitalWrite(uint8_t pin, uint8_t val)
+{
+  digitalOps++;
+  advanceMicros(digitalOpMicros);
+  if (pin >= FJ2_SIM_NUM_PINS)
+    return;
+  _output[pin] = (val == LOW) ? LOW : HIGH;
+  updateAnalogTargets();
+}
+
+int FJ2SimBoard::digitalRead(uint8_t pin)
+{
+  digitalOps++;
+  advanceMicros(digitalOpMicros);
+  if (pin >= FJ2_SIM_NUM_PINS)
+    return (LOW);
+  if (_mode[pin] == OUTPUT)
+    return (_output[pin]);
+  if (_externalVolts[pin] >= 0.0)
+    return ((_externalVolts[pin] > (vcc / 2.0)) ? HIGH : LOW);
+  if (pin == FJ2_CAP_SENSE_BUTTON_1) // AT42QT1011 buttons
+    return (isButtonPressed(1) ? HIGH : LOW);
+  if (pin == FJ2_CAP_SENSE_BUTTON_2)
+    return (isButtonPressed(2) ? HIGH : LOW);
+  return (_output[pin]); // The pull-up (if enabled)
+}
+
+int FJ2SimBoard::analogRead(uint8_t pin)
+{
+  analogReads++;
+  advanceMicros(analogReadMicros);
+  uint8_t channel = (pin >= A0) ? pin - A0 : pin;
+  if (channel >= 16)
+    return (0);
+  float counts = countsNow(channel); // Relative to VCC
+  if (adcReference == INTERNAL1V1) counts *= vcc / 1.1;
+  else if (adcReference == INTERNAL2V56) counts *= vcc / 2.56;
+  else if (adcReference == EXTERNAL) counts *= vcc / externalReferenceVolts;
+  _noiseSeed = _noiseSeed * 1103515245 + 12345;
+  if (adcNoiseCounts > 0)
+    counts += (float)((int)((_noiseSeed >> 16) % (2 * adcNoiseCounts + 1)) - adcNoiseCounts);
+  int result = (int)(counts + 0.5);
+  if (result < 0) result = 0;
+  if (result > 1023) result = 1023;
+  return (result);
+}
+
+uint8_t FJ2SimBoard::getPinMode(uint8_t pin)
+{
+  return (pin < FJ2_SIM_NUM_PINS ? _mode[pin] : INPUT);
+}
+
+uint8_t FJ2SimBoard::getPinOutput(uint8_t pin)
+{
+  return (pin < FJ2_SIM_NUM_PINS ? _output[pin] : LOW);
+}
+
+// ***** The analog model *****
+
+//True if the V1 (1) or V2 (2) high side switch is on
+bool FJ2SimBoard::railEnabled(uint8_t select)
+{
+  uint8_t pin = (select == 1) ? FJ2_V1_POWER_CONTROL : FJ2_V2_POWER_CONTROL;
+  return ((_mode[pin] == OUTPUT) && (_output[pin] == HIGH));
+}
+
+//The V1 (1) or V2 (2) regulator voltage - set by whichever control resistors are pulled low
+float FJ2SimBoard::railSetting(uint8_t select)
+{
+  const uint8_t v1Pins[] = { FJ2_V1_CONTROL_TO_3V3, FJ2_V1_CONTROL_TO_5V0 };
+  const float v1Volts[] = { 3.3, 5.0 };
+  const uint8_t v2Pins[] = { FJ2_V2_CONTROL_TO_3V3, FJ2_V2_CONTROL_TO_3V7, FJ2_V2_CONTROL_TO_4V2, FJ2_V2_CONTROL_TO_5V0 };
+  const float v2Volts[] = { 3.3, 3.7, 4.2, 5.0 };
+  const uint8_t *pins = (select == 1) ? v1Pins : v2Pins;
+  const float *volts = (select == 1) ? v1Volts : v2Volts;
+  int num = (select == 1) ? 2 : 4;
+
+  //Resistors in parallel raise the voltage, so use the highest selected
+  float setting = regulatorMinimumVolts;
+  for (int i = 0; i < num; i++)
+  {
+    if ((_mode[pins[i]] == OUTPUT) && (_output[pins[i]] == LOW) && (volts[i] > setting))
+      setting = volts[i];
+  }
+  return (setting);
+}
+
+//The V1 (1) or V2 (2) output voltage now (ignoring the ramp)
+float FJ2SimBoard::getRailVolts(uint8_t select)
+{
+  if (!railEnabled(select))
+    return (0.0);
+  if (((select == 1) && v1Shorted) || ((select == 2) && v2Shorted))
+    return (0.0);
+  return (railSetting(select));
+}
+
+//The settled ADC reading for channel and the time constant of the transition towards it
+float FJ2SimBoard::analogTarget(uint8_t channel, float *tauMillis)
+{
+  *tauMillis = 0.0;
+
+  uint8_t pin = A0 + channel;
+  if (_externalVolts[pin] >= 0.0)
+    return (_externalVolts[pin] / vcc * 1023.0);
+
+  if (pin == FJ2_BRAIN_VCC_A0)
+  {
+    //The 3.3V Zener. At 3.3V the Zener is not fully on and reads ~900. At 5V it reads 3.3/5.0 of full scale
+    if (vcc < 3.4)
+      return (900.0);
+    return (3.3 / vcc * 1023.0);
+  }
+
+  if ((pin == FJ2_PT_READ_V1) || (pin == FJ2_PT_READ_V2))
+  {
+    uint8_t select = (pin == FJ2_PT_READ_V1) ? 1 : 2;
+    bool shorted = (select == 1) ? v1Shorted : v2Shorted;
+    if (railEnabled(select))
+    {
+      *tauMillis = railTauMillis;
+      return (getRailVolts(select) * 10.0 / 11.0 * ptReadGain / vcc * 1023.0); // The 10k/11k divider
+    }
+    if ((_mode[FJ2_POWER_TEST_CONTROL] == OUTPUT) && (_output[FJ2_POWER_TEST_CONTROL] == HIGH))
+    {
+      //Readings from a real FJ2: 3.3V: open 680, short 410; 5.0V: open 620, short 430
+      *tauMillis = powerTestTauMillis;
+      float fraction = (vcc - 3.3) / (5.0 - 3.3);
+      if (shorted)
+        return (410.0 + (fraction * 20.0));
+      return (680.0 - (fraction * 60.0));
+    }
+    *tauMillis = railTauMillis; // Discharging
+    return (0.0);
+  }
+
+  return (0.0);
+}
+
+//The ADC reading for channel now - following the exponential transition towards the target
+float FJ2SimBoard::countsNow(uint8_t channel)
+{
+  if (_tauMicros[channel] <= 0.0)
+    return (_targetCounts[channel]);
+  float elapsed = (float)(nowMicros - _transitionMicros[channel]);
+  return (_targetCounts[channel] + ((_startCounts[channel] - _targetCounts[channel]) * expf(-elapsed / _tauMicros[channel])));
+}
+
+//Called whenever a pin changes. Start a new transition on any channel whose target has changed
+void FJ2SimBoard::updateAnalogTargets()
+{
+  for (uint8_t channel = 0; channel < 16; channel++)
+  {
+    float tauMillis;
+    float target = analogTarget(channel, &tauMillis);
+    if (target > 1023.0) target = 1023.0;
+    if ((target != _targetCounts[channel]) || ((tauMillis * 1000.0) != _tauMicros[channel]))
+    {
+      _startCounts[channel] = countsNow(channel);
+      _targetCounts[channel] = target;
+      _tauMicros[channel] = tauMillis * 1000.0;
+      _transitionMicros[channel] = nowMicros;
+    }
+  }
+}
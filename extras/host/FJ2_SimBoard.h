@@ -0,0 +1,127 @@
+/*
+  FJ2_SimBoard.h - a simulated Flying Jalapeno 2 (Mega2560) for host builds
+
+  The simulated board models:
+    the pin modes and output states
+    the ADC - including the FJ2_PT_READ_V1/V2 resistor dividers, the power test network and the 3.3V Zener on A0
+    a virtual clock which is advanced by delays and by the (typical Mega2560) cost of each hardware call
+    the I2C bus (devices only respond when the FJ2 I2C buffer is enabled)
+    the cap sense buttons (charge times, with press schedules)
+  and counts the hardware calls so timing changes can be measured.
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#ifndef _FJ2_SIM_BOARD_H_
+#define _FJ2_SIM_BOARD_H_
+
+#include <stdint.h>
+
+#define FJ2_SIM_NUM_PINS 70 // Mega2560
+#define FJ2_SIM_MAX_PRESSES 8 // The number of scheduled button presses per button
+
+class FJ2SimBoard
+{
+  public:
+
+    static FJ2SimBoard &instance(); //The one simulated board. (A function-local static so it exists before any global constructor uses it)
+
+    void powerOn(); //Return the board to its power-on state. The configuration and statistics are not changed
+    void resetStatistics(); //Zero the call counters
+
+    // ***** The virtual clock *****
+    uint64_t nowMicros = 0; // Simulated time since power-on
+    void advanceMicros(uint64_t micros); //Advance the clock
+
+    //The simulated cost of each hardware call (micros). These are typical Mega2560 (16MHz) values
+    uint32_t analogReadMicros = 112; // 13 ADC clocks at 125kHz (prescaler 128) plus overhead
+    uint32_t digitalOpMicros = 4; // pinMode / digitalWrite / digitalRead look up the pin tables and disable interrupts
+    uint32_t capSenseCycleMicros = 10; // The fixed part of each cap sense charge / discharge cycle
+    float capSenseMicrosPerCount = 0.75; // Each cap sense count is one pass of the charge-time loop
+    uint32_t i2cOverheadMicros = 20; // Start, stop and Wire library overhead per transmission
+
+    // ***** The board configuration *****
+    float vcc = 3.3; // The FJ2 VCC jumper setting
+    float ptReadGain = 1.03; // The FJ2_PT_READ dividers read ~3% high (the testVoltage fiddle factor)
+    float railTauMillis = 2.0; // Time constant of V1/V2 (regulator start-up and output capacitance)
+    float powerTestTauMillis = 0.5; // Time constant of the power test network
+    float regulatorMinimumVolts = 1.25; // V1/V2 when no control resistor is selected (the regulator reference)
+    bool v1Shorted = false; // Simulate a short on V1
+    bool v2Shorted = false; // Simulate a short on V2
+    int adcNoiseCounts = 1; // Uniform noise (+/- counts) added to every ADC reading
+    uint8_t adcReference = DEFAULT; // Set by analogReference. The readings are scaled to the reference
+    float externalReferenceVolts = 2.5; // The AREF voltage (for EXTERNAL)
+    void setPinVoltage(uint8_t pin, float volts); //Set an external (board under test) voltage on a pin. Negative clears it
+
+    // ***** I2C *****
+    void addI2CDevice(uint8_t address); //Add a device to the board under test
+    void removeI2CDevice(uint8_t address);
+    bool isI2CDevicePresent(uint8_t address); //True if the device is present and the I2C buffer is enabled
+    uint32_t i2cClockHz = 100000; // Set by Wire.setClock
+    bool i2cBegun = false; // Set by Wire.begin / Wire.end
+
+    // ***** Cap sense buttons *****
+    long capSenseCountsReleased = 50; // Charge-time counts per sample when not touched
+    long capSenseCountsPressed = 200; // Charge-time counts per sample when touched
+    long capSenseDriftPerMinute = 0; // Counts per sample added for every minute of simulated time (jig warm-up)
+    void setButton(uint8_t button, bool pressed); //Press or release button 1 or 2 now
+    void scheduleButtonPress(uint8_t button, unsigned long atMillis, unsigned long holdMillis); //Press button 1 or 2 at atMillis for holdMillis
+    void autoPressButton(uint8_t button, unsigned long periodMillis, unsigned long holdMillis); //Press button 1 or 2 for holdMillis every periodMillis. 0 disables
+    bool isButtonPressed(uint8_t button);
+    long capSenseSample(uint8_t receivePin); //Take one cap sense sample. Returns the count and advances the clock
+
+    // ***** Serial *****
+    bool serialEcho = true; // Copy Serial output to stdout
+    bool serialRaw = false; // Copy every byte. Otherwise '\r' is dropped, so the output has Linux line endings
+
+    // ***** Statistics *****
+    unsigned long analogReads = 0;
+    unsigned long digitalOps = 0;
+    unsigned long capSenseSamples = 0;
+    unsigned long i2cTransmissions = 0;
+    unsigned long serialBytes = 0;
+    uint64_t delayMicrosTotal = 0; // Time spent in delay / delayMicroseconds
+
+    // ***** The pins - called by the Arduino shim *****
+    void pinMode(uint8_t pin, uint8_t mode);
+    void digitalWrite(uint8_t pin, uint8_t val);
+    int digitalRead(uint8_t pin);
+    int analogRead(uint8_t pin);
+    uint8_t getPinMode(uint8_t pin);
+    uint8_t getPinOutput(uint8_t pin);
+    float getRailVolts(uint8_t select); //The V1 (1) or V2 (2) output voltage now
+
+  private:
+
+    FJ2SimBoard();
+
+    uint8_t _mode[FJ2_SIM_NUM_PINS];
+    uint8_t _output[FJ2_SIM_NUM_PINS];
+    float _externalVolts[FJ2_SIM_NUM_PINS]; // Negative if not driven
+
+    //Each analog pin moves exponentially from _startCounts to _targetCounts, starting at _transitionMicros
+    float _targetCounts[16];
+    float _startCounts[16];
+    float _tauMicros[16];
+    uint64_t _transitionMicros[16];
+    float countsNow(uint8_t channel);
+    void updateAnalogTargets(); //Called whenever a pin changes
+    float analogTarget(uint8_t channel, float *tauMillis);
+    bool railEnabled(uint8_t select);
+    float railSetting(uint8_t select);
+
+    uint8_t _i2cDevices[16]; // Bitmap of the I2C devices present
+
+    bool _buttonPressed[2];
+    unsigned long _pressAt[2][FJ2_SIM_MAX_PRESSES];
+    unsigned long _releaseAt[2][FJ2_SIM_MAX_PRESSES];
+    unsigned long _autoPeriodMillis[2];
+    unsigned long _autoHoldMillis[2];
+
+    uint32_t _noiseSeed = 12345;
+};
+
+#define FJ2Sim (FJ2SimBoard::instance())
+
+#endif
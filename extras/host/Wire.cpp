@@ -0,0 +1,60 @@
+/*
+  Wire.cpp - host (Linux) shim for the Flying Jalapeno 2 simulation backend
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "Wire.h"
+
+TwoWire Wire;
+
+void TwoWire::begin()
+{
+  FJ2Sim.i2cBegun = true;
+  FJ2Sim.i2cClockHz = 100000; // Like the AVR Wire library, begin sets the clock to 100kHz
+}
+
+void TwoWire::end()
+{
+  FJ2Sim.i2cBegun = false;
+}
+
+void TwoWire::setClock(uint32_t clock)
+{
+  FJ2Sim.i2cClockHz = clock;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  _address = address;
+  _bytes = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  (void)data;
+  _bytes++;
+  return (1);
+}
+
+//Returns 0 for success (ACK) or 2 for NACK on the address - like the AVR Wire library
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  (void)sendStop;
+  FJ2Sim.i2cTransmissions++;
+  bool present = FJ2Sim.isI2CDevicePresent(_address);
+  uint32_t bytes = present ? (1 + _bytes) : 1; // A NACK on the address ends the transmission
+  FJ2Sim.advanceMicros(FJ2Sim.i2cOverheadMicros + ((uint64_t)bytes * 9 * 1000000) / FJ2Sim.i2cClockHz);
+  return (present ? 0 : 2);
+}
+
+//The simulated devices do not return any data
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop)
+{
+  (void)quantity;
+  (void)sendStop;
+  beginTransmission(address);
+  endTransmission();
+  return (0);
+}
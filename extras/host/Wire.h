@@ -0,0 +1,39 @@
+/*
+  Wire.h - host (Linux) shim for the Flying Jalapeno 2 simulation backend
+
+  Transmissions are routed to the simulated I2C bus. Each one costs
+  (1 + bytes) x 9 bits at the bus clock, plus FJ2Sim.i2cOverheadMicros
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#ifndef _FJ2_HOST_WIRE_H_
+#define _FJ2_HOST_WIRE_H_
+
+#include "Arduino.h"
+
+class TwoWire : public Stream
+{
+  public:
+    void begin();
+    void end();
+    void setClock(uint32_t clock);
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+    size_t write(uint8_t data);
+    using Print::write;
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+
+  private:
+    uint8_t _address = 0;
+    uint8_t _bytes = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,42 @@
+/*
+  FJ2_Test.h - a minimal check framework for the FJ2 host tests
+
+  Each test is a program with its own main. FJ2_CHECK records a failure (and carries on), so one run reports every problem.
+  FJ2_TEST_RESULT prints the summary and returns the exit code: 0 if every check passed.
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#ifndef _FJ2_TEST_H_
+#define _FJ2_TEST_H_
+
+#include <stdio.h>
+
+static int fj2TestChecks = 0;
+static int fj2TestFailures = 0;
+
+#define FJ2_CHECK(condition) \
+  do { \
+    fj2TestChecks++; \
+    if (!(condition)) { \
+      fj2TestFailures++; \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+#define FJ2_CHECK_EQUAL(actual, expected) \
+  do { \
+    fj2TestChecks++; \
+    long long _actual = (long long)(actual); \
+    long long _expected = (long long)(expected); \
+    if (_actual != _expected) { \
+      fj2TestFailures++; \
+      printf("FAIL %s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _actual, _expected); \
+    } \
+  } while (0)
+
+#define FJ2_TEST_RESULT(name) \
+  (printf("%s: %d checks, %d failed\n", (name), fj2TestChecks, fj2TestFailures), (fj2TestFailures == 0) ? 0 : 1)
+
+#endif
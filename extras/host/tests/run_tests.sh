@@ -0,0 +1,22 @@
+#!/bin/sh
+# Build and run each of the FJ2 host tests (test_*.cpp). Run from the root of the library
+# The exit code is 0 if every test passed. See extras/host/README.md
+# Released into the public domain.
+
+BUILD=${BUILD:-/tmp/fj2_tests}
+mkdir -p "$BUILD" || exit 1
+
+failed=0
+for test in extras/host/tests/test_*.cpp; do
+  name=$(basename "$test" .cpp)
+  if ! g++ -std=gnu++11 -DARDUINO=10819 -Wall -Wextra -Iextras/host -Isrc "$test" src/*.cpp \
+      extras/host/Arduino.cpp extras/host/FJ2_SimBoard.cpp extras/host/Wire.cpp extras/host/CapacitiveSensor.cpp \
+      -o "$BUILD/$name"; then
+    echo "$name: build failed"
+    failed=1
+    continue
+  fi
+  "$BUILD/$name" || failed=1
+done
+
+exit $failed
@@ -0,0 +1,159 @@
+/*
+  test_adc_engine.cpp - host test for the averaged-read engine
+
+  The reads run against the simulated ADC. FJ2SimBoard counts the analogRead conversions and keeps the virtual clock,
+  so each check compares the conversions taken - and the simulated time they took - against what was asked for.
+  This covers startAveragedRead / isReadComplete / getAveragedRead, the early exit, and the trimmed mean and median
+  clamp to FJ2_ADC_RING_SIZE samples.
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h"
+#include "FJ2_Test.h"
+
+#define TEST_PIN A1
+#define TEST_VOLTS 1.65
+
+//The polled engine takes one conversion per isReadComplete call. Anything else the read does (millis, micros, run)
+//costs at most this much simulated time per conversion
+#define OVERHEAD_MICROS_PER_SAMPLE 4
+#define OVERHEAD_MICROS_FIXED 100
+
+FlyingJalapeno2 FJ2(FJ2_STAT_LED, 3.3);
+
+static unsigned long readsBefore;
+static uint64_t microsBefore;
+
+static void startCounting()
+{
+  readsBefore = FJ2Sim.analogReads;
+  microsBefore = FJ2Sim.nowMicros;
+}
+
+static unsigned long conversions()
+{
+  return (FJ2Sim.analogReads - readsBefore);
+}
+
+//Check the simulated time is numSamples conversions (plus settleMillis) plus a little overhead
+static void checkElapsed(long numSamples, unsigned long settleMillis = 0)
+{
+  uint64_t elapsed = FJ2Sim.nowMicros - microsBefore;
+  uint64_t minimum = ((uint64_t)numSamples * FJ2Sim.analogReadMicros) + ((uint64_t)settleMillis * 1000);
+  FJ2_CHECK(elapsed >= minimum);
+  FJ2_CHECK(elapsed <= minimum + ((uint64_t)numSamples * OVERHEAD_MICROS_PER_SAMPLE) + OVERHEAD_MICROS_FIXED);
+}
+
+//averagedAnalogRead(pin, N) takes exactly N conversions
+static void testAveragedRead()
+{
+  const long counts[] = { 1, 25, 100, 1000 };
+  for (uint8_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+  {
+    startCounting();
+    int reading = FJ2.averagedAnalogRead(TEST_PIN, counts[i]);
+    FJ2_CHECK_EQUAL(conversions(), counts[i]);
+    FJ2_CHECK_EQUAL(FJ2.getLastSampleCount(), counts[i]);
+    checkElapsed(counts[i]);
+    FJ2_CHECK((reading > 500) && (reading < 530)); // 1.65V of 3.3V
+  }
+
+  //numSamples 0 uses setAnalogReadSamples
+  FJ2.setAnalogReadSamples(40);
+  startCounting();
+  FJ2.averagedAnalogRead(TEST_PIN);
+  FJ2_CHECK_EQUAL(conversions(), 40);
+  FJ2.setAnalogReadSamples();
+}
+
+//The non-blocking calls take one conversion per isReadComplete (on the host) and the result matches the blocking read
+static void testNonBlocking()
+{
+  startCounting();
+  FJ2.startAveragedRead(TEST_PIN, 50);
+  long polls = 0;
+  while (!FJ2.isReadComplete())
+    polls++;
+  FJ2_CHECK_EQUAL(conversions(), 50);
+  FJ2_CHECK_EQUAL(polls, 49); // The call which takes the last sample returns true
+  checkElapsed(50);
+  int reading = FJ2.getAveragedRead();
+  FJ2_CHECK((reading > 500) && (reading < 530));
+  FJ2_CHECK(FJ2.isReadComplete()); // No more conversions once the read is complete
+  FJ2_CHECK_EQUAL(conversions(), 50);
+}
+
+//With the early exit, verifyVoltage stops as soon as the verdict is certain - and never takes more than asked for
+static void testEarlyExit()
+{
+  FJ2.setAnalogReadSamples(1000);
+
+  startCounting();
+  FJ2_CHECK(FJ2.verifyVoltage(TEST_PIN, TEST_VOLTS, 10)); // Full length without the early exit
+  FJ2_CHECK_EQUAL(conversions(), 1000);
+
+  FJ2.setEarlyExit(true, 4, 8);
+
+  startCounting();
+  FJ2_CHECK(FJ2.verifyVoltage(TEST_PIN, TEST_VOLTS, 10)); // Well inside the window
+  long taken = FJ2.getLastSampleCount();
+  FJ2_CHECK((taken >= 8) && (taken < 100));
+  FJ2_CHECK_EQUAL(conversions(), taken); // The conversions stop with the read
+  checkElapsed(taken, FJ2.getLastSettleMillis()); // verifyVoltage waits for the pin to settle first
+
+  startCounting();
+  FJ2_CHECK(!FJ2.verifyVoltage(TEST_PIN, 3.0, 10)); // Well outside the window
+  taken = FJ2.getLastSampleCount();
+  FJ2_CHECK((taken >= 8) && (taken < 100));
+  FJ2_CHECK_EQUAL(conversions(), taken);
+
+  FJ2.setEarlyExit(false);
+  FJ2.setAnalogReadSamples();
+}
+
+//The trimmed mean and median sort the samples in a ring-sized buffer, so they take at most FJ2_ADC_RING_SIZE.
+//They also turn the early exit off
+static void testSortedFilterClamp()
+{
+  const FJ2_adc_filter_e filters[] = { FJ2_FILTER_TRIMMED_MEAN, FJ2_FILTER_MEDIAN };
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    FJ2.setAnalogFilter(filters[i]);
+
+    startCounting();
+    int reading = FJ2.averagedAnalogRead(TEST_PIN, 100);
+    FJ2_CHECK_EQUAL(conversions(), FJ2_ADC_RING_SIZE);
+    FJ2_CHECK_EQUAL(FJ2.getLastSampleCount(), FJ2_ADC_RING_SIZE);
+    checkElapsed(FJ2_ADC_RING_SIZE);
+    FJ2_CHECK((reading > 500) && (reading < 530));
+
+    startCounting();
+    FJ2.averagedAnalogRead(TEST_PIN, 10); // Fewer than the ring size - not changed
+    FJ2_CHECK_EQUAL(conversions(), 10);
+
+    FJ2.setEarlyExit(true, 4, 8);
+    FJ2.setAnalogReadSamples(1000);
+    startCounting();
+    FJ2_CHECK(FJ2.verifyVoltage(TEST_PIN, TEST_VOLTS, 10));
+    FJ2_CHECK_EQUAL(conversions(), FJ2_ADC_RING_SIZE);
+    FJ2.setEarlyExit(false);
+    FJ2.setAnalogReadSamples();
+  }
+  FJ2.setAnalogFilter(FJ2_FILTER_MEAN);
+}
+
+int main()
+{
+  FJ2Sim.adcNoiseCounts = 1;
+  FJ2Sim.setPinVoltage(TEST_PIN, TEST_VOLTS);
+  FJ2.reset();
+  delay(100); // Let the simulated pin settle
+
+  testAveragedRead();
+  testNonBlocking();
+  testEarlyExit();
+  testSortedFilterClamp();
+  return (FJ2_TEST_RESULT("test_adc_engine"));
+}
@@ -0,0 +1,195 @@
+/*
+  test_button_tracker.cpp - host test for ButtonTracker
+
+  ButtonTracker::update is driven with scripted button states, one call per simulated milli, and the events
+  (and when they happen) are checked against the timing rules. No board simulation is needed.
+
+  This file is only used by host builds. See extras/host/README.md
+  Released into the public domain.
+*/
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h"
+#include "FJ2_Test.h"
+
+#define BUTTON_1 0x01
+#define BUTTON_2 0x02
+#define NO_BUTTONS 0x00
+
+#define MAX_EVENTS 16
+
+typedef struct {
+  unsigned long millis;
+  FJ2_button_event_e event;
+  uint8_t button;
+} Event;
+
+static Event events[MAX_EVENTS];
+static int numEvents = 0;
+static unsigned long now = 0;
+
+//Start a test with a fresh tracker (default timing: hold 50, release 100, hold event 1000, pre-release 100)
+static void start(ButtonTracker &tracker, boolean requireRelease = false)
+{
+  tracker.setTiming();
+  tracker.begin(requireRelease);
+  numEvents = 0;
+  now = 1000; // Not zero - begin(true) uses a zero release time to mean "no release yet"
+}
+
+//Call update once per milli for durationMillis with the buttons in pressed. Record the events
+static void drive(ButtonTracker &tracker, unsigned long durationMillis, uint8_t pressed)
+{
+  for (unsigned long i = 0; i < durationMillis; i++)
+  {
+    FJ2_button_event_e event = tracker.update(now, pressed);
+    if ((event != FJ2_BUTTON_EVENT_NONE) && (numEvents < MAX_EVENTS))
+    {
+      events[numEvents].millis = now;
+      events[numEvents].event = event;
+      events[numEvents].button = tracker.getEventButton();
+      numEvents++;
+    }
+    now++;
+  }
+}
+
+static int countEvents(FJ2_button_event_e event)
+{
+  int count = 0;
+  for (int i = 0; i < numEvents; i++)
+  {
+    if (events[i].event == event)
+      count++;
+  }
+  return (count);
+}
+
+//A press shorter than minimumHoldMillis is ignored. A longer one gives PRESS once the hold time has passed
+static void testDebounce()
+{
+  ButtonTracker tracker;
+  start(tracker);
+
+  drive(tracker, 40, BUTTON_1); // Too short
+  drive(tracker, 200, NO_BUTTONS);
+  FJ2_CHECK_EQUAL(numEvents, 0);
+
+  unsigned long pressStart = now;
+  drive(tracker, 200, BUTTON_1);
+  FJ2_CHECK_EQUAL(numEvents, 1);
+  FJ2_CHECK_EQUAL(events[0].event, FJ2_BUTTON_EVENT_PRESS);
+  FJ2_CHECK_EQUAL(events[0].millis, pressStart + 51); // Held for more than minimumHoldMillis
+  FJ2_CHECK_EQUAL(events[0].button, 1);
+}
+
+//Button 1 takes priority when both are pressed. Button 2 works on its own
+static void testPriority()
+{
+  ButtonTracker tracker;
+  start(tracker);
+
+  drive(tracker, 100, BUTTON_1 | BUTTON_2);
+  FJ2_CHECK_EQUAL(numEvents, 1);
+  FJ2_CHECK_EQUAL(events[0].button, 1);
+  FJ2_CHECK_EQUAL(tracker.watchedButtons(), 0x01); // Only button 1 needs to be read now
+
+  drive(tracker, 200, NO_BUTTONS);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS_RELEASE), 1);
+
+  start(tracker);
+  drive(tracker, 100, BUTTON_2);
+  FJ2_CHECK_EQUAL(numEvents, 1);
+  FJ2_CHECK_EQUAL(events[0].button, 2);
+  FJ2_CHECK_EQUAL(tracker.watchedButtons(), 0x02);
+
+  drive(tracker, 100, BUTTON_1 | BUTTON_2); // Button 1 can't take over a button 2 press
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_RELEASE), 0);
+}
+
+//A long press gives one HOLD event, holdEventMillis after the start of the press
+static void testHoldOnce()
+{
+  ButtonTracker tracker;
+  start(tracker);
+
+  unsigned long pressStart = now;
+  drive(tracker, 3000, BUTTON_1);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS), 1);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_HOLD), 1);
+  FJ2_CHECK_EQUAL(numEvents, 2);
+  FJ2_CHECK_EQUAL(events[1].event, FJ2_BUTTON_EVENT_HOLD);
+  FJ2_CHECK_EQUAL(events[1].millis, pressStart + 1001);
+}
+
+//A release shorter than minimumReleaseMillis is not a PRESS_RELEASE. The button goes back to PRESSED without a new PRESS
+static void testRePress()
+{
+  ButtonTracker tracker;
+  start(tracker);
+
+  drive(tracker, 100, BUTTON_1);
+  drive(tracker, 50, NO_BUTTONS); // Released - but not for long enough
+  drive(tracker, 100, BUTTON_1); // Pressed again
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS), 1);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_RELEASE), 1);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS_RELEASE), 0);
+
+  drive(tracker, 200, NO_BUTTONS);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS), 1);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_RELEASE), 2);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS_RELEASE), 1);
+}
+
+//PRESS_RELEASE comes once the button has been released for more than minimumReleaseMillis
+static void testPressRelease()
+{
+  ButtonTracker tracker;
+  start(tracker);
+
+  drive(tracker, 100, BUTTON_2);
+  unsigned long releaseStart = now;
+  drive(tracker, 300, NO_BUTTONS);
+  FJ2_CHECK_EQUAL(numEvents, 3);
+  FJ2_CHECK_EQUAL(events[1].event, FJ2_BUTTON_EVENT_RELEASE);
+  FJ2_CHECK_EQUAL(events[1].millis, releaseStart);
+  FJ2_CHECK_EQUAL(events[2].event, FJ2_BUTTON_EVENT_PRESS_RELEASE);
+  FJ2_CHECK_EQUAL(events[2].millis, releaseStart + 101);
+  FJ2_CHECK_EQUAL(events[2].button, 2);
+
+  //The tracker is ready for the next press
+  drive(tracker, 100, BUTTON_1);
+  FJ2_CHECK_EQUAL(countEvents(FJ2_BUTTON_EVENT_PRESS), 2);
+}
+
+//begin(true): a press is only accepted after both buttons have been released for more than minimumPreReleaseMillis
+static void testPreRelease()
+{
+  ButtonTracker tracker;
+  start(tracker, true);
+  FJ2_CHECK(tracker.isWaitingForRelease());
+
+  drive(tracker, 500, BUTTON_1); // Held from the start - ignored
+  drive(tracker, 50, NO_BUTTONS); // Not released for long enough
+  drive(tracker, 100, BUTTON_2); // Ignored - and restarts the release time
+  FJ2_CHECK_EQUAL(numEvents, 0);
+  FJ2_CHECK(tracker.isWaitingForRelease());
+
+  drive(tracker, 102, NO_BUTTONS); // Released for long enough
+  FJ2_CHECK(!tracker.isWaitingForRelease());
+
+  drive(tracker, 100, BUTTON_2);
+  FJ2_CHECK_EQUAL(numEvents, 1);
+  FJ2_CHECK_EQUAL(events[0].event, FJ2_BUTTON_EVENT_PRESS);
+  FJ2_CHECK_EQUAL(events[0].button, 2);
+}
+
+int main()
+{
+  testDebounce();
+  testPriority();
+  testHoldOnce();
+  testRePress();
+  testPressRelease();
+  testPreRelease();
+  return (FJ2_TEST_RESULT("test_button_tracker"));
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+fj2_debug_decode.py - turn tokenized Flying Jalapeno 2 debug messages back into text
+
+When the library is built with FJ2_TOKENIZED_DEBUG, each debug message is printed as:
+  FJ2_DEBUG_TOKEN_SYNC (0x1E), the message ID (one byte), then four bytes (little-endian) per argument
+The message text and the number of arguments come from the FJ2_DEBUG_MESSAGES list in the library header.
+Everything else on the port (the sketch's own prints) is passed through unchanged.
+
+Usage:
+  python3 fj2_debug_decode.py [--header HEADER] [FILE]         decode a capture (or stdin)
+  python3 fj2_debug_decode.py [--header HEADER] --port COM3    decode a serial port (needs pyserial)
+
+Released into the public domain.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+TOKEN_SYNC = 0x1E
+
+DEFAULT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'src',
+                              'SparkFun_Flying_Jalapeno_2_Arduino_Library.h')
+
+FORMAT_CODE = re.compile(r'%(?:\.(\d))?([dufx])')
+
+
+def load_messages(header):
+    """Return the message list - (name, text) in ID order - from the FJ2_DEBUG_MESSAGES X-macro"""
+    with open(header) as f:
+        source = f.read()
+    start = source.find('#define FJ2_DEBUG_MESSAGES(X)')
+    if start < 0:
+        raise ValueError('FJ2_DEBUG_MESSAGES not found in ' + header)
+    #The macro ends at the first line which is not continued
+    lines = []
+    for line in source[start:].splitlines():
+        lines.append(line)
+        if not line.rstrip().endswith('\\'):
+            break
+    entries = re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', '\n'.join(lines))
+    return [(name, bytes(text, 'ascii').decode('unicode_escape')) for name, text in entries]
+
+
+def format_float(value, decimals):
+    """Print a float the way Arduino's Print::print(double, digits) does"""
+    if value != value:
+        return 'nan'
+    if value in (float('inf'), float('-inf')):
+        return 'inf'
+    if value > 4294967040.0 or value < -4294967040.0:
+        return 'ovf'
+    return '%.*f' % (decimals, value)
+
+
+def format_message(text, raw_args):
+    """Replace the format codes in text with the arguments (4 bytes each)"""
+    out = []
+    pos = 0
+    for index, match in enumerate(FORMAT_CODE.finditer(text)):
+        out.append(text[pos:match.start()])
+        pos = match.end()
+        raw = raw_args[4 * index:4 * index + 4]
+        code = match.group(2)
+        if code == 'f':
+            decimals = int(match.group(1)) if match.group(1) else 2
+            out.append(format_float(struct.unpack('<f', raw)[0], decimals))
+        elif code == 'u':
+            out.append('%u' % struct.unpack('<I', raw)[0])
+        elif code == 'x':
+            value = struct.unpack('<i', raw)[0]
+            out.append('%02X' % value if value >= 0 else '%X' % (value & 0xFFFFFFFF))
+        else:
+            out.append('%d' % struct.unpack('<i', raw)[0])
+    out.append(text[pos:])
+    return ''.join(out)
+
+
+class Decoder:
+    """Decode a byte stream - which may arrive in pieces - into text"""
+
+    def __init__(self, messages):
+        self.messages = messages
+        self.arg_counts = [len(FORMAT_CODE.findall(text)) for _, text in messages]
+        self.pending = bytearray()
+
+    def feed(self, data):
+        """Add some bytes. Returns the text decoded so far"""
+        self.pending += data
+        out = bytearray()
+        while self.pending:
+            sync = self.pending.find(TOKEN_SYNC)
+            if sync < 0:
+                out += self.pending
+                self.pending = bytearray()
+                break
+            out += self.pending[:sync]
+            del self.pending[:sync]
+            if len(self.pending) < 2:
+                break  # Wait for the ID
+            message_id = self.pending[1]
+            if message_id >= len(self.messages):
+                out += b'<unknown debug message %d>\r\n' % message_id
+                del self.pending[:2]
+                continue
+            length = 2 + 4 * self.arg_counts[message_id]
+            if len(self.pending) < length:
+                break  # Wait for the arguments
+            text = format_message(self.messages[message_id][1], bytes(self.pending[2:length]))
+            out += text.encode('ascii', 'replace') + b'\r\n'
+            del self.pending[:length]
+        return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode tokenized Flying Jalapeno 2 debug messages')
+    parser.add_argument('file', nargs='?', help='a capture of the serial output (default: stdin)')
+    parser.add_argument('--header', default=DEFAULT_HEADER, help='the library header (for the message list)')
+    parser.add_argument('--port', help='read from this serial port instead (needs pyserial)')
+    parser.add_argument('--baud', type=int, default=115200, help='the serial port baud rate (default 115200)')
+    args = parser.parse_args()
+
+    decoder = Decoder(load_messages(args.header))
+    out = sys.stdout.buffer
+
+    if args.port:
+        import serial
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+            try:
+                while True:
+                    out.write(decoder.feed(port.read(256)))
+                    out.flush()
+            except KeyboardInterrupt:
+                pass
+    else:
+        source = open(args.file, 'rb') if args.file else sys.stdin.buffer
+        with source:
+            while True:
+                data = source.read1(4096)  # Return whatever is available, so a pipe is decoded as it arrives
+                if not data:
+                    break
+                out.write(decoder.feed(data))
+                out.flush()
+    out.write(decoder.pending)  # Anything left over (e.g. a partial token)
+
+
+if __name__ == '__main__':
+    main()
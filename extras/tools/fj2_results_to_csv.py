@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+fj2_results_to_csv.py - convert a Flying Jalapeno 2 result log (FJ2_ResultLogger) to CSV
+
+The log is a series of 32 byte records (see src/FJ2_ResultLogger.h). Each board has a BOARD record
+followed by its STEP (TestSequence) or CHANNEL (MeasurementBatch) records. EMPTY records - the unused
+part of a flushed sector and the unused preallocated space - are skipped.
+
+Usage:
+  python3 fj2_results_to_csv.py RESULTS.BIN [OUTPUT.csv]       (default output: stdout)
+
+Released into the public domain.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+RECORD_FORMAT = '<BBBBIIIffhBBI'
+RECORD_SIZE = 32
+RESULT_VERSION = 1
+RESULT_MAGIC = 0x52324A46
+
+RECORD_TYPES = {0: 'empty', 1: 'file', 2: 'board', 3: 'step', 4: 'channel', 5: 'user'}
+
+#FJ2_step_type_e
+STEP_TYPES = ['testVCC', 'isV1Shorted', 'isV2Shorted', 'setVoltageV1', 'setVoltageV2', 'enableV1', 'enableV2',
+              'testVoltage', 'verifyVoltage', 'verifyI2Cdevice', 'custom']
+
+#FJ2_batch_channel_e
+CHANNEL_TYPES = ['pin', 'V1', 'V2', 'VCC']
+
+COLUMNS = ['record', 'serialNumber', 'timestampMillis', 'index', 'type', 'pin', 'pass', 'elapsedMicros',
+           'rawMean', 'volts', 'expectedVolts', 'value']
+
+
+def type_name(record_type, value):
+    """The name of a step or channel type"""
+    names = STEP_TYPES if record_type == 3 else CHANNEL_TYPES if record_type == 4 else None
+    if names is not None and value < len(names):
+        return names[value]
+    return str(value)
+
+
+def convert(log, out):
+    """Write each record in log (bytes) to the csv writer out. Returns the number of records written"""
+    assert struct.calcsize(RECORD_FORMAT) == RECORD_SIZE
+    written = 0
+    for offset in range(0, len(log) - RECORD_SIZE + 1, RECORD_SIZE):
+        (record_type, version, index, passed, serial_number, timestamp, elapsed, volts, expected,
+         raw_mean, step_type, pin, value) = struct.unpack_from(RECORD_FORMAT, log, offset)
+        if record_type == 0:
+            continue
+        if record_type == 1:
+            if serial_number != RESULT_MAGIC or value != RECORD_SIZE:
+                raise ValueError('not an FJ2 result log')
+            continue
+        if version != RESULT_VERSION:
+            sys.stderr.write('Skipping the record at offset %d: version %d\n' % (offset, version))
+            continue
+        out.writerow([RECORD_TYPES.get(record_type, str(record_type)), serial_number, timestamp, index,
+                      type_name(record_type, step_type), pin, passed, elapsed, raw_mean,
+                      '%.3f' % volts, '%.3f' % expected, value])
+        written += 1
+    return written
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert an FJ2 result log to CSV')
+    parser.add_argument('log', help='the result log (e.g. RESULTS.BIN from the microSD card)')
+    parser.add_argument('output', nargs='?', help='the CSV file (default: stdout)')
+    args = parser.parse_args()
+
+    with open(args.log, 'rb') as f:
+        log = f.read()
+
+    out_file = open(args.output, 'w', newline='') if args.output else sys.stdout
+    with out_file:
+        out = csv.writer(out_file)
+        out.writerow(COLUMNS)
+        count = convert(log, out)
+    sys.stderr.write('%d records\n' % count)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,240 @@
+#ifndef _FJ2_RESULT_LOGGER_H_
+#define _FJ2_RESULT_LOGGER_H_
+
+//A binary test-result logger for the FJ2 microSD card
+//
+//Each board's results are stored as fixed-size (32 byte) records. The records are collected in a 512 byte
+//sector buffer and written a whole sector at a time to a file which has been preallocated (contiguously),
+//so no FAT clusters need to be allocated while the tests are running.
+//Logging a board only copies its records into the buffer (a few tens of micros). The buffer is written when it fills,
+//or when flush is called - e.g. while the jig is waiting for the next button press.
+//
+//The logger is a template so the FJ2 library does not need SdFat. FileClass is the SdFat file type (File32, ExFile, FsFile or File)
+//and must provide: write(const void *, size_t), seekSet(uint32_t), preAllocate(uint32_t) and sync()
+//extras/tools/fj2_results_to_csv.py converts the file to CSV
+
+#include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h"
+
+#define FJ2_RESULT_SECTOR_SIZE 512 // The size of each write
+#define FJ2_RESULT_RECORD_SIZE 32 // The size of each record
+#define FJ2_RESULT_RECORDS_PER_SECTOR (FJ2_RESULT_SECTOR_SIZE / FJ2_RESULT_RECORD_SIZE)
+#define FJ2_RESULT_VERSION 1 // Change this if the record layout changes
+#define FJ2_RESULT_MAGIC 0x52324A46 // "FJ2R" - stored in the serialNumber of the file record
+
+typedef enum {
+  FJ2_RECORD_EMPTY = 0, // An unused record (the rest of a sector which has been flushed)
+  FJ2_RECORD_FILE, // The first record in the file. serialNumber is FJ2_RESULT_MAGIC; value is FJ2_RESULT_RECORD_SIZE
+  FJ2_RECORD_BOARD, // One per board: pass is the overall result; elapsedMicros is the total time;
+                    // index is the number of step / channel records which follow; value is the failed step + 1 (0 if none failed)
+  FJ2_RECORD_STEP, // One per TestSequence step: index is the step number; type is the FJ2_step_type_e; value is 1 if the step ran
+  FJ2_RECORD_CHANNEL, // One per MeasurementBatch channel: index is the channel number; type is the FJ2_batch_channel_e
+  FJ2_RECORD_USER // Logged by the sketch (logRecord)
+} FJ2_record_type_e;
+
+//One result record. The layout is the same on the Mega2560 and the host (little-endian; all fields aligned; no padding)
+typedef struct {
+  uint8_t recordType; // FJ2_record_type_e
+  uint8_t version; // FJ2_RESULT_VERSION
+  uint8_t index; // The step or channel number (see FJ2_record_type_e)
+  uint8_t pass; // 1 = pass; 0 = fail
+  uint32_t serialNumber; // The serial number of the board under test
+  uint32_t timestampMillis; // millis when the record was logged
+  uint32_t elapsedMicros; // How long the step (or board) took
+  float volts; // The measured voltage
+  float expectedVolts; // The expected voltage
+  int16_t rawMean; // The averaged ADC reading
+  uint8_t type; // The step or channel type
+  uint8_t pin; // The pin (or select) tested
+  uint32_t value; // See FJ2_record_type_e
+} FJ2_ResultRecord;
+
+static_assert(sizeof(FJ2_ResultRecord) == FJ2_RESULT_RECORD_SIZE, "FJ2_ResultRecord must be FJ2_RESULT_RECORD_SIZE bytes");
+
+template <class FileClass>
+class FJ2_ResultLogger
+{
+  public:
+
+    //Start logging to file. The file must be open for writing and empty (e.g. opened with O_RDWR | O_CREAT | O_TRUNC)
+    //maxRecords records are preallocated. Returns false if the preallocation or the first write failed
+    boolean begin(FileClass &file, uint32_t maxRecords)
+    {
+      _file = &file;
+      _maxSectors = (maxRecords + FJ2_RESULT_RECORDS_PER_SECTOR - 1) / FJ2_RESULT_RECORDS_PER_SECTOR;
+      _sector = 0;
+      _used = 0;
+      _dirty = false;
+      _dropped = 0;
+      memset(_buffer, 0, sizeof(_buffer));
+
+      if (!_file->preAllocate(_maxSectors * FJ2_RESULT_SECTOR_SIZE))
+        return (false);
+
+      FJ2_ResultRecord *record = next(FJ2_RECORD_FILE, FJ2_RESULT_MAGIC);
+      if (record == NULL)
+        return (false);
+      record->value = FJ2_RESULT_RECORD_SIZE;
+      return (flush());
+    }
+
+    //Log the results of a TestSequence: a board record then one record per step. Returns false if the file is full
+    //If the records do not all fit, none of them are logged (so the board record always matches the records which follow it)
+    boolean logSequence(uint32_t serialNumber, TestSequence &sequence)
+    {
+      if (!reserve(sequence.size() + 1))
+        return (false);
+
+      FJ2_ResultRecord *record = next(FJ2_RECORD_BOARD, serialNumber);
+      if (record == NULL)
+        return (false);
+      record->index = sequence.size();
+      record->pass = sequence.allPassed();
+      record->elapsedMicros = sequence.getElapsedMicros();
+      record->value = sequence.getFailedStep() + 1;
+
+      for (uint8_t i = 0; i < sequence.size(); i++)
+      {
+        FJ2_TestStep *step = sequence.result(i);
+        record = next(FJ2_RECORD_STEP, serialNumber);
+        if (record == NULL)
+          return (false);
+        record->index = i;
+        record->pass = step->pass;
+        record->elapsedMicros = step->elapsedMicros;
+        record->rawMean = step->rawMean;
+        record->volts = step->volts;
+        record->expectedVolts = step->voltage;
+        record->type = step->type;
+        record->pin = step->pin;
+        record->value = step->ran;
+      }
+      return (true);
+    }
+
+    //Log the results of a MeasurementBatch: a board record then one record per channel. Returns false if the file is full
+    //If the records do not all fit, none of them are logged
+    //elapsedMicros is optional - e.g. the time measureBatch took
+    boolean logBatch(uint32_t serialNumber, MeasurementBatch &batch, uint32_t elapsedMicros = 0)
+    {
+      if (!reserve(batch.size() + 1))
+        return (false);
+
+      FJ2_ResultRecord *record = next(FJ2_RECORD_BOARD, serialNumber);
+      if (record == NULL)
+        return (false);
+      record->index = batch.size();
+      record->pass = batch.allPassed();
+      record->elapsedMicros = elapsedMicros;
+
+      for (uint8_t i = 0; i < batch.size(); i++)
+      {
+        FJ2_BatchChannel *channel = batch.result(i);
+        record = next(FJ2_RECORD_CHANNEL, serialNumber);
+        if (record == NULL)
+          return (false);
+        record->index = i;
+        record->pass = channel->pass;
+        record->volts = channel->volts;
+        record->expectedVolts = channel->expectedVoltage;
+        record->rawMean = channel->rawMean;
+        record->type = channel->type;
+        record->pin = channel->pin;
+        record->value = channel->allowedPercent;
+      }
+      return (true);
+    }
+
+    //Log a record filled in by the sketch. recordType and version are set here (to FJ2_RECORD_USER and FJ2_RESULT_VERSION)
+    boolean logRecord(const FJ2_ResultRecord &userRecord)
+    {
+      FJ2_ResultRecord *record = next(FJ2_RECORD_USER, userRecord.serialNumber);
+      if (record == NULL)
+        return (false);
+      *record = userRecord;
+      record->recordType = FJ2_RECORD_USER;
+      record->version = FJ2_RESULT_VERSION;
+      return (true);
+    }
+
+    //Write the partly-full sector (the unused records are FJ2_RECORD_EMPTY) so the records logged so far are safe
+    //The sector is written again when more records are added. Call this when the jig is idle. Returns false if the write failed
+    boolean flush()
+    {
+      if (!_dirty)
+        return (true);
+      if (!writeSector())
+        return (false);
+      _dirty = false;
+      if (_used >= FJ2_RESULT_RECORDS_PER_SECTOR) // Move on to the next sector
+      {
+        _sector++;
+        _used = 0;
+        memset(_buffer, 0, sizeof(_buffer));
+      }
+      return (_file->sync());
+    }
+
+    uint32_t getRecordsLogged() { return ((_sector * FJ2_RESULT_RECORDS_PER_SECTOR) + _used); } //Includes the file record
+    uint32_t getDropped() { return (_dropped); } //Returns the number of records which did not fit in the file (or could not be written)
+
+  private:
+
+    FileClass *_file = NULL;
+    uint32_t _maxSectors = 0; // The preallocated size
+    uint32_t _sector = 0; // The sector being filled
+    uint8_t _used = 0; // The number of records in _buffer
+    boolean _dirty = false; // True if _buffer has not been written
+    uint32_t _dropped = 0;
+    FJ2_ResultRecord _buffer[FJ2_RESULT_RECORDS_PER_SECTOR];
+
+    //Return true if numRecords more records fit in the preallocated file. If not, they are all counted as dropped
+    boolean reserve(uint32_t numRecords)
+    {
+      uint32_t available = 0;
+      if ((_file != NULL) && (_sector < _maxSectors))
+        available = ((_maxSectors - _sector) * FJ2_RESULT_RECORDS_PER_SECTOR) - _used;
+      if (numRecords <= available)
+        return (true);
+      _dropped += numRecords;
+      return (false);
+    }
+
+    //Return the next free record (zeroed, with the common fields filled in). Writes the buffer if it is full
+    //Returns NULL if the file is full or the write failed
+    FJ2_ResultRecord *next(uint8_t recordType, uint32_t serialNumber)
+    {
+      if ((_file == NULL) || (_sector >= _maxSectors))
+      {
+        _dropped++;
+        return (NULL);
+      }
+
+      if (_used >= FJ2_RESULT_RECORDS_PER_SECTOR)
+      {
+        if (!flush() || (_sector >= _maxSectors))
+        {
+          _dropped++;
+          return (NULL);
+        }
+      }
+
+      FJ2_ResultRecord *record = &_buffer[_used++];
+      memset(record, 0, sizeof(FJ2_ResultRecord));
+      record->recordType = recordType;
+      record->version = FJ2_RESULT_VERSION;
+      record->serialNumber = serialNumber;
+      record->timestampMillis = millis();
+      _dirty = true;
+      return (record);
+    }
+
+    //Write _buffer to the current sector
+    boolean writeSector()
+    {
+      if (!_file->seekSet(_sector * FJ2_RESULT_SECTOR_SIZE))
+        return (false);
+      return (_file->write((const uint8_t *)_buffer, FJ2_RESULT_SECTOR_SIZE) == FJ2_RESULT_SECTOR_SIZE);
+    }
+};
+
+#endif
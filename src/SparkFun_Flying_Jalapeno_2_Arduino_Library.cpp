@@ -6,6 +6,219 @@
 */
 
 #include "SparkFun_Flying_Jalapeno_2_Arduino_Library.h"
+#include <new> // Placement new - for the CapacitiveSensor objects. (The AVR core provides <new> from version 1.8.3)
+
+// ***** The Statistics Table *****
+
+//The statistics are shared by all FlyingJalapeno2 objects (like the ADC engine). FJ2_STAT_SCOPE(op) times the rest of the enclosing block
+#ifdef FJ2_ENABLE_STATS
+
+static FJ2_OpStats _fj2Stats[FJ2_STAT_NUM_OPS];
+
+static void _fj2RecordStat(FJ2_stat_op_e op, uint32_t duration)
+{
+  FJ2_OpStats *stats = &_fj2Stats[op];
+  stats->count++;
+  stats->totalMicros += duration;
+  if (duration > stats->maxMicros)
+    stats->maxMicros = duration;
+
+  uint8_t bucket = 0;
+  uint32_t limit = FJ2_STAT_FIRST_BUCKET_MICROS;
+  while ((bucket < (FJ2_STAT_NUM_BUCKETS - 1)) && (duration >= limit))
+  {
+    bucket++;
+    limit <<= 2;
+  }
+  if (stats->buckets[bucket] < 0xFFFF)
+    stats->buckets[bucket]++;
+}
+
+class FJ2_StatScope
+{
+  public:
+    FJ2_StatScope(FJ2_stat_op_e op) { _op = op; _startMicros = micros(); }
+    ~FJ2_StatScope() { _fj2RecordStat(_op, micros() - _startMicros); }
+  private:
+    FJ2_stat_op_e _op;
+    uint32_t _startMicros;
+};
+
+#define FJ2_STAT_SCOPE(op) FJ2_StatScope _fj2StatScope(op)
+
+#else
+
+#define FJ2_STAT_SCOPE(op)
+
+#endif
+
+// ***** Fast GPIO *****
+
+//On the Mega, the fixed FJ2 pins are written directly to the port registers. Each pin's port and bit are looked up at compile time,
+//and FJ2_PinGroup combines the pins on each port into a single masked write. pinMode and digitalWrite look up the pin tables
+//and disable interrupts on every call, so this is many times faster.
+//On other platforms (and on the host), FJ2_Pin and FJ2_PinGroup fall back to pinMode and digitalWrite.
+//Only pins with a fixed FJ2_* number can use these. _statLED and the user's pins still use pinMode / digitalWrite.
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#define FJ2_FAST_GPIO
+#endif
+
+#ifdef FJ2_FAST_GPIO
+
+enum { FJ2_PORT_A = 0, FJ2_PORT_B, FJ2_PORT_C, FJ2_PORT_D, FJ2_PORT_E, FJ2_PORT_F, FJ2_PORT_G, FJ2_PORT_H, FJ2_PORT_J, FJ2_PORT_K, FJ2_PORT_L, FJ2_NUM_PORTS };
+
+#define FJ2_PIN(port, bit) (((FJ2_PORT_##port) << 4) | (bit))
+
+//The Mega2560 pin map: (port << 4) | bit for Arduino pins 0 to 69
+constexpr uint8_t _fj2PinMap[] = {
+  FJ2_PIN(E, 0), FJ2_PIN(E, 1), FJ2_PIN(E, 4), FJ2_PIN(E, 5), FJ2_PIN(G, 5), FJ2_PIN(E, 3), FJ2_PIN(H, 3), FJ2_PIN(H, 4), // 0-7
+  FJ2_PIN(H, 5), FJ2_PIN(H, 6), FJ2_PIN(B, 4), FJ2_PIN(B, 5), FJ2_PIN(B, 6), FJ2_PIN(B, 7), FJ2_PIN(J, 1), FJ2_PIN(J, 0), // 8-15
+  FJ2_PIN(H, 1), FJ2_PIN(H, 0), FJ2_PIN(D, 3), FJ2_PIN(D, 2), FJ2_PIN(D, 1), FJ2_PIN(D, 0), FJ2_PIN(A, 0), FJ2_PIN(A, 1), // 16-23
+  FJ2_PIN(A, 2), FJ2_PIN(A, 3), FJ2_PIN(A, 4), FJ2_PIN(A, 5), FJ2_PIN(A, 6), FJ2_PIN(A, 7), FJ2_PIN(C, 7), FJ2_PIN(C, 6), // 24-31
+  FJ2_PIN(C, 5), FJ2_PIN(C, 4), FJ2_PIN(C, 3), FJ2_PIN(C, 2), FJ2_PIN(C, 1), FJ2_PIN(C, 0), FJ2_PIN(D, 7), FJ2_PIN(G, 2), // 32-39
+  FJ2_PIN(G, 1), FJ2_PIN(G, 0), FJ2_PIN(L, 7), FJ2_PIN(L, 6), FJ2_PIN(L, 5), FJ2_PIN(L, 4), FJ2_PIN(L, 3), FJ2_PIN(L, 2), // 40-47
+  FJ2_PIN(L, 1), FJ2_PIN(L, 0), FJ2_PIN(B, 3), FJ2_PIN(B, 2), FJ2_PIN(B, 1), FJ2_PIN(B, 0), FJ2_PIN(F, 0), FJ2_PIN(F, 1), // 48-55
+  FJ2_PIN(F, 2), FJ2_PIN(F, 3), FJ2_PIN(F, 4), FJ2_PIN(F, 5), FJ2_PIN(F, 6), FJ2_PIN(F, 7), FJ2_PIN(K, 0), FJ2_PIN(K, 1), // 56-63
+  FJ2_PIN(K, 2), FJ2_PIN(K, 3), FJ2_PIN(K, 4), FJ2_PIN(K, 5), FJ2_PIN(K, 6), FJ2_PIN(K, 7) // 64-69
+};
+
+constexpr uint8_t _fj2PinPort(uint8_t pin) { return (_fj2PinMap[pin] >> 4); }
+constexpr uint8_t _fj2PinMask(uint8_t pin) { return (1 << (_fj2PinMap[pin] & 0x07)); }
+
+//The mask of the pins (in a list) which are on port
+constexpr uint8_t _fj2PortMask(uint8_t) { return (0); }
+template <typename... Pins> constexpr uint8_t _fj2PortMask(uint8_t port, uint8_t pin, Pins... pins)
+{
+  return ((_fj2PinPort(pin) == port ? _fj2PinMask(pin) : 0) | _fj2PortMask(port, pins...));
+}
+
+//The registers for each port. port is always a compile-time constant, so the switch disappears
+static inline __attribute__((always_inline)) volatile uint8_t *_fj2PORT(uint8_t port)
+{
+  switch (port)
+  {
+    case FJ2_PORT_A: return (&PORTA);
+    case FJ2_PORT_B: return (&PORTB);
+    case FJ2_PORT_C: return (&PORTC);
+    case FJ2_PORT_D: return (&PORTD);
+    case FJ2_PORT_E: return (&PORTE);
+    case FJ2_PORT_F: return (&PORTF);
+    case FJ2_PORT_G: return (&PORTG);
+    case FJ2_PORT_H: return (&PORTH);
+    case FJ2_PORT_J: return (&PORTJ);
+    case FJ2_PORT_K: return (&PORTK);
+    default: return (&PORTL);
+  }
+}
+static inline __attribute__((always_inline)) volatile uint8_t *_fj2DDR(uint8_t port)
+{
+  switch (port)
+  {
+    case FJ2_PORT_A: return (&DDRA);
+    case FJ2_PORT_B: return (&DDRB);
+    case FJ2_PORT_C: return (&DDRC);
+    case FJ2_PORT_D: return (&DDRD);
+    case FJ2_PORT_E: return (&DDRE);
+    case FJ2_PORT_F: return (&DDRF);
+    case FJ2_PORT_G: return (&DDRG);
+    case FJ2_PORT_H: return (&DDRH);
+    case FJ2_PORT_J: return (&DDRJ);
+    case FJ2_PORT_K: return (&DDRK);
+    default: return (&DDRL);
+  }
+}
+
+//Apply a masked write to each port which has pins in the list. Ports H to L are not in I/O space, so these are
+//read-modify-writes. The callers disable interrupts, like digitalWrite does
+template <uint8_t port, uint8_t... pins> struct _fj2Ports
+{
+  static inline __attribute__((always_inline)) void clearPORT()
+  {
+    if (_fj2PortMask(port, pins...) != 0) *_fj2PORT(port) &= (uint8_t)~_fj2PortMask(port, pins...);
+    _fj2Ports<port + 1, pins...>::clearPORT();
+  }
+  static inline __attribute__((always_inline)) void setPORT()
+  {
+    if (_fj2PortMask(port, pins...) != 0) *_fj2PORT(port) |= _fj2PortMask(port, pins...);
+    _fj2Ports<port + 1, pins...>::setPORT();
+  }
+  static inline __attribute__((always_inline)) void clearDDR()
+  {
+    if (_fj2PortMask(port, pins...) != 0) *_fj2DDR(port) &= (uint8_t)~_fj2PortMask(port, pins...);
+    _fj2Ports<port + 1, pins...>::clearDDR();
+  }
+  static inline __attribute__((always_inline)) void setDDR()
+  {
+    if (_fj2PortMask(port, pins...) != 0) *_fj2DDR(port) |= _fj2PortMask(port, pins...);
+    _fj2Ports<port + 1, pins...>::setDDR();
+  }
+};
+template <uint8_t... pins> struct _fj2Ports<FJ2_NUM_PORTS, pins...>
+{
+  static inline void clearPORT() {}
+  static inline void setPORT() {}
+  static inline void clearDDR() {}
+  static inline void setDDR() {}
+};
+
+//A group of fixed pins. Each function is one masked write per port (per register), with interrupts disabled
+template <uint8_t... pins> struct FJ2_PinGroup
+{
+  //Like digitalWrite(pin, LOW) then pinMode(pin, OUTPUT) for each pin
+  static inline __attribute__((always_inline)) void outputLow()
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    _fj2Ports<0, pins...>::clearPORT();
+    _fj2Ports<0, pins...>::setDDR();
+    SREG = oldSREG;
+  }
+  //Like digitalWrite(pin, LOW) then pinMode(pin, INPUT) for each pin. (pinMode(INPUT) also clears the PORT bit - disabling the pull-up)
+  static inline __attribute__((always_inline)) void input()
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    _fj2Ports<0, pins...>::clearPORT();
+    _fj2Ports<0, pins...>::clearDDR();
+    SREG = oldSREG;
+  }
+  //Like pinMode(pin, OUTPUT) then digitalWrite(pin, HIGH) for each pin
+  static inline __attribute__((always_inline)) void outputHigh()
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    _fj2Ports<0, pins...>::setDDR();
+    _fj2Ports<0, pins...>::setPORT();
+    SREG = oldSREG;
+  }
+};
+
+#else
+
+//The fallback: pinMode and digitalWrite, one pin at a time
+template <uint8_t... pins> struct FJ2_PinGroup
+{
+  static inline void outputLow()
+  {
+    int unused[] = { (digitalWrite(pins, LOW), pinMode(pins, OUTPUT), 0)... };
+    (void)unused;
+  }
+  static inline void input()
+  {
+    int unused[] = { (digitalWrite(pins, LOW), pinMode(pins, INPUT), 0)... };
+    (void)unused;
+  }
+  static inline void outputHigh()
+  {
+    int unused[] = { (pinMode(pins, OUTPUT), digitalWrite(pins, HIGH), 0)... };
+    (void)unused;
+  }
+};
+
+#endif
+
+//A single fixed pin
+template <uint8_t pin> struct FJ2_Pin : public FJ2_PinGroup<pin> {};
 
 // ***** The FJ2 Class *****
 
@@ -15,7 +228,22 @@ FlyingJalapeno2::FlyingJalapeno2(int statLED, float FJ_VCC, bool useCapSense)
 {
   _statLED = statLED;
   _FJ_VCC = FJ_VCC;
+#ifndef FJ2_NO_CAP_SENSE
   _useCapSense = useCapSense;
+#else
+  (void)useCapSense;
+#endif
+  _vccWindow = makeAdcWindow(3.3, 10); // The Zener window for testVCC when VCC is 5V
+
+  //The built-in tasks. The button task waits for enableTask(FJ2_TASK_BUTTONS)
+  memset(_tasks, 0, sizeof(_tasks));
+  for (uint8_t i = 0; i < FJ2_NUM_BUILT_IN_TASKS; i++)
+  {
+    _tasks[i].function = builtInTask;
+    _tasks[i].context = this;
+    _tasks[i].enabled = (i != FJ2_TASK_BUTTONS);
+  }
+  _tasks[FJ2_TASK_BUTTONS].intervalMillis = FJ2_BUTTON_TASK_MILLIS;
 
   // ***** FJ2 Buttons *****
   //CapacitiveSensor(byte sendPin, byte receivePin)
@@ -23,11 +251,14 @@ FlyingJalapeno2::FlyingJalapeno2(int statLED, float FJ_VCC, bool useCapSense)
   //The send pin is connected to the pad via the large resistor
   //So on FJ2, the CS_RETURN pin is actually the send pin
   //Note: CapacitiveSensor::CapacitiveSensor configures the send pin as an output and pulls it low
+  //The sensors are constructed in _capSenseStorage, so nothing is allocated on the heap
+#ifndef FJ2_NO_CAP_SENSE
   if (_useCapSense)
   {
-    FJ2button1 = new CapacitiveSensor(FJ2_CAP_SENSE_RETURN, FJ2_CAP_SENSE_BUTTON_1);
-    FJ2button2 = new CapacitiveSensor(FJ2_CAP_SENSE_RETURN, FJ2_CAP_SENSE_BUTTON_2);
+    FJ2button1 = new (_capSenseStorage[0]) CapacitiveSensor(FJ2_CAP_SENSE_RETURN, FJ2_CAP_SENSE_BUTTON_1);
+    FJ2button2 = new (_capSenseStorage[1]) CapacitiveSensor(FJ2_CAP_SENSE_RETURN, FJ2_CAP_SENSE_BUTTON_2);
   }
+#endif
 
   reset(); // Reset everything
 
@@ -39,19 +270,24 @@ FlyingJalapeno2::FlyingJalapeno2(int statLED, float FJ_VCC, bool useCapSense)
   {
     // We can not use Serial prints here as Serial will not have been begun at this point
     //Instead, let's blink SOS on statLED
-    SOS(statLED);
-    SOS(statLED);
-    SOS(statLED);
+    //(delay does not work here either - the timers have not been started - so play the SOS in the background)
+    playPattern(statLED, FJ2_PATTERN_SOS, 3);
   }
 }
 
-void FlyingJalapeno2::enableDebugging(Stream &debugPort)
+//If buffered is true, the debug messages are stored and printed later (by poll and while the library is waiting)
+void FlyingJalapeno2::enableDebugging(Stream &debugPort, boolean buffered)
 {
+  if (_printDebug == true)
+    flushDebug(); // Print any messages for the old port
   _debugSerial = &debugPort; //Grab which port the user wants us to use for debugging
+  _bufferedDebug = buffered;
   _printDebug = true; //Should we print the commands we send? Good for debugging
 }
 void FlyingJalapeno2::disableDebugging()
 {
+  if (_printDebug == true)
+    flushDebug(); // Print any buffered messages
   _printDebug = false; //Turn off extra print statements
 }
 
@@ -66,24 +302,19 @@ void FlyingJalapeno2::disableDebugging()
 //"Note that even if you don't use the hardware SS pin, it must be left as an output or the SD library won't work."
 void FlyingJalapeno2::reset(boolean resetLEDs)
 {
+  FJ2_STAT_SCOPE(FJ2_STAT_RESET);
 
   // Turn all the LEDs off - if resetLEDs is true
   if (resetLEDs)
   {
+    stopAllPatterns(); // Stop any LED patterns first - so they don't turn the LEDs back on
+
     // Just in case _statLED is not one of the four regular LEDs
     // (It could be LED_BUILTIN on the FJ2 or a custom LED on the test jig)
     pinMode(_statLED, OUTPUT);
     digitalWrite(_statLED, LOW);
 
-    pinMode(FJ2_LED_PROGRAM_AND_TEST_PASS, OUTPUT);
-    pinMode(FJ2_LED_TEST_PASS, OUTPUT);
-    pinMode(FJ2_LED_FAIL, OUTPUT);
-    pinMode(FJ2_STAT_LED, OUTPUT);
-
-    digitalWrite(FJ2_LED_PROGRAM_AND_TEST_PASS, LOW);
-    digitalWrite(FJ2_LED_TEST_PASS, LOW);
-    digitalWrite(FJ2_LED_FAIL, LOW);
-    digitalWrite(FJ2_STAT_LED, LOW);
+    FJ2_PinGroup<FJ2_LED_PROGRAM_AND_TEST_PASS, FJ2_LED_TEST_PASS, FJ2_LED_FAIL, FJ2_STAT_LED>::outputLow();
   }
 
   // Disable the power
@@ -91,56 +322,45 @@ void FlyingJalapeno2::reset(boolean resetLEDs)
   disableV1(); // Make sure V1 and V2 are disabled
   disableV2();
 
-  // Turn the V1 voltage control pins off
-  digitalWrite(FJ2_V1_CONTROL_TO_3V3, LOW);
-  digitalWrite(FJ2_V1_CONTROL_TO_5V0, LOW);
-  pinMode(FJ2_V1_CONTROL_TO_3V3, INPUT);
-  pinMode(FJ2_V1_CONTROL_TO_5V0, INPUT);
+  // Turn the V1 and V2 voltage control pins off
+  FJ2_PinGroup<FJ2_V1_CONTROL_TO_3V3, FJ2_V1_CONTROL_TO_5V0,
+               FJ2_V2_CONTROL_TO_3V3, FJ2_V2_CONTROL_TO_3V7, FJ2_V2_CONTROL_TO_4V2, FJ2_V2_CONTROL_TO_5V0>::input();
 
-  // Turn the V2 voltage control pins off
-  digitalWrite(FJ2_V2_CONTROL_TO_3V3, LOW);
-  digitalWrite(FJ2_V2_CONTROL_TO_3V7, LOW);
-  digitalWrite(FJ2_V2_CONTROL_TO_4V2, LOW);
-  digitalWrite(FJ2_V2_CONTROL_TO_5V0, LOW);
-  pinMode(FJ2_V2_CONTROL_TO_3V3, INPUT);
-  pinMode(FJ2_V2_CONTROL_TO_3V7, INPUT);
-  pinMode(FJ2_V2_CONTROL_TO_4V2, INPUT);
-  pinMode(FJ2_V2_CONTROL_TO_5V0, INPUT);
-
-  //Configure the power test pins as inputs to begin with
-  pinMode(FJ2_POWER_TEST_CONTROL, INPUT);
-  pinMode(FJ2_PT_READ_V1, INPUT);
-  pinMode(FJ2_PT_READ_V2, INPUT);
+  //Configure the power test pins (and the Zener pin) as inputs to begin with
+  FJ2_PinGroup<FJ2_POWER_TEST_CONTROL, FJ2_PT_READ_V1, FJ2_PT_READ_V2, FJ2_BRAIN_VCC_A0>::input();
 
   //We do not need to worry about the SPI pins providing parasitic power to the board under test
   //The SPI buffer prevents that as soon as FJ2_SPI_EN is low
 
   // Set up the optional pins
-  pinMode(FJ2_BRAIN_VCC_A0, INPUT);
-  digitalWrite(FJ2_I2C_EN, LOW); // Make sure the I2C buffer is disabled by pulling FJ2_I2C_EN low
-  pinMode(FJ2_I2C_EN, OUTPUT);
-  digitalWrite(FJ2_SERIAL_EN, LOW); // Make sure the Serial buffer is disabled by pulling FJ2_SERIAL_EN low
-  pinMode(FJ2_SERIAL_EN, OUTPUT);
-  digitalWrite(FJ2_SPI_EN, LOW); // Make sure the SPI buffer is disabled by pulling FJ2_SPI_EN low
-  pinMode(FJ2_SPI_EN, OUTPUT);
-  digitalWrite(FJ2_MICROSD_PWR_EN, LOW); // Make sure the microSD power is disabled by pulling FJ2_MICROSD_PWR_EN low
-  pinMode(FJ2_MICROSD_PWR_EN, OUTPUT);
-  digitalWrite(FJ2_MICROSD_EN, LOW); // Make sure the microSD buffer is disabled by pulling FJ2_MICROSD_EN low
-  pinMode(FJ2_MICROSD_EN, OUTPUT);
-  digitalWrite(FJ2_MICROSD_CS, HIGH); // Get ready to deselect the microSD card
-  pinMode(FJ2_MICROSD_CS, INPUT);
+  // Make sure the I2C, Serial, SPI and microSD buffers and the microSD power are disabled by pulling their enable pins low
+  // (The microSD card is left alone if keepMicroSDEnabled has been called - so a log file can stay open)
+  if (_keepMicroSD)
+  {
+    FJ2_PinGroup<FJ2_I2C_EN, FJ2_SERIAL_EN, FJ2_SPI_EN>::outputLow();
+  }
+  else
+  {
+    FJ2_PinGroup<FJ2_I2C_EN, FJ2_SERIAL_EN, FJ2_SPI_EN, FJ2_MICROSD_PWR_EN, FJ2_MICROSD_EN>::outputLow();
+    digitalWrite(FJ2_MICROSD_CS, HIGH); // Get ready to deselect the microSD card
+    pinMode(FJ2_MICROSD_CS, INPUT);
+  }
 
   // If _useCapSense is false, configure the cap sense pins as inputs
   // (Don't use INPUT_PULLUP or you'll see the 15us HeatBeat pulses)
   // (Pull CAP_SENSE_RETURN low to avoid it acting as a pull-up)
+#ifndef FJ2_NO_CAP_SENSE
   if (!_useCapSense)
+#endif
   {
-    pinMode(FJ2_CAP_SENSE_BUTTON_1, INPUT);
-    pinMode(FJ2_CAP_SENSE_BUTTON_2, INPUT);
-    pinMode(FJ2_CAP_SENSE_RETURN, OUTPUT);
-    digitalWrite(FJ2_CAP_SENSE_RETURN, LOW);
+    FJ2_PinGroup<FJ2_CAP_SENSE_BUTTON_1, FJ2_CAP_SENSE_BUTTON_2>::input();
+    FJ2_Pin<FJ2_CAP_SENSE_RETURN>::outputLow();
   }
 
+  // Forget the VCC calibration. It is measured again by the first test which needs it
+  _vccCalibrated = false;
+  _measuredVCC = 0.0;
+
   // Call userReset - which can be overwritten by the user
 
   userReset(resetLEDs); // Do any board-specific resety stuff in userReset
@@ -166,6 +386,120 @@ void FlyingJalapeno2::setCapSenseSamples(uint8_t samples)
     _capSenseSamples = samples;
 }
 
+//Enable the incremental cap sense filters. See the header file for details
+void FlyingJalapeno2::enableIncrementalCapSense(uint8_t samplesPerPoll, uint8_t filterShift, uint8_t baselineShift, uint8_t hysteresisPercent)
+{
+#ifndef FJ2_NO_CAP_SENSE
+  if (samplesPerPoll > 0) _capSenseSamplesPerPoll = samplesPerPoll;
+  if (filterShift < 16) _capSenseFilterShift = filterShift;
+  if (baselineShift < 16) _capSenseBaselineShift = baselineShift;
+  if (hysteresisPercent < 100) _capSenseHysteresisPercent = hysteresisPercent;
+  recalibrateCapSense();
+  _incrementalCapSense = true;
+#else
+  (void)samplesPerPoll;
+  (void)filterShift;
+  (void)baselineShift;
+  (void)hysteresisPercent;
+#endif
+}
+
+void FlyingJalapeno2::disableIncrementalCapSense()
+{
+#ifndef FJ2_NO_CAP_SENSE
+  _incrementalCapSense = false;
+#endif
+}
+
+//Restart the incremental filters. The baselines are taken from the next readings
+void FlyingJalapeno2::recalibrateCapSense()
+{
+#ifndef FJ2_NO_CAP_SENSE
+  _capSenseFilter1.initialised = false;
+  _capSenseFilter1.pressed = false;
+  _capSenseFilter2.initialised = false;
+  _capSenseFilter2.pressed = false;
+#endif
+}
+
+//Returns the incremental baseline for button 1 or 2. Always 0 with FJ2_NO_CAP_SENSE
+long FlyingJalapeno2::getCapSenseBaseline(uint8_t button)
+{
+#ifndef FJ2_NO_CAP_SENSE
+  return (button == 2 ? _capSenseFilter2.baseline : _capSenseFilter1.baseline);
+#else
+  (void)button;
+  return (0);
+#endif
+}
+
+//Returns the incremental filtered reading for button 1 or 2. Always 0 with FJ2_NO_CAP_SENSE
+long FlyingJalapeno2::getCapSenseFiltered(uint8_t button)
+{
+#ifndef FJ2_NO_CAP_SENSE
+  return (button == 2 ? _capSenseFilter2.filtered : _capSenseFilter1.filtered);
+#else
+  (void)button;
+  return (0);
+#endif
+}
+
+#ifndef FJ2_NO_CAP_SENSE
+
+//PRIVATE: Take _capSenseSamplesPerPoll samples and fold them into filter. Returns true if the button is pressed
+boolean FlyingJalapeno2::incrementalCapSense(CapacitiveSensor *button, FJ2_CapSenseFilter *filter, long threshold)
+{
+  long reading;
+  {
+    FJ2_STAT_SCOPE(FJ2_STAT_CAP_SENSE);
+    reading = button->capacitiveSensorRaw(_capSenseSamplesPerPoll);
+  }
+  if (reading < 0) // Timeout or error. Keep the previous state
+  {
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_CAP_SENSE_RAW, reading);
+    }
+    return (filter->pressed);
+  }
+
+  //Scale the reading to _capSenseSamples samples, so the threshold means the same thing as it does for capacitiveSensor
+  reading = reading * _capSenseSamples / _capSenseSamplesPerPoll;
+
+  if (!filter->initialised)
+  {
+    filter->filtered = reading;
+    filter->baseline = reading;
+    filter->pressed = false;
+    filter->initialised = true;
+  }
+
+  filter->filtered += (reading - filter->filtered) >> _capSenseFilterShift; // EWMA
+
+  long delta = filter->filtered - filter->baseline;
+
+  if (filter->pressed)
+  {
+    if (delta < (threshold * (100 - _capSenseHysteresisPercent) / 100))
+      filter->pressed = false;
+  }
+  else if (delta > threshold)
+  {
+    filter->pressed = true;
+  }
+
+  if (!filter->pressed)
+  {
+    if (filter->filtered < filter->baseline)
+      filter->baseline = filter->filtered; // Follow the baseline down immediately (like CapacitiveSensor's auto-calibration)
+    else
+      filter->baseline += (filter->filtered - filter->baseline) >> _capSenseBaselineShift; // Track slow upward drift
+  }
+
+  return (filter->pressed);
+}
+#endif
+
 //Returns true if value is over threshold
 //Threshold is optional. _capSenseThreshold will be used if threshold is not provided (zero)
 boolean FlyingJalapeno2::isProgramAndTestPressed(long threshold)
@@ -178,13 +512,24 @@ boolean FlyingJalapeno2::isButton1Pressed(long threshold)
 }
 boolean FlyingJalapeno2::isPretestPressed(long threshold)
 {
-  if (_useCapSense)
+#ifdef FJ2_NO_CAP_SENSE
+  (void)threshold; // The AT42QT1011 buttons have no threshold
+#else
+  if (_useCapSense && _incrementalCapSense)
+  {
+    if (threshold == 0) threshold = _capSenseThreshold;
+    return (incrementalCapSense(FJ2button1, &_capSenseFilter1, threshold));
+  }
+  else if (_useCapSense)
   {
-    long preTestButton = FJ2button1->capacitiveSensor(_capSenseSamples);
+    long preTestButton;
+    {
+      FJ2_STAT_SCOPE(FJ2_STAT_CAP_SENSE);
+      preTestButton = FJ2button1->capacitiveSensor(_capSenseSamples);
+    }
     if ((_printDebug == true) && (preTestButton < 0))
     {
-      _debugSerial->print(F("FlyingJalapeno2::isPretestPressed: FJ2button1.capacitiveSensor returned "));
-      _debugSerial->println(preTestButton);
+      debugLog(FJ2_MSG_CAP_SENSE_1, preTestButton);
     }
     if (threshold == 0) threshold = _capSenseThreshold;
     if (preTestButton > threshold)
@@ -192,6 +537,7 @@ boolean FlyingJalapeno2::isPretestPressed(long threshold)
     return(false);
   }
   else
+#endif
   {
     // Check that the button signal is high for > 15us (just in case the AT42QT1011 HeartBeat is detected)
     // Take six samples five microseconds apart. Return true if all six are high
@@ -214,13 +560,24 @@ boolean FlyingJalapeno2::isButton2Pressed(long threshold)
 }
 boolean FlyingJalapeno2::isTestPressed(long threshold)
 {
-  if (_useCapSense)
+#ifdef FJ2_NO_CAP_SENSE
+  (void)threshold; // The AT42QT1011 buttons have no threshold
+#else
+  if (_useCapSense && _incrementalCapSense)
   {
-    long preTestButton = FJ2button2->capacitiveSensor(_capSenseSamples);
+    if (threshold == 0) threshold = _capSenseThreshold;
+    return (incrementalCapSense(FJ2button2, &_capSenseFilter2, threshold));
+  }
+  else if (_useCapSense)
+  {
+    long preTestButton;
+    {
+      FJ2_STAT_SCOPE(FJ2_STAT_CAP_SENSE);
+      preTestButton = FJ2button2->capacitiveSensor(_capSenseSamples);
+    }
     if ((_printDebug == true) && (preTestButton < 0))
     {
-      _debugSerial->print(F("FlyingJalapeno2::isPretestPressed: FJ2button2.capacitiveSensor returned "));
-      _debugSerial->println(preTestButton);
+      debugLog(FJ2_MSG_CAP_SENSE_2, preTestButton);
     }
     if (threshold == 0) threshold = _capSenseThreshold;
     if (preTestButton > threshold)
@@ -228,6 +585,7 @@ boolean FlyingJalapeno2::isTestPressed(long threshold)
     return(false);
   }
   else
+#endif
   {
     // Check that the button signal is high for > 15us (just in case the AT42QT1011 HeartBeat is detected)
     // Take six samples five microseconds apart. Return true if all six are high
@@ -266,58 +624,16 @@ int FlyingJalapeno2::waitForButtonPress(unsigned long timeoutMillis, unsigned lo
   boolean keepGoing = true; // keepGoing if true
   boolean timedOut = false; // Indicate if we timed out
   int result = 0; // Return: 0 = no button; 1 = button 1; 2 = button 2
-  unsigned long latestButtonPress = 0; // Record the time of the latest button press
+
+  _waitTracker.setTiming(minimumHoldMillis);
+  _waitTracker.begin();
 
   while (keepGoing)
   {
-    if (result == 0) //If we have not yet recorded a button press
-    {
-      if (isButton1Pressed()) // Check if button 1 is pressed. 1 takes priority over 2
-      {
-        latestButtonPress = millis(); // Record the time of the latest button press
-        result = 1; // Indicate button 1 is being pressed
-      }
-      else if (isButton2Pressed()) // Check if button 2 is pressed
-      {
-        latestButtonPress = millis(); // Record the time of the latest button press
-        result = 2; // Indicate button 2 is being pressed
-      }
-      else
-      {
-        // Neither button is pressed
-      }
-    }
-    else if (result == 1) // Button 1 has been pressed. Check if it is still being pressed
-    {
-      if (isButton1Pressed()) // Is button 1 still being pressed?
-      {
-        // Button is still being pressed so check if it has been held for minimumHoldMillis
-        if (millis() > (latestButtonPress + minimumHoldMillis))
-        {
-          keepGoing = false; // Button has been held for long enough. Time to leave the loop
-        }
-      }
-      else
-      {
-        // Button 1 has been released so reset result back to zero and go back to looking for a fresh press
-        result = 0;
-      }
-    }
-    else // if (result == 2) // Button 2 has been pressed. Check if it is still being pressed
+    if (pollButtons(_waitTracker) == FJ2_BUTTON_EVENT_PRESS) // Has a button been held for long enough?
     {
-      if (isButton2Pressed()) // Is button 2 still being pressed?
-      {
-        // Button is still being pressed so check if it has been held for minimumHoldMillis
-        if (millis() > (latestButtonPress + minimumHoldMillis))
-        {
-          keepGoing = false; // Button has been held for long enough. Time to leave the loop
-        }
-      }
-      else
-      {
-        // Button 2 has been released so reset result back to zero and go back to looking for a fresh press
-        result = 0;
-      }
+      result = _waitTracker.getEventButton();
+      keepGoing = false; // Button has been held for long enough. Time to leave the loop
     }
 
     // Check for a timeout
@@ -327,7 +643,7 @@ int FlyingJalapeno2::waitForButtonPress(unsigned long timeoutMillis, unsigned lo
     {
       if (_printDebug == true)
       {
-        _debugSerial->println(F("FlyingJalapeno2::waitForButtonPress: timed out!"));
+        debugLog(FJ2_MSG_PRESS_TIMEOUT);
       }
       keepGoing = false; // Timeout. Time to leave the loop
       timedOut = true;
@@ -343,9 +659,7 @@ int FlyingJalapeno2::waitForButtonPress(unsigned long timeoutMillis, unsigned lo
 
   if (_printDebug == true)
   {
-    _debugSerial->print(F("FlyingJalapeno2::waitForButtonPress: button "));
-    _debugSerial->print(result);
-    _debugSerial->println(F(" pressed"));
+    debugLog(FJ2_MSG_PRESS_BUTTON, result);
   }
 
   return (result);
@@ -364,11 +678,10 @@ int FlyingJalapeno2::waitForButtonPressRelease(unsigned long timeoutMillis, unsi
   }
   boolean keepGoing = true; // keepGoing if true
   boolean timedOut = false; // Indicate if we timed out
-  unsigned long latestButtonRelease = 0; // Record the time of the latest button release
 
   if (_printDebug == true)
   {
-    _debugSerial->println(F("FlyingJalapeno2::waitForButtonPressRelease: calling waitForButtonPress"));
+    debugLog(FJ2_MSG_PRESS_RELEASE_CALLING);
   }
 
   //Begin by checking for a valid button press
@@ -379,62 +692,18 @@ int FlyingJalapeno2::waitForButtonPressRelease(unsigned long timeoutMillis, unsi
     return (0);
   
   //A valid press was recorded on button 1 or button 2
-  //Now check that the button is released
+  //_waitTracker is still tracking it. Now check that the button is released
+  _waitTracker.setTiming(minimumHoldMillis, minimumReleaseMillis);
+
   while (keepGoing)
   {
-    if (result == 1) // Button 1 was pressed. Check if it is still being pressed
-    {
-      if (isButton1Pressed()) // Is button 1 still being pressed?
-      {
-        // Button is still being pressed
-        latestButtonRelease = 0;
-      }
-      else
-      {
-        // Button 1 has been released
-
-        // Check if this is a fresh release (latestButtonRelease == 0)
-        if (latestButtonRelease == 0)
-        {
-          latestButtonRelease = millis(); // Record the time of the release
-        }
-
-        else if (millis() > (latestButtonRelease + minimumReleaseMillis))
-        {
-          if (_printDebug == true)
-          {
-            _debugSerial->println(F("FlyingJalapeno2::waitForButtonPressRelease: button 1 has been released"));
-          }
-          keepGoing = false; // Button has been released for long enough. Time to leave the loop
-        }
-      }
-    }
-    else // if (result == 2) // Button 2 was pressed. Check if it is still being pressed
+    if (pollButtons(_waitTracker) == FJ2_BUTTON_EVENT_PRESS_RELEASE) // Has the button been released for long enough?
     {
-      if (isButton2Pressed()) // Is button 2 still being pressed?
-      {
-        // Button is still being pressed
-        latestButtonRelease = 0;
-      }
-      else
+      if (_printDebug == true)
       {
-        // Button 2 has been released
-
-        // Check if this is a fresh release (latestButtonRelease == 0)
-        if (latestButtonRelease == 0)
-        {
-          latestButtonRelease = millis(); // Record the time of the release
-        }
-
-        else if (millis() > (latestButtonRelease + minimumReleaseMillis))
-        {
-          if (_printDebug == true)
-          {
-            _debugSerial->println(F("FlyingJalapeno2::waitForButtonPressRelease: button 2 has been released"));
-          }
-          keepGoing = false; // Button has been released for long enough. Time to leave the loop
-        }
+        debugLog(FJ2_MSG_PRESS_RELEASE_BUTTON, result);
       }
+      keepGoing = false; // Button has been released for long enough. Time to leave the loop
     }
 
     // Check for a timeout
@@ -444,7 +713,7 @@ int FlyingJalapeno2::waitForButtonPressRelease(unsigned long timeoutMillis, unsi
     {
       if (_printDebug == true)
       {
-        _debugSerial->println(F("FlyingJalapeno2::waitForButtonPressRelease: timed out!"));
+        debugLog(FJ2_MSG_PRESS_RELEASE_TIMEOUT);
       }
       keepGoing = false; // Timeout. Time to leave the loop
       timedOut = true;
@@ -465,34 +734,22 @@ int FlyingJalapeno2::waitForButtonReleasePressRelease(unsigned long timeoutMilli
   unsigned long startMillis = millis(); // Record millis when the function was called
   boolean keepGoing = true; // keepGoing if true
   boolean timedOut = false; // Indicate if we timed out
-  unsigned long latestButtonRelease = 0; // Record the time of the latest button release
 
   //Check that neither button is pressed - for at least minimumPreReleaseMillis
+  _waitTracker.setTiming(minimumHoldMillis, minimumPostReleaseMillis, 1000, minimumPreReleaseMillis);
+  _waitTracker.begin(true);
+
   while (keepGoing)
   {
-    if ((isButton1Pressed()) || (isButton2Pressed())) // Is either being pressed?
-    {
-      // At least one button is being pressed
-      latestButtonRelease = 0;
-    }
-    else
-    {
-      // Neither button is being pressed
+    pollButtons(_waitTracker);
 
-      // Check if this is a fresh release (latestButtonRelease == 0)
-      if (latestButtonRelease == 0)
-      {
-        latestButtonRelease = millis(); // Record the time of the release
-      }
-
-      else if (millis() > (latestButtonRelease + minimumPreReleaseMillis))
+    if (!_waitTracker.isWaitingForRelease())
+    {
+      if (_printDebug == true)
       {
-        if (_printDebug == true)
-        {
-          _debugSerial->println(F("FlyingJalapeno2::waitForButtonReleasePressRelease: neither button pressed. Calling waitForButtonPressRelease"));
-        }
-        keepGoing = false; // Buttons have been released for long enough. Time to leave the loop
+        debugLog(FJ2_MSG_RELEASE_PRESS_RELEASE_CALLING);
       }
+      keepGoing = false; // Buttons have been released for long enough. Time to leave the loop
     }
 
     // Check for a timeout
@@ -502,7 +759,7 @@ int FlyingJalapeno2::waitForButtonReleasePressRelease(unsigned long timeoutMilli
     {
       if (_printDebug == true)
       {
-        _debugSerial->println(F("FlyingJalapeno2::waitForButtonReleasePressRelease: timed out!"));
+        debugLog(FJ2_MSG_RELEASE_PRESS_RELEASE_TIMEOUT);
       }
       keepGoing = false; // Timeout. Time to leave the loop
       timedOut = true;
@@ -520,6 +777,33 @@ int FlyingJalapeno2::waitForButtonReleasePressRelease(unsigned long timeoutMilli
   return (result);
 }
 
+//Read the buttons which buttonTracker needs and advance it
+FJ2_button_event_e FlyingJalapeno2::pollButtons()
+{
+  return (pollButtons(buttonTracker));
+}
+
+//PRIVATE: Read the buttons which tracker needs and advance it
+//Button 1 takes priority, so button 2 is only read if button 1 is not pressed
+//The state is timestamped when the buttons are read - so the time run() takes does not count towards the hold or release time
+FJ2_button_event_e FlyingJalapeno2::pollButtons(ButtonTracker &tracker)
+{
+  uint8_t watched = tracker.watchedButtons();
+  uint8_t pressed = 0;
+
+  if ((watched & 0x01) && isButton1Pressed())
+    pressed |= 0x01;
+  if ((watched & 0x02) && ((pressed & 0x01) == 0) && isButton2Pressed())
+    pressed |= 0x02;
+  unsigned long now = millis();
+
+  _pollingButtons = true;
+  run(); // Keep the LED patterns, debug messages and tasks going while we wait for the buttons
+  _pollingButtons = false;
+
+  return (tracker.update(now, pressed));
+}
+
 //Turn stat LED on
 void FlyingJalapeno2::statOn()
 {
@@ -551,25 +835,220 @@ void FlyingJalapeno2::SOS(int pin)
   dot(pin);
   dot(pin);
   dot(pin);
-  delay(1750);
+  idleDelay(1750);
 }
 
 void FlyingJalapeno2::dot(int pin)
 {
   if (pin == -1) pin = _statLED;
   digitalWrite(pin, HIGH);
-  delay(250);
+  idleDelay(250);
   digitalWrite(pin, LOW);
-  delay(250);
+  idleDelay(250);
 }
 
 void FlyingJalapeno2::dash(int pin)
 {
   if (pin == -1) pin = _statLED;
   digitalWrite(pin, HIGH);
-  delay(750);
+  idleDelay(750);
   digitalWrite(pin, LOW);
-  delay(250);
+  idleDelay(250);
+}
+
+// ***** The LED Pattern Sequencer *****
+
+const uint8_t FJ2_PATTERN_DOT[] PROGMEM = { FJ2_LED_ON | 1, 1, 0 };
+const uint8_t FJ2_PATTERN_DASH[] PROGMEM = { FJ2_LED_ON | 3, 1, 0 };
+const uint8_t FJ2_PATTERN_SOS[] PROGMEM = {
+  FJ2_LED_ON | 1, 1, FJ2_LED_ON | 1, 1, FJ2_LED_ON | 1, 1, // S
+  FJ2_LED_ON | 3, 1, FJ2_LED_ON | 3, 1, FJ2_LED_ON | 3, 1, // O
+  FJ2_LED_ON | 1, 1, FJ2_LED_ON | 1, 1, FJ2_LED_ON | 1, 1, // S
+  7, 0 }; // The 1750ms gap
+const uint8_t FJ2_PATTERN_HEARTBEAT[] PROGMEM = { FJ2_LED_ON | 1, 3, 0 };
+
+//The sequencer state can be shared with the timer interrupt (FJ2_LED_USE_TIMER0), so it lives here rather than in the class (like the ADC engine)
+//Each slot plays one pattern on one pin. A slot is free when its pattern is NULL
+//The main code only changes the slots with interrupts disabled
+typedef struct {
+  int pin; // The LED pin
+  const uint8_t *pattern; // The pattern (in program memory). NULL if the slot is free
+  uint8_t step; // The index of the current step
+  uint8_t repeatsLeft; // The number of times left to play the pattern. 0 = forever
+  unsigned long stepStartMillis; // When the current step started
+  unsigned long stepMillis; // The duration of the current step
+} FJ2_LEDSlot;
+
+static FJ2_LEDSlot _ledSlots[FJ2_MAX_LED_PATTERNS]; // Zero-initialised - so all the slots are free before any constructor runs
+static volatile uint8_t _ledNumPlaying = 0; // The number of slots in use. The slots are only looked at when this is non-zero
+
+#if defined(FJ2_LED_USE_TIMER0) && defined(__AVR__) && defined(TIMSK0) && defined(OCIE0A) && defined(TIMER0_COMPA_vect)
+#define FJ2_LED_USE_ISR // Use the Timer0 compare interrupt to advance the patterns. Opt-in - see FJ2_LED_USE_TIMER0
+#endif
+
+//Start the current step of a slot. Go back to the start of the pattern (or free the slot) at the end of the pattern
+static void _ledStartStep(FJ2_LEDSlot *slot, unsigned long now)
+{
+  uint8_t step = pgm_read_byte(slot->pattern + slot->step);
+  if (step == 0) // End of the pattern?
+  {
+    if ((slot->repeatsLeft != 1) && (slot->step > 0)) // Play it again? (Check step > 0 in case the pattern is empty)
+    {
+      if (slot->repeatsLeft > 1) slot->repeatsLeft--;
+      slot->step = 0;
+      step = pgm_read_byte(slot->pattern);
+    }
+    else
+    {
+      digitalWrite(slot->pin, LOW); // All done. Turn the LED off and free the slot
+      slot->pattern = NULL;
+      _ledNumPlaying--;
+      return;
+    }
+  }
+  digitalWrite(slot->pin, (step & FJ2_LED_ON) ? HIGH : LOW);
+  slot->stepMillis = (unsigned long)(step & ~FJ2_LED_ON) * FJ2_LED_PATTERN_UNIT_MILLIS;
+  slot->stepStartMillis = now;
+}
+
+//Advance any slots whose current step has finished
+//If the updates are late (e.g. during a delay), skip the missed steps so the patterns keep their timing
+static void _ledUpdate(unsigned long now)
+{
+  for (uint8_t i = 0; i < FJ2_MAX_LED_PATTERNS; i++)
+  {
+    FJ2_LEDSlot *slot = &_ledSlots[i];
+    while ((slot->pattern != NULL) && ((now - slot->stepStartMillis) >= slot->stepMillis))
+    {
+      boolean zeroLength = (slot->stepMillis == 0);
+      slot->step++;
+      _ledStartStep(slot, slot->stepStartMillis + slot->stepMillis);
+      if (zeroLength)
+        break; // Don't get stuck on a pattern of zero-length steps
+    }
+  }
+#ifdef FJ2_LED_USE_ISR
+  if (_ledNumPlaying == 0)
+    TIMSK0 &= ~_BV(OCIE0A); // Nothing left to play. Disable the interrupt
+#endif
+}
+
+//Return the slot playing on pin. NULL if there isn't one
+static FJ2_LEDSlot *_ledFindSlot(int pin)
+{
+  for (uint8_t i = 0; i < FJ2_MAX_LED_PATTERNS; i++)
+  {
+    if ((_ledSlots[i].pattern != NULL) && (_ledSlots[i].pin == pin))
+      return (&_ledSlots[i]);
+  }
+  return (NULL);
+}
+
+//Return a free slot. NULL if there isn't one
+static FJ2_LEDSlot *_ledFreeSlot()
+{
+  for (uint8_t i = 0; i < FJ2_MAX_LED_PATTERNS; i++)
+  {
+    if (_ledSlots[i].pattern == NULL)
+      return (&_ledSlots[i]);
+  }
+  return (NULL);
+}
+
+#ifdef FJ2_LED_USE_ISR
+//Timer0 is already running (for millis). Its compare A interrupt fires once per Timer0 cycle - about every millisecond
+//The interrupt is only enabled while a pattern is playing. Only with FJ2_LED_USE_TIMER0 - see the header for the pin 13 conflict
+ISR(TIMER0_COMPA_vect)
+{
+  _ledUpdate(millis());
+}
+#endif
+
+//Play pattern on pin. repeat is the number of times to play it. FJ2_PATTERN_FOREVER (0) plays it until stopPattern is called
+//Returns false if all FJ2_MAX_LED_PATTERNS slots are in use
+boolean FlyingJalapeno2::playPattern(int pin, const uint8_t *pattern, uint8_t repeat)
+{
+  if (pin == -1) pin = _statLED;
+  if ((pin < 0) || (pattern == NULL))
+    return (false);
+
+  pinMode(pin, OUTPUT);
+
+  noInterrupts();
+  FJ2_LEDSlot *slot = _ledFindSlot(pin); // Replace the pattern already playing on this pin
+  if (slot == NULL)
+  {
+    slot = _ledFreeSlot();
+    if (slot == NULL)
+    {
+      interrupts();
+      if (_printDebug == true)
+      {
+        debugLog(FJ2_MSG_PATTERN_FULL);
+      }
+      return (false);
+    }
+    slot->pin = pin;
+    _ledNumPlaying++;
+  }
+  slot->pattern = pattern;
+  slot->step = 0;
+  slot->repeatsLeft = repeat;
+  _ledStartStep(slot, millis());
+#ifdef FJ2_LED_USE_ISR
+  if (_ledNumPlaying > 0)
+    TIMSK0 |= _BV(OCIE0A);
+#endif
+  interrupts();
+  return (true);
+}
+
+//Stop the pattern on pin and turn the LED off
+void FlyingJalapeno2::stopPattern(int pin)
+{
+  if (pin == -1) pin = _statLED;
+  if (pin < 0)
+    return;
+  noInterrupts();
+  FJ2_LEDSlot *slot = _ledFindSlot(pin);
+  if (slot != NULL)
+  {
+    digitalWrite(pin, LOW);
+    slot->pattern = NULL;
+    _ledNumPlaying--;
+  }
+  interrupts();
+}
+
+//Returns true if a pattern is playing on pin
+boolean FlyingJalapeno2::isPlaying(int pin)
+{
+  if (pin == -1) pin = _statLED;
+  if (pin < 0)
+    return (false);
+  noInterrupts();
+  boolean playing = (_ledFindSlot(pin) != NULL);
+  interrupts();
+  return (playing);
+}
+
+//Advance the patterns. With FJ2_LED_USE_TIMER0 the timer interrupt does this, so this does nothing
+void FlyingJalapeno2::updateLEDs()
+{
+#ifndef FJ2_LED_USE_ISR
+  if (_ledNumPlaying > 0)
+    _ledUpdate(millis());
+#endif
+}
+
+//PRIVATE: Stop all of the patterns (without changing the LEDs)
+void FlyingJalapeno2::stopAllPatterns()
+{
+  noInterrupts();
+  for (uint8_t i = 0; i < FJ2_MAX_LED_PATTERNS; i++)
+    _ledSlots[i].pattern = NULL;
+  _ledNumPlaying = 0;
+  interrupts();
 }
 
 // GENERIC PRE-TEST for shorts to GND on power rails, returns true if all is good, returns false if a short is detected
@@ -579,13 +1058,12 @@ boolean FlyingJalapeno2::PreTest_Custom(byte control_pin, byte read_pin)
   pinMode(read_pin, INPUT);
 
   digitalWrite(control_pin, HIGH);
-  delay(200);
+  waitForSettle(read_pin); //Wait for voltage to settle before taking a ADC reading
   int reading = averagedAnalogRead(read_pin);
 
   if (_printDebug == true)
   {
-    _debugSerial->print(F("FlyingJalapeno2::PreTest_Custom: jumper test reading: "));
-    _debugSerial->println(reading);
+    debugLog(FJ2_MSG_PRETEST_READING, reading);
   }
 
   digitalWrite(control_pin, LOW);
@@ -604,13 +1082,12 @@ boolean FlyingJalapeno2::isShortToGround_Custom(byte control_pin, byte read_pin)
   pinMode(read_pin, INPUT);
 
   digitalWrite(control_pin, HIGH);
-  delay(200);
+  waitForSettle(read_pin); //Wait for voltage to settle before taking a ADC reading
   int reading = averagedAnalogRead(read_pin);
 
   if (_printDebug == true)
   {
-    _debugSerial->print(F("FlyingJalapeno2::isShortToGround_Custom: jumper test reading: "));
-    _debugSerial->println(reading);
+    debugLog(FJ2_MSG_SHORT_READING, reading);
   }
 
   digitalWrite(control_pin, LOW);
@@ -640,6 +1117,8 @@ boolean FlyingJalapeno2::isV2Shorted(int shortThreshold)
 //Returns true if all is good, returns false if there is short detected
 boolean FlyingJalapeno2::powerTest(byte select, int shortThreshold) // select is either "1" or "2"
 {
+  FJ2_STAT_SCOPE(FJ2_STAT_POWER_TEST);
+
   //Power down regulators
   disableV1();
   disableV2();
@@ -652,30 +1131,31 @@ boolean FlyingJalapeno2::powerTest(byte select, int shortThreshold) // select is
   {
     if (_printDebug == true)
     {
-      _debugSerial->println(F("FlyingJalapeno2::powerTest: Error! select must be 1 or 2."));
+      debugLog(FJ2_MSG_POWER_TEST_SELECT);
     }
     return (false);
   }
 
   //Now setup the control pin
-  pinMode(FJ2_POWER_TEST_CONTROL, OUTPUT);
-  digitalWrite(FJ2_POWER_TEST_CONTROL, HIGH);
+  FJ2_Pin<FJ2_POWER_TEST_CONTROL>::outputHigh();
 
   pinMode(read_pin, INPUT);
 
-  delay(200); //Wait for voltage to settle before taking a ADC reading
+  waitForSettle(read_pin); //Wait for voltage to settle before taking a ADC reading
 
-  int reading = averagedAnalogRead(read_pin);
+  //The board passes if the reading is at least shortThreshold
+  FJ2_AdcWindow window = { (uint16_t)constrain(shortThreshold, 0, 1023), 1023 };
+  long count;
+  long total = readAnalogSum(read_pin, 0, &count, &window);
+  int reading = (count == 0) ? 0 : (int)(total / count);
 
   if (_printDebug == true)
   {
-    _debugSerial->print(F("FlyingJalapeno2::powerTest: power test reading: "));
-    _debugSerial->println(reading);
+    debugLog(FJ2_MSG_POWER_TEST_READING, reading);
   }
 
   //Release the control pin
-  digitalWrite(FJ2_POWER_TEST_CONTROL, LOW);
-  pinMode(FJ2_POWER_TEST_CONTROL, INPUT);
+  FJ2_Pin<FJ2_POWER_TEST_CONTROL>::input();
 
   //Actual readings taken with the FJ2:
   //
@@ -693,461 +1173,2778 @@ boolean FlyingJalapeno2::powerTest(byte select, int shortThreshold) // select is
   return true;
 }
 
-//Set the number of analog reads to average
-void FlyingJalapeno2::setAnalogReadSamples(long samples)
-{
-  _numAnalogSamples = samples;
-}
-
-//Average the analog reading to minimise noise
-int FlyingJalapeno2::averagedAnalogRead(byte analogPin)
-{
-  long runningTotal = 0;
-  for (long i = 0; i < _numAnalogSamples; i++)
-  {
-    runningTotal += analogRead(analogPin);
-    delay(1);
-  }
-  return ((int)(runningTotal / _numAnalogSamples));
-}
-
-//Test a pin to see what voltage is on the pin.
-//Returns true if pin voltage is within a given window of the value we are looking for
-//pin = pin to test
-//expectedVoltage = voltage we expect. 0.0 to 5.0 (float)
-//allowedPercent = allowed window for overage. 0 to 100 (int) (default 10%)
-boolean FlyingJalapeno2::verifyVoltage(int pin, float expectedVoltage, int allowedPercent)
+//Test V1 and V2 for shorts at the same time. Returns true if either is shorted
+//FJ2_POWER_TEST_CONTROL feeds both dividers, so the test network is energised once, both pins settle together
+//and their samples are interleaved. This takes about half as long as isV1Shorted plus isV2Shorted
+//result is optional. If provided, it is filled with the per-rail results and readings
+boolean FlyingJalapeno2::areV1V2Shorted(int shortThreshold, FJ2_ShortTestResult *result)
 {
-  //float allowanceFraction = map(allowedPercent, 0, 100, 0, 1.0); //Scale int to a fraction of 1.0
-  //Grrrr! map doesn't work with floats at all
+  FJ2_STAT_SCOPE(FJ2_STAT_POWER_TEST);
 
-  float allowanceFraction = allowedPercent / 100.0; //Scale the allowedPercent to a float
+  //Power down regulators
+  disableV1();
+  disableV2();
 
-  pinMode(pin, INPUT); //Make sure pin is an input
+  //Now setup the control pin
+  FJ2_Pin<FJ2_POWER_TEST_CONTROL>::outputHigh();
 
-  delay(200); //Wait for voltage to settle before taking a ADC reading
+  const byte pins[2] = { FJ2_PT_READ_V1, FJ2_PT_READ_V2 };
+  pinMode(FJ2_PT_READ_V1, INPUT);
+  pinMode(FJ2_PT_READ_V2, INPUT);
 
-  int reading = averagedAnalogRead(pin);
+  waitForSettle(pins, 2); //Wait for both voltages to settle before taking the ADC readings
 
-  //Convert reading to voltage
-  float readVoltage = _FJ_VCC / 1023 * reading;
+  startAveragedRead(pins, 2);
+  while (!isReadComplete())
+    run(); // Wait for the samples to be collected
 
-  boolean result = ((readVoltage <= (expectedVoltage * (1.0 + allowanceFraction))) && (readVoltage >= (expectedVoltage * (1.0 - allowanceFraction))));
+  //A rail is shorted if its reading is lower than shortThreshold: total < shortThreshold * count
+  long count;
+  long total = getAnalogSum(0, &count);
+  int reading1 = (count == 0) ? 0 : (int)(total / count);
+  boolean shorted1 = (total < ((long)shortThreshold * count));
+  total = getAnalogSum(1, &count);
+  int reading2 = (count == 0) ? 0 : (int)(total / count);
+  boolean shorted2 = (total < ((long)shortThreshold * count));
 
   if (_printDebug == true)
   {
-    _debugSerial->print(F("FlyingJalapeno2::verifyVoltage: expectedVoltage: "));
-    _debugSerial->println(expectedVoltage, 2);
-
-    _debugSerial->print(F("FlyingJalapeno2::verifyVoltage: allowanceFraction: "));
-    _debugSerial->println(allowanceFraction, 2);
+    debugLog(FJ2_MSG_SHORT_TEST_READINGS, reading1, reading2);
+  }
 
-    _debugSerial->print(F("FlyingJalapeno2::verifyVoltage: reading: "));
-    _debugSerial->println(reading);
-    
-    _debugSerial->print(F("FlyingJalapeno2::verifyVoltage: voltage: "));
-    _debugSerial->println(readVoltage, 2);
+  //Release the control pin
+  FJ2_Pin<FJ2_POWER_TEST_CONTROL>::input();
 
-    _debugSerial->print(F("FlyingJalapeno2::verifyVoltage: result: "));
-    _debugSerial->println(result);
+  if (result != NULL)
+  {
+    result->v1Shorted = shorted1;
+    result->v2Shorted = shorted2;
+    result->v1Reading = reading1;
+    result->v2Reading = reading2;
   }
 
-  return (result);
+  return (shorted1 || shorted2);
 }
 
-boolean FlyingJalapeno2::verifyValue(float input_value, float correct_val, float allowance_percent)
+//Set the number of analog reads to average
+void FlyingJalapeno2::setAnalogReadSamples(long samples)
 {
-  float allowanceFraction = allowance_percent / 100.0; //Scale the allowedPercent to a float
-
-  if ((input_value <= (correct_val * (1.0 + allowanceFraction))) && (input_value >= (correct_val * (1.0 - allowanceFraction))))
-    return true; // good value
-  return false;
+  _numAnalogSamples = samples;
 }
 
-//Enable or disable regulator #1
-void FlyingJalapeno2::enableV1(void)
+// ***** The ADC Engine *****
+
+//The engine state is shared with the ADC interrupt, so it lives here rather than in the class
+//There is only one ADC, so there is only one engine - no matter how many FlyingJalapeno2 objects there are
+//When more than one pin is being read, the conversions are interleaved: pin 0, pin 1, ..., pin 0, pin 1, ...
+static volatile uint16_t _adcRing[FJ2_ADC_RING_SIZE]; // The most recent samples (from all pins)
+static volatile uint8_t _adcRingHead = 0; // Where the next sample will be stored
+static volatile long _adcTotals[FJ2_ADC_MAX_CHANNELS]; // The running total of the samples for each pin
+static volatile unsigned long _adcSquares[FJ2_ADC_MAX_CHANNELS]; // The running total of the squared samples for each pin (for the early exit)
+static volatile long _adcCount = 0; // The number of samples collected (from all pins)
+static volatile long _adcTarget = 0; // The number of samples to collect (from all pins)
+static volatile boolean _adcBusy = false; // True while a read is in progress
+static volatile uint8_t _adcChannel = 0; // The index of the pin being converted
+static byte _adcPins[FJ2_ADC_MAX_CHANNELS]; // The pins being read
+static uint8_t _adcNumChannels = 1; // The number of pins being read
+static volatile boolean _adcDiscardNext = false; // True if the next conversion is to be discarded
+static uint8_t _adcReference = DEFAULT; // The ADC reference (configureADC)
+static float _adcExternalReference = 0.0; // The AREF voltage (configureADC)
+static uint8_t _adcPrescaler = 128; // The ADC clock prescaler (configureADC)
+static boolean _adcDiscardFirst = false; // True: discard the first conversion after the pin changes (configureADC)
+
+#if defined(__AVR__) && defined(ADCSRA) && defined(ADC_vect)
+#define FJ2_ADC_USE_ISR // Use the ADC interrupt to collect the samples
+#endif
+
+//Store one sample in the ring buffer and add it to the running total for the current pin
+//Then move on to the next pin
+static inline void _adcStoreSample(uint16_t sample)
 {
-  if (_V1_setting == 0.0) // Check if setVoltageV1 has been called
-  {
-    if (_printDebug == true)
-    {
-      _debugSerial->println(F("FlyingJalapeno2::enableV1: setVoltageV1 has not been called. Aborting..."));
-    }
-    return;
-  }
-
-  digitalWrite(FJ2_V1_POWER_CONTROL, HIGH); // turn on the high side switch
-  pinMode(FJ2_V1_POWER_CONTROL, OUTPUT);
-  _V1_actual = _V1_setting;
-  if (_printDebug == true)
-  {
-    _debugSerial->println(F("FlyingJalapeno2::enableV1: V1 enabled!"));
-  }
+  _adcRing[_adcRingHead] = sample;
+  _adcRingHead = (_adcRingHead + 1) % FJ2_ADC_RING_SIZE;
+  _adcTotals[_adcChannel] += sample;
+  _adcSquares[_adcChannel] += (unsigned long)sample * sample;
+  _adcCount++;
+  _adcChannel++;
+  if (_adcChannel >= _adcNumChannels)
+    _adcChannel = 0;
 }
 
-void FlyingJalapeno2::disableV1(void)
+#ifdef FJ2_ADC_USE_ISR
+//Select the ADC channel for pin - the same way analogRead does
+static inline void _adcSelectPin(byte pin)
 {
-  //Do not do Serial prints here as disableV1 is called when the class is instantiated - before Serial is begun
-  digitalWrite(FJ2_V1_POWER_CONTROL, LOW); // turn off the high side switch
-  pinMode(FJ2_V1_POWER_CONTROL, OUTPUT);
-  _V1_actual = 0.0;
+  uint8_t channel = pin;
+  if (channel >= A0) channel -= A0; // Allow for channel or pin numbers
+#if defined(MUX5)
+  ADCSRB = (ADCSRB & ~_BV(MUX5)) | (((channel >> 3) & 0x01) << MUX5); // The Mega has 16 channels
+#endif
+  ADMUX = (_adcReference << 6) | (channel & 0x07); // The REFS bits are the analogReference value
 }
 
-//Enable or disable regulator #2
-void FlyingJalapeno2::enableV2(void)
+//Each conversion-complete interrupt stores the sample, selects the next pin and starts the next conversion
+//The interrupt is disabled once all of the samples have been collected
+ISR(ADC_vect)
 {
-  if (_V2_setting == 0.0) // Check if setVoltageV2 has been called
+  uint16_t sample = ADC; // Reads ADCL then ADCH
+  if (!_adcBusy)
   {
-    if (_printDebug == true)
+    ADCSRA &= ~_BV(ADIE); // Spurious interrupt. Make sure the interrupt is disabled
+    return;
+  }
+  if (_adcDiscardNext) // The first conversion after the pin changed. Throw it away and start again
+  {
+    _adcDiscardNext = false;
+    ADCSRA |= _BV(ADSC);
+    return;
+  }
+  _adcStoreSample(sample);
+  if (_adcCount < _adcTarget)
+  {
+    if (_adcNumChannels > 1)
     {
-      _debugSerial->println(F("FlyingJalapeno2::enableV2: setVoltageV2 has not been called. Aborting..."));
+      _adcSelectPin(_adcPins[_adcChannel]);
+      _adcDiscardNext = _adcDiscardFirst;
     }
-    return;
+    ADCSRA |= _BV(ADSC); // Start the next conversion
   }
-
-  digitalWrite(FJ2_V2_POWER_CONTROL, HIGH); // turn on the high side switch
-  pinMode(FJ2_V2_POWER_CONTROL, OUTPUT);
-  _V2_actual = _V2_setting;
-  if (_printDebug == true)
+  else
   {
-    _debugSerial->println(F("FlyingJalapeno2::enableV2: V2 enabled!"));
+    ADCSRA &= ~_BV(ADIE); // All done. Disable the interrupt
+    _adcBusy = false;
   }
 }
+#endif
 
-void FlyingJalapeno2::disableV2(void)
+//Stop the read early
+static void _adcStop()
 {
-  //Do not do Serial prints here as disableV2 is called when the class is instantiated - before Serial is begun
-  digitalWrite(FJ2_V2_POWER_CONTROL, LOW); // turn off the high side switch
-  pinMode(FJ2_V2_POWER_CONTROL, OUTPUT);
-  _V2_actual = 0.0;
+  noInterrupts();
+#ifdef FJ2_ADC_USE_ISR
+  _adcTarget = _adcCount; // The interrupt collects the conversion in progress, then stops
+#else
+  _adcBusy = false;
+#endif
+  interrupts();
 }
 
-//Setup the first power supply to the chosen voltage level
-//Leaves MOSFET off so regulator is configured but not connected to target
-void FlyingJalapeno2::setVoltageV1(float voltage)
+//Returns true if the mean of count samples is beyond boundary (an ADC count) at the chosen confidence:
+//|mean - boundary| > sigma * the standard error of the mean. Multiplying through by count^2 * (count - 1) leaves only integers:
+//(total - boundary * count)^2 * (count - 1) > sigma^2 * (count * squares - total^2)
+//With up to FJ2_EARLY_EXIT_MAX_SAMPLES samples, nothing overflows 64 bits
+static boolean _adcBeyondDoubt(long total, unsigned long squares, long count, long boundary, uint8_t sigma)
 {
-  // Turn the V1 voltage control pins off
-  digitalWrite(FJ2_V1_CONTROL_TO_3V3, LOW);
-  digitalWrite(FJ2_V1_CONTROL_TO_5V0, LOW);
-  pinMode(FJ2_V1_CONTROL_TO_3V3, INPUT);
-  pinMode(FJ2_V1_CONTROL_TO_5V0, INPUT);
+  int64_t difference = (int64_t)total - ((int64_t)boundary * count);
+  int64_t spread = ((int64_t)count * squares) - ((int64_t)total * total); // Never negative
+  return ((uint64_t)(difference * difference) * (uint64_t)(count - 1) > (uint64_t)sigma * sigma * (uint64_t)spread);
+}
 
-  if ((voltage >= 3.25) && (voltage <= 3.35))
-  {
-    pinMode(FJ2_V1_CONTROL_TO_3V3, OUTPUT);
-    digitalWrite(FJ2_V1_CONTROL_TO_3V3, LOW);
-    _V1_setting = 3.3;
-  }
-  else if ((voltage >= 4.95) && (voltage <= 5.05))
-  {
-    pinMode(FJ2_V1_CONTROL_TO_5V0, OUTPUT);
-    digitalWrite(FJ2_V1_CONTROL_TO_5V0, LOW);
-    _V1_setting = 5.0;
-  }
-  else
+//Sort samples in place (insertion sort - there are at most FJ2_ADC_RING_SIZE of them)
+static void _adcSortSamples(uint16_t *samples, uint8_t numSamples)
+{
+  for (uint8_t i = 1; i < numSamples; i++)
   {
-    if (_printDebug == true)
+    uint16_t sample = samples[i];
+    uint8_t j = i;
+    while ((j > 0) && (samples[j - 1] > sample))
     {
-      _debugSerial->print(F("FlyingJalapeno2::setVoltageV1: invalid voltage specified: "));
-      _debugSerial->print(voltage, 2);
-      _debugSerial->println(F(". Defaulting to 3.3V"));
+      samples[j] = samples[j - 1];
+      j--;
     }
-    pinMode(FJ2_V1_CONTROL_TO_3V3, OUTPUT); // default to 3.3V - even when the high side switch is turn off.
-    digitalWrite(FJ2_V1_CONTROL_TO_3V3, LOW);
-    _V1_setting = 3.3;
-  }
-
-  if (_printDebug == true)
-  {
-    _debugSerial->print(F("FlyingJalapeno2::setVoltageV1: V1 will be "));
-    _debugSerial->print(_V1_setting, 1);
-    _debugSerial->println(F("V when enabled"));
+    samples[j] = sample;
   }
 }
 
-//Setup the second power supply to the chosen voltage level
-//Leaves MOSFET off so regulator is configured but not connected to target
-void FlyingJalapeno2::setVoltageV2(float voltage)
+//Apply the trimmed mean or median filter to samples (in place)
+//Returns the total of the samples which are kept. count is set to how many were kept, so total / count is the filtered reading
+static long _adcFilterSamples(uint16_t *samples, uint8_t numSamples, FJ2_adc_filter_e filter, uint8_t trim, long *count)
 {
-  // Turn the V2 voltage control pins off
-  digitalWrite(FJ2_V2_CONTROL_TO_3V3, LOW);
-  digitalWrite(FJ2_V2_CONTROL_TO_3V7, LOW);
-  digitalWrite(FJ2_V2_CONTROL_TO_4V2, LOW);
-  digitalWrite(FJ2_V2_CONTROL_TO_5V0, LOW);
-  pinMode(FJ2_V2_CONTROL_TO_3V3, INPUT);
-  pinMode(FJ2_V2_CONTROL_TO_3V7, INPUT);
-  pinMode(FJ2_V2_CONTROL_TO_4V2, INPUT);
-  pinMode(FJ2_V2_CONTROL_TO_5V0, INPUT);
+  *count = 0;
+  if (numSamples == 0)
+    return (0);
 
-  if ((voltage >= 3.25) && (voltage <= 3.35))
+  _adcSortSamples(samples, numSamples);
+
+  if (filter == FJ2_FILTER_MEDIAN)
   {
-    pinMode(FJ2_V2_CONTROL_TO_3V3, OUTPUT);
-    digitalWrite(FJ2_V2_CONTROL_TO_3V3, LOW);
-    _V2_setting = 3.3;
+    //The median of an even number of samples is the mean of the middle two
+    trim = (numSamples - 1) / 2;
   }
-  else if ((voltage >= 3.65) && (voltage <= 3.75))
+  else if ((trim * 2) >= numSamples)
   {
-    pinMode(FJ2_V2_CONTROL_TO_3V7, OUTPUT);
-    digitalWrite(FJ2_V2_CONTROL_TO_3V7, LOW);
-    _V2_setting = 3.7;
+    trim = (numSamples - 1) / 2; // Always keep at least one sample
   }
-  else if ((voltage >= 4.15) && (voltage <= 4.25))
+
+  long total = 0;
+  for (uint8_t i = trim; i < (numSamples - trim); i++)
+    total += samples[i];
+  *count = numSamples - (2 * trim);
+  return (total);
+}
+
+#ifdef FJ2_ADC_USE_ISR
+//Take numSamples readings of the 1.1V bandgap, against VCC. Returns the total. count is set to the number of readings
+//analogRead can't select the bandgap, so this uses the ADC registers directly (and blocks)
+static long _adcReadBandgap(long numSamples, long *count)
+{
+  ADCSRA &= ~_BV(ADIE); // Stop any averaged read
+  _adcBusy = false;
+#if defined(MUX5)
+  ADCSRB &= ~_BV(MUX5);
+#endif
+  ADMUX = (DEFAULT << 6) | 0x1E; // MUX4:0 = 11110 selects the bandgap
+  delay(1); // The bandgap needs time to settle after it is selected
+
+  ADCSRA |= _BV(ADEN) | _BV(ADSC); // Discard the first conversion
+  while (ADCSRA & _BV(ADSC))
+    ;
+  long total = 0;
+  for (long i = 0; i < numSamples; i++)
   {
-    pinMode(FJ2_V2_CONTROL_TO_4V2, OUTPUT);
-    digitalWrite(FJ2_V2_CONTROL_TO_4V2, LOW);
-    _V2_setting = 4.2;
+    ADCSRA |= _BV(ADSC);
+    while (ADCSRA & _BV(ADSC))
+      ;
+    total += ADC;
   }
-  else if ((voltage >= 4.95) && (voltage <= 5.05))
+  *count = numSamples;
+  return (total);
+}
+#endif
+
+//Start a non-blocking averaged read of _numAnalogSamples samples
+//numSamples is optional. _numAnalogSamples will be used if numSamples is not provided (zero)
+void FlyingJalapeno2::startAveragedRead(byte analogPin, long numSamples)
+{
+  startAveragedRead(&analogPin, 1, numSamples);
+}
+
+//Start a non-blocking, interleaved, averaged read of numPins pins (up to FJ2_ADC_MAX_CHANNELS)
+//Each pin is sampled numSamples times (or _numAnalogSamples times if numSamples is zero)
+void FlyingJalapeno2::startAveragedRead(const byte *analogPins, uint8_t numPins, long numSamples)
+{
+  long target = (numSamples > 0) ? numSamples : _numAnalogSamples;
+  if (target < 1) target = 1; // Avoid a divide by zero in getAveragedRead
+  if (numPins < 1) numPins = 1;
+  if (numPins > FJ2_ADC_MAX_CHANNELS) numPins = FJ2_ADC_MAX_CHANNELS;
+
+#ifdef FJ2_ADC_USE_ISR
+  ADCSRA &= ~_BV(ADIE); // Stop any read which is already in progress
+#endif
+
+  for (uint8_t i = 0; i < numPins; i++)
   {
-    pinMode(FJ2_V2_CONTROL_TO_5V0, OUTPUT);
-    digitalWrite(FJ2_V2_CONTROL_TO_5V0, LOW);
-    _V2_setting = 5.0;
+    _adcPins[i] = analogPins[i];
+    _adcTotals[i] = 0;
+    _adcSquares[i] = 0;
   }
-  else
+  _adcNumChannels = numPins;
+  _adcChannel = 0;
+  _adcRingHead = 0;
+  _adcCount = 0;
+  _adcTarget = target * numPins;
+  _adcDiscardNext = _adcDiscardFirst;
+  _adcBusy = true;
+
+#ifdef FJ2_ADC_USE_ISR
+  _adcSelectPin(_adcPins[0]);
+
+  //Clear any old interrupt flag (by writing a one to it), enable the interrupt and start the first conversion
+  //The prescaler is set by configureADC (Arduino sets it to 128 during init)
+  ADCSRA |= _BV(ADEN) | _BV(ADIF) | _BV(ADIE) | _BV(ADSC);
+#endif
+}
+
+//Returns true when all the samples have been collected
+//If the ADC interrupt is not available, this takes one sample per call
+boolean FlyingJalapeno2::isReadComplete()
+{
+#ifndef FJ2_ADC_USE_ISR
+  if (_adcBusy)
   {
-    if (_printDebug == true)
+    if (_adcDiscardNext)
     {
-      _debugSerial->print(F("FlyingJalapeno2::setVoltageV2: invalid voltage specified: "));
-      _debugSerial->print(voltage, 2);
-      _debugSerial->println(F(". Defaulting to 3.3V"));
+      analogRead(_adcPins[_adcChannel]); // The first conversion after the pin changed. Throw it away
+      _adcDiscardNext = false;
     }
-    pinMode(FJ2_V2_CONTROL_TO_3V3, OUTPUT); // default to 3.3V
-    digitalWrite(FJ2_V2_CONTROL_TO_3V3, LOW);
-    _V2_setting = 3.3;
+    _adcStoreSample(analogRead(_adcPins[_adcChannel]));
+    if (_adcCount >= _adcTarget)
+      _adcBusy = false;
+    else if (_adcNumChannels > 1)
+      _adcDiscardNext = _adcDiscardFirst;
   }
+  updateLEDs(); // Keep the LED patterns going
+#endif
+  return (!_adcBusy);
+}
 
-  if (_printDebug == true)
-  {
-    _debugSerial->print(F("FlyingJalapeno2::setVoltageV2: V2 will be "));
-    _debugSerial->print(_V2_setting, 1);
-    _debugSerial->println(F("V when enabled"));
-  }
+//Configure the ADC
+//prescaler divides the 16MHz clock: 128 (125kHz - the Arduino default), 64, 32 or 16 (1MHz). Each conversion takes 13 ADC clocks
+//reference is the analogReference value: DEFAULT (VCC), INTERNAL1V1 (the bandgap), INTERNAL2V56 or EXTERNAL (AREF)
+//externalReferenceVoltage is the AREF voltage (only needed for EXTERNAL)
+//discardFirst: throw away the first conversion after the ADC pin changes, so the sample capacitor has time to settle
+//The ADC engine is shared, so this applies to every FlyingJalapeno2 object
+void FlyingJalapeno2::configureADC(uint8_t prescaler, uint8_t reference, boolean discardFirst, float externalReferenceVoltage)
+{
+  uint8_t prescalerBits = 7; // ADPS2:0 for 128
+  if (prescaler <= 16) prescalerBits = 4;
+  else if (prescaler <= 32) prescalerBits = 5;
+  else if (prescaler <= 64) prescalerBits = 6;
+  _adcPrescaler = 1 << prescalerBits;
+  _adcReference = reference;
+  _adcDiscardFirst = discardFirst;
+  if (reference == EXTERNAL) _adcExternalReference = externalReferenceVoltage;
+
+  analogReference(reference); // So analogRead uses the same reference
+#if defined(ADCSRA) && defined(ADPS0)
+  ADCSRA = (ADCSRA & ~(_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))) | prescalerBits; // analogRead uses the same prescaler
+#endif
+
+  updateAdcWindows(); //The windows are in ADC counts, so they change with the reference
 }
 
-//Return _V1_setting - i.e. what V1 will be when enabled
-float FlyingJalapeno2::getVoltageSettingV1()
+//PRIVATE: Work out the cached ADC windows again - after the reference (or the measured VCC) has changed
+void FlyingJalapeno2::updateAdcWindows()
 {
-  return (_V1_setting);
+  _vccWindow = makeAdcWindow(3.3, 10);
+  if (_V1_setting > 0.0) _V1SettingWindow = makeAdcWindow(railReadVoltage(_V1_setting), 5);
+  if (_V2_setting > 0.0) _V2SettingWindow = makeAdcWindow(railReadVoltage(_V2_setting), 5);
+  if ((_V1Window.lo != 0) || (_V1Window.hi != 0)) _V1Window = _V1SettingWindow; // V1 is enabled
+  if ((_V2Window.lo != 0) || (_V2Window.hi != 0)) _V2Window = _V2SettingWindow;
 }
 
-//Return _V2_setting - i.e. what V2 will be when enabled
-float FlyingJalapeno2::getVoltageSettingV2()
+//Returns the ADC reference voltage. The counts are converted to volts with this
+//With the DEFAULT reference this is VCC: the measured VCC if VCC calibration is enabled (and it worked), otherwise the nominal VCC
+float FlyingJalapeno2::getADCReferenceVoltage()
 {
- return (_V2_setting);
+  if (_adcReference == INTERNAL1V1) return (1.1);
+  if (_adcReference == INTERNAL2V56) return (2.56);
+  if (_adcReference == EXTERNAL) return (_adcExternalReference);
+  if (_measuredVCC > 0.0) return (_measuredVCC);
+  return (_FJ_VCC);
 }
 
+//Select how VCC is found: FJ2_VCC_NOMINAL (the FJ_VCC passed to the constructor - the default),
+//FJ2_VCC_FROM_ZENER (the 3.3V Zener on FJ2_BRAIN_VCC_A0 - 5V VCC only) or FJ2_VCC_FROM_BANDGAP (the ATmega2560 1.1V bandgap)
+//referenceVoltage is the actual Zener or bandgap voltage, if it has been measured. 0.0 selects the nominal 3.3V or 1.1V
+//VCC is measured by the first test after each reset (or by calling calibrateVCC)
+void FlyingJalapeno2::setVCCCalibration(FJ2_vcc_source_e source, float referenceVoltage)
+{
+  _vccSource = source;
+  _vccCalibrationReference = referenceVoltage;
+  _vccCalibrated = false;
+  _measuredVCC = 0.0;
+  updateAdcWindows();
+}
 
-//Test if the voltage on V1/V2 is OK. Returns false if the voltage is out of range
-//Note: due to the 10k/11k divider on the PT_READ pins, we can only verify voltages which are lower than VCC * 0.9
-boolean FlyingJalapeno2::testVoltage(byte select) // select is either "1" or "2"
+//Measure VCC now. Returns true if the measurement worked. If it did not (e.g. the reading was more than
+//FJ2_VCC_CALIBRATION_LIMIT percent from the nominal VCC), the nominal VCC is used until the next reset
+boolean FlyingJalapeno2::calibrateVCC()
 {
-  //Specify the read_pin and expected voltage
-  byte read_pin;
-  float expectedVoltage;
-  if (select == 1)
+  _vccCalibrated = true; // Even if this fails, so we don't try again on every test
+  _measuredVCC = 0.0;
+
+  if ((_vccSource == FJ2_VCC_NOMINAL) || (_adcReference != DEFAULT)) // Only VCC needs measuring
   {
-    read_pin = FJ2_PT_READ_V1;
-    expectedVoltage = _V1_actual * 10.0 / 11.0; // Compensate for resistor divider
-    //If VCC is 5.0V and V1/V2 are also 5.0V, the ADC reading is ~950
-    // which converts to 4.64V. So, for 5V, the fiddle factor should be 1.02
-    //If VCC is 3.3V and V1/V2 are also 3.3V, the ADC reading is ~970
-    // which converts to 3.13V. So, for 3.3V, the fiddle factor should be 1.04
-    //Let's split the difference and use a fiddle factor of 1.03
-    expectedVoltage *= 1.03; // Fiddle factor - from FJ2 testing
+    updateAdcWindows();
+    return (_vccSource == FJ2_VCC_NOMINAL);
   }
-  else if (select == 2)
+
+  long count = 0;
+  long total = 0;
+  float referenceVoltage = _vccCalibrationReference;
+  if (_vccSource == FJ2_VCC_FROM_ZENER)
   {
-    read_pin = FJ2_PT_READ_V2;
-    expectedVoltage = _V2_actual * 10.0 / 11.0; // Compensate for resistor divider
-    expectedVoltage *= 1.03; // Fiddle factor - from FJ2 testing
+    if (referenceVoltage <= 0.0) referenceVoltage = 3.3;
+    if (_FJ_VCC > referenceVoltage) // The Zener is only in regulation if VCC is higher than the Zener voltage
+      total = readAnalogSum(FJ2_BRAIN_VCC_A0, 0, &count);
   }
   else
   {
-    if (_printDebug == true)
-    {
-      _debugSerial->println(F("FlyingJalapeno2::testVoltage: Error! select must be 1 or 2."));
-    }
-    return (false);
+    if (referenceVoltage <= 0.0) referenceVoltage = 1.1;
+#ifdef FJ2_ADC_USE_ISR
+    total = _adcReadBandgap(_numAnalogSamples, &count);
+#endif
   }
 
+  float vcc = 0.0;
+  if (total > 0)
+    vcc = referenceVoltage * 1023.0 * count / total; // The reading is referenceVoltage / VCC * 1023
+
+  boolean result = (vcc >= (_FJ_VCC * (100 - FJ2_VCC_CALIBRATION_LIMIT) / 100.0)) && (vcc <= (_FJ_VCC * (100 + FJ2_VCC_CALIBRATION_LIMIT) / 100.0));
+  if (result)
+    _measuredVCC = vcc;
+
   if (_printDebug == true)
   {
-    _debugSerial->print(F("FlyingJalapeno2::testVoltage: Testing V"));
-    _debugSerial->print(select);
-    _debugSerial->print(F(". The expected voltage (from the resistor divider) is "));
-    _debugSerial->print(expectedVoltage, 2);
-    _debugSerial->println(F("V"));
+    debugLog(FJ2_MSG_VCC_CALIBRATION, vcc, result);
   }
 
-  //Verify the voltage is within 5%
-  return (verifyVoltage(read_pin, expectedVoltage, 5));
+  updateAdcWindows();
+  return (result);
 }
 
-//Test if the FJ2 VCC has been set correctly (using the 3.3V Zener diode on FJ2_BRAIN_VCC_A0)
-//Return true if FJ2_BRAIN_VCC_A0 matches _FJ_VCC
-boolean FlyingJalapeno2::testVCC()
+//Returns the VCC used to convert the ADC counts: the measured VCC or (if it has not been measured) the nominal VCC
+float FlyingJalapeno2::getMeasuredVCC()
 {
-  //Check VCC by reading the 3.3V zener connected to A0
-  //If VCC is 3.3V, the signal on A0 will be close to full range
-  //If VCC is 5V, the signal on A0 will be (roughly) 3.3V/5V * 1023 = 675
+  return ((_measuredVCC > 0.0) ? _measuredVCC : _FJ_VCC);
+}
 
-  int val = averagedAnalogRead(FJ2_BRAIN_VCC_A0);
+//PRIVATE: Measure VCC if VCC calibration is enabled and VCC has not been measured since the last reset
+void FlyingJalapeno2::checkVCCCalibration()
+{
+  if ((_vccSource != FJ2_VCC_NOMINAL) && (!_vccCalibrated))
+    calibrateVCC();
+}
 
-  if (_printDebug == true)
+//Returns the time each conversion takes (in micros) with the configured prescaler: 13 ADC clocks (plus the discarded conversions)
+float FlyingJalapeno2::getADCConversionMicros()
+{
+  return (13.0 * _adcPrescaler / 16.0); // The Mega2560 clock is 16MHz
+}
+
+//Average the analog reading to minimise noise
+//This is a blocking wrapper for startAveragedRead / isReadComplete / getAveragedRead
+int FlyingJalapeno2::averagedAnalogRead(byte analogPin, long numSamples)
+{
+  long count;
+  long total = readAnalogSum(analogPin, numSamples, &count);
+  if (count == 0)
+    return (0);
+  return ((int)(total / count));
+}
+
+//PRIVATE: Take numSamples samples of analogPin (_numAnalogSamples if numSamples is 0). Returns the total; count is set to the number of samples
+//The integer tests compare the total against an ADC window, so they never need to divide
+//If window is provided and the early exit is enabled, the read stops as soon as the verdict (inside / outside window) is certain
+long FlyingJalapeno2::readAnalogSum(byte analogPin, long numSamples, long *count, const FJ2_AdcWindow *window)
+{
+  FJ2_STAT_SCOPE(FJ2_STAT_AVERAGED_READ);
+
+  //The filter may change the number of samples
+  boolean sortSamples = (_analogFilter == FJ2_FILTER_TRIMMED_MEAN) || (_analogFilter == FJ2_FILTER_MEDIAN);
+  if ((numSamples == 0) && (_analogFilter == FJ2_FILTER_OVERSAMPLE))
+    numSamples = 1L << (2 * _analogFilterParameter); // 4^bits
+  else if (sortSamples)
   {
-    _debugSerial->print(F("FlyingJalapeno2::testVCC: VCC should be "));
-    _debugSerial->print(_FJ_VCC, 2);
-    _debugSerial->println(F("V"));
-    _debugSerial->print(F("FlyingJalapeno2::testVCC: val is: "));
-    _debugSerial->println(val);
+    if (numSamples == 0) numSamples = _numAnalogSamples;
+    if (numSamples > FJ2_ADC_RING_SIZE) numSamples = FJ2_ADC_RING_SIZE; // The samples must all fit in the ring buffer
   }
 
-  if ((_FJ_VCC >= 3.29) && (_FJ_VCC <= 3.31)) // Is VCC supposed to be 3.3V?
+  startAveragedRead(analogPin, numSamples);
+  long target = _adcTarget;
+  //The early exit tests the mean, so it can't be used with the trimmed mean or median
+  boolean earlyExit = _earlyExit && (window != NULL) && (target <= FJ2_EARLY_EXIT_MAX_SAMPLES) && !sortSamples;
+  long checked = 0; // The number of samples when the verdict was last checked
+  boolean stopped = false;
+  while (!isReadComplete())
   {
-    // val should be close to 1023. Return false if it isn't (i.e. VCC is higher than 3.3V!)
-    // Note: on the one FJ2 I have tested so far, val is: ~900 for 3.3V; and ~700 for 5.0V
-    if (val < 800)
+    run(); // Run the tasks (e.g. print buffered debug messages) while the samples are collected
+    if (earlyExit && !stopped)
     {
-      if (_printDebug == true)
+      noInterrupts();
+      long sampleCount = _adcCount;
+      long total = _adcTotals[0];
+      unsigned long squares = _adcSquares[0];
+      interrupts();
+
+      if ((sampleCount > checked) && (sampleCount >= _earlyExitMinSamples))
       {
-        _debugSerial->println(F("FlyingJalapeno2::testVCC: PANIC! VCC appears to be higher than 3.3V!"));
+        checked = sampleCount;
+        if (isVerdictCertain(total, squares, sampleCount, *window))
+        {
+          _adcStop();
+          stopped = true;
+        }
       }
-      return false;
     }
-    return true;
   }
+  _lastAnalogTotal = getAnalogSum(0, &_lastAnalogCount);
+  _lastSamplesTaken = _lastAnalogCount;
 
-  // else: _FJ_VCC must be 5.0V so check diode voltage reads as 3.3V
-  boolean result = verifyVoltage(FJ2_BRAIN_VCC_A0, 3.3, 10);
+  if (sortSamples)
+  {
+    uint16_t samples[FJ2_ADC_RING_SIZE];
+    uint8_t numCopied = getRecentSamples(samples, FJ2_ADC_RING_SIZE);
+    _lastAnalogTotal = _adcFilterSamples(samples, numCopied, _analogFilter, _analogFilterParameter, &_lastAnalogCount);
+  }
+  *count = _lastAnalogCount;
 
-  if ((!result) && (_printDebug == true))
+  if (stopped && (_printDebug == true))
   {
-    _debugSerial->println(F("FlyingJalapeno2::testVCC: PANIC! VCC appears to be out of bounds!"));
+    debugLog(FJ2_MSG_EARLY_EXIT, _lastSamplesTaken, target);
   }
 
-  return (result);
+  return (_lastAnalogTotal);
 }
 
-//Enable the I2C buffer by pulling FJ2_I2C_EN high
-void FlyingJalapeno2::enableI2CBuffer()
+//PRIVATE: Returns true if the mean of count samples is certainly inside, or certainly outside, window
+//The window boundaries are lo and hi + 1 (see FJ2_isSumInWindow). A boundary at the end of the ADC range (0 or 1024) is always satisfied
+boolean FlyingJalapeno2::isVerdictCertain(long total, unsigned long squares, long count, FJ2_AdcWindow window)
 {
-  pinMode(FJ2_I2C_EN, OUTPUT); // Enable the I2C buffer by pulling FJ2_I2C_EN high
-  digitalWrite(FJ2_I2C_EN, HIGH);
+  long lo = window.lo;
+  long hi = (long)window.hi + 1;
+  boolean belowLo = total < (lo * count);
+  boolean belowHi = total < (hi * count);
+  boolean loCertain = (lo == 0) || _adcBeyondDoubt(total, squares, count, lo, _earlyExitSigma);
+  boolean hiCertain = (hi > 1023) || _adcBeyondDoubt(total, squares, count, hi, _earlyExitSigma);
+
+  if (belowLo) // Outside (below)
+    return (loCertain);
+  if (!belowHi) // Outside (above)
+    return (hiCertain);
+  return (loCertain && hiCertain); // Inside
 }
-//Disable the I2C buffer by pulling FJ2_I2C_EN low
-void FlyingJalapeno2::disableI2CBuffer()
+
+//Enable or disable the early exit. When enabled, verifyVoltage, verifyCounts, testVoltage, testVCC and isV1/V2Shorted stop sampling
+//as soon as the mean is more than confidenceSigma standard errors inside (or outside) the window. At least minimumSamples are always taken.
+//Borderline readings still take all _numAnalogSamples samples
+void FlyingJalapeno2::setEarlyExit(boolean enable, uint8_t confidenceSigma, long minimumSamples)
 {
-  digitalWrite(FJ2_I2C_EN, LOW); // Make sure the I2C buffer is disabled by pulling FJ2_I2C_EN low
-  pinMode(FJ2_I2C_EN, OUTPUT);
+  _earlyExit = enable;
+  if (confidenceSigma > 0) _earlyExitSigma = confidenceSigma;
+  if (minimumSamples >= 2) _earlyExitMinSamples = minimumSamples; // The variance needs at least two samples
 }
 
-//Enable the Serial buffer by pulling FJ2_SERIAL_EN high
-void FlyingJalapeno2::enableSerialBuffer()
+//Returns the number of samples used by the most recent averaged read. Fewer than _numAnalogSamples if it stopped early
+long FlyingJalapeno2::getLastSampleCount()
 {
-  pinMode(FJ2_SERIAL_EN, OUTPUT); // Enable the Serial buffer by pulling FJ2_SERIAL_EN high
-  digitalWrite(FJ2_SERIAL_EN, HIGH);
+  return (_lastSamplesTaken);
 }
-//Disable the Serial buffer by pulling FJ2_SERIAL_EN low
-void FlyingJalapeno2::disableSerialBuffer()
+
+//Select the averaged read filter. parameter is the number of extra bits (FJ2_FILTER_OVERSAMPLE)
+//or the number of samples to trim from each end (FJ2_FILTER_TRIMMED_MEAN)
+void FlyingJalapeno2::setAnalogFilter(FJ2_adc_filter_e filter, uint8_t parameter)
 {
-  digitalWrite(FJ2_SERIAL_EN, LOW); // Make sure the Serial buffer is disabled by pulling FJ2_SERIAL_EN low
-  pinMode(FJ2_SERIAL_EN, OUTPUT);
+  if (filter == FJ2_FILTER_OVERSAMPLE)
+    parameter = constrain(parameter, (uint8_t)1, (uint8_t)FJ2_OVERSAMPLE_MAX_BITS);
+  _analogFilter = filter;
+  _analogFilterParameter = parameter;
 }
 
-//Enable the SPI buffer by pulling FJ2_SPI_EN high
-void FlyingJalapeno2::enableSPIBuffer()
+//Returns the most recent averaged read with the oversampled bits: total * 2^bits / count
+//For 4^bits samples this is the total shifted right by bits (decimation). Without oversampling it is the same as getLastAveragedRead
+long FlyingJalapeno2::getLastOversampledRead()
 {
-  pinMode(FJ2_TARGET_CS, OUTPUT); //Deselect the SPI target
-  digitalWrite(FJ2_TARGET_CS, HIGH);
-  pinMode(FJ2_SPI_EN, OUTPUT); // Enable the SPI buffer is disabled by pulling FJ2_SPI_EN high
-  digitalWrite(FJ2_SPI_EN, HIGH);
+  if (_lastAnalogCount == 0)
+    return (-1);
+  uint8_t bits = (_analogFilter == FJ2_FILTER_OVERSAMPLE) ? _analogFilterParameter : 0;
+  return ((_lastAnalogTotal << bits) / _lastAnalogCount);
 }
-//Disable the SPI buffer by pulling FJ2_SPI_EN low
-void FlyingJalapeno2::disableSPIBuffer()
+
+//Returns the result of the most recent averaged read. -1 if there has not been one (since runSequence started the step)
+int FlyingJalapeno2::getLastAveragedRead()
 {
-  digitalWrite(FJ2_SPI_EN, LOW); // Make sure the SPI buffer is disabled by pulling FJ2_SPI_EN low
-  pinMode(FJ2_SPI_EN, OUTPUT);
-  digitalWrite(FJ2_TARGET_CS, HIGH); //Prepare to deselect the SPI target (once the power is enabled)
-  pinMode(FJ2_TARGET_CS, INPUT);
+  if (_lastAnalogCount == 0)
+    return (-1);
+  return ((int)(_lastAnalogTotal / _lastAnalogCount));
 }
 
-//Enable the microSD buffer by pulling FJ2_MICROSD_EN high
-void FlyingJalapeno2::enableMicroSDBuffer()
+//Returns the average of the samples collected so far for the chosen pin
+//channel is the index of the pin in the list passed to startAveragedRead (0 for a single pin)
+int FlyingJalapeno2::getAveragedRead(uint8_t channel)
 {
-  pinMode(FJ2_MICROSD_CS, OUTPUT); // Deselect the microSD card
-  digitalWrite(FJ2_MICROSD_CS, HIGH);
-  pinMode(FJ2_MICROSD_EN, OUTPUT); // Pull FJ2_MICROSD_EN high
-  digitalWrite(FJ2_MICROSD_EN, HIGH);
+  long count;
+  long total = getAnalogSum(channel, &count);
+  if (count == 0)
+    return (0);
+  return ((int)(total / count));
 }
-//Disable the microSD buffer by pulling FJ2_MICROSD_EN low
-void FlyingJalapeno2::disableMicroSDBuffer()
+
+//PRIVATE: Returns the total of the samples collected so far for the chosen pin. count is set to the number of samples
+long FlyingJalapeno2::getAnalogSum(uint8_t channel, long *count)
 {
-  digitalWrite(FJ2_MICROSD_EN, LOW); // Make sure the microSD buffer is disabled by pulling FJ2_MICROSD_EN low
-  pinMode(FJ2_MICROSD_EN, OUTPUT);
-  digitalWrite(FJ2_MICROSD_CS, HIGH); // Get ready to deselect the microSD
-  pinMode(FJ2_MICROSD_CS, INPUT);
+  *count = 0;
+  if (channel >= _adcNumChannels)
+    return (0);
+
+  noInterrupts(); // The totals and count are updated by the ADC interrupt
+  long total = _adcTotals[channel];
+  long allCount = _adcCount;
+  interrupts();
+
+  //The conversions are interleaved, so work out how many samples this pin has had
+  long channelCount = allCount / _adcNumChannels;
+  if (channel < (allCount % _adcNumChannels))
+    channelCount++;
+
+  *count = channelCount;
+  return (total);
 }
 
-//Enable the microSD power by pulling FJ2_MICROSD_PWR_EN high
-void FlyingJalapeno2::enableMicroSDPower()
+//Copy up to FJ2_ADC_RING_SIZE of the most recent samples into samples (oldest first)
+//Returns the number of samples copied
+uint8_t FlyingJalapeno2::getRecentSamples(uint16_t *samples, uint8_t maxSamples)
 {
-  pinMode(FJ2_MICROSD_PWR_EN, OUTPUT); // Pull FJ2_MICROSD_PWR_EN high
-  digitalWrite(FJ2_MICROSD_PWR_EN, HIGH);
+  noInterrupts();
+  long count = _adcCount;
+  uint8_t head = _adcRingHead;
+  interrupts();
+
+  uint8_t available = (count < FJ2_ADC_RING_SIZE) ? (uint8_t)count : FJ2_ADC_RING_SIZE;
+  if (maxSamples > available) maxSamples = available;
+
+  //Start at the oldest of the maxSamples most recent samples
+  uint8_t index = (head + FJ2_ADC_RING_SIZE - maxSamples) % FJ2_ADC_RING_SIZE;
+  for (uint8_t i = 0; i < maxSamples; i++)
+  {
+    samples[i] = _adcRing[index];
+    index = (index + 1) % FJ2_ADC_RING_SIZE;
+  }
+  return (maxSamples);
 }
-//Disable the microSD power by pulling FJ2_MICROSD_PWR_EN low
-void FlyingJalapeno2::disableMicroSDPower()
+
+//Select fixed or adaptive settle detection
+//adaptive = false: wait a fixed 200ms before sampling (the default)
+//adaptive = true: sample the pin every settleIntervalMillis. Each sample is the mean of settleWindowSamples ADC readings.
+//  The signal is settled once settleStableWindows successive means have been within toleranceCounts of the previous mean.
+//  maxSettleMillis is the timeout
+void FlyingJalapeno2::setSettleMode(boolean adaptive, int toleranceCounts, unsigned long maxSettleMillis, unsigned long settleIntervalMillis, uint8_t settleWindowSamples, uint8_t settleStableWindows)
 {
-  digitalWrite(FJ2_MICROSD_PWR_EN, LOW); // Make sure the microSD power is disabled by pulling FJ2_MICROSD_PWR_EN low
-  pinMode(FJ2_MICROSD_PWR_EN, OUTPUT);
+  _adaptiveSettle = adaptive;
+  if (toleranceCounts >= 0) _settleTolerance = toleranceCounts;
+  _maxSettleMillis = maxSettleMillis;
+  _settleIntervalMillis = settleIntervalMillis;
+  if (settleWindowSamples > 0) _settleWindowSamples = settleWindowSamples;
+  if (settleStableWindows > 0) _settleStableWindows = settleStableWindows;
 }
 
-//Verify the address of an I2C device
-//If address is zero, do a full scan
-//Return true if the specified address pings correctly
-boolean FlyingJalapeno2::verifyI2Cdevice(byte address)
+//Returns the settle time used by the most recent test (in millis)
+unsigned long FlyingJalapeno2::getLastSettleMillis()
+{
+  return (_lastSettleMillis);
+}
+
+//Returns true if the most recent adaptive settle reached maxSettleMillis
+boolean FlyingJalapeno2::lastSettleTimedOut()
+{
+  return (_lastSettleTimedOut);
+}
+
+//PRIVATE: Wait for the voltage on pin to settle before taking a ADC reading
+void FlyingJalapeno2::waitForSettle(byte pin)
+{
+  waitForSettle(&pin, 1);
+}
+
+//PRIVATE: Wait for the voltages on numPins pins to settle before taking ADC readings
+//In adaptive mode, the pins are sampled together (interleaved) and all of them must be stable
+void FlyingJalapeno2::waitForSettle(const byte *pins, uint8_t numPins)
 {
-  byte error;
-  boolean result = false;
+  _lastSettleTimedOut = false;
+
+  if (!_adaptiveSettle)
+  {
+    idleDelay(200);
+    _lastSettleMillis = 200;
+    return;
+  }
 
-  for (int device = 1; device < 127; device++) // Step through all devices
+  if (numPins > FJ2_ADC_MAX_CHANNELS) numPins = FJ2_ADC_MAX_CHANNELS;
+
+  unsigned long startMillis = millis();
+  int previousMeans[FJ2_ADC_MAX_CHANNELS];
+  boolean havePrevious = false; // False until we have the first set of means
+  uint8_t stableWindows = 0;
+
+  while (true)
   {
-    if ((address == 0) || (device == address)) // Check if we should ping this one
+    startAveragedRead(pins, numPins, _settleWindowSamples);
+    while (!isReadComplete())
+      run(); // Wait for the samples to be collected
+
+    boolean stable = havePrevious; // We need two sets of means before we can check for stability
+    for (uint8_t i = 0; i < numPins; i++)
     {
-      if (_printDebug == true)
-      {
-        _debugSerial->print(F("FlyingJalapeno2::verifyI2Cdevice: Pinging address 0x"));
-        if (device < 16) _debugSerial->print(F("0"));
-        _debugSerial->print(device, HEX);
-      }
+      int mean = getAveragedRead(i);
+      if (havePrevious && (abs(mean - previousMeans[i]) > _settleTolerance))
+        stable = false;
+      previousMeans[i] = mean;
+    }
+    havePrevious = true;
 
-      Wire.beginTransmission(device); // Ping this device
-      error = Wire.endTransmission();
+    if (stable)
+      stableWindows++;
+    else
+      stableWindows = 0;
 
-      if (error == 0)
+    if (stableWindows >= _settleStableWindows)
+      break; // Settled
+
+    if (millis() - startMillis >= _maxSettleMillis)
+    {
+      _lastSettleTimedOut = true;
+      break; // Timeout
+    }
+
+    idleDelay(_settleIntervalMillis);
+  }
+
+  _lastSettleMillis = millis() - startMillis;
+
+  if (_printDebug == true)
+  {
+    debugLog(_lastSettleTimedOut ? FJ2_MSG_SETTLE_TIMEOUT : FJ2_MSG_SETTLE, _lastSettleMillis);
+  }
+}
+
+//Test a pin to see what voltage is on the pin.
+//Returns true if pin voltage is within a given window of the value we are looking for
+//pin = pin to test
+//expectedVoltage = voltage we expect. 0.0 to 5.0 (float)
+//allowedPercent = allowed window for overage. 0 to 100 (int) (default 10%)
+boolean FlyingJalapeno2::verifyVoltage(int pin, float expectedVoltage, int allowedPercent)
+{
+  boolean result = verifyWindow(pin, makeAdcWindow(expectedVoltage, allowedPercent));
+
+  if (_printDebug == true)
+  {
+    printVerifyDebug(expectedVoltage, allowedPercent / 100.0, result);
+  }
+
+  return (result);
+}
+
+//The verifyVoltage pass / fail test for a single reading
+//Used to work out (and check) the ADC windows, so the windows give exactly the same results as the float maths
+static boolean _fj2VoltageAtLeast(float vcc, int reading, float minimumVoltage)
+{
+  float readVoltage = vcc / 1023 * reading; //Convert reading to voltage
+  return (readVoltage >= minimumVoltage);
+}
+static boolean _fj2VoltageAtMost(float vcc, int reading, float maximumVoltage)
+{
+  float readVoltage = vcc / 1023 * reading;
+  return (readVoltage <= maximumVoltage);
+}
+
+//Return the ADC window for expectedVoltage +/- allowedPercent
+//The readings inside the window are exactly those which verifyVoltage(pin, expectedVoltage, allowedPercent) passes
+//This uses float maths - so call it once (e.g. in setup) and then call verifyCounts as often as needed
+FJ2_AdcWindow FlyingJalapeno2::makeAdcWindow(float expectedVoltage, int allowedPercent)
+{
+  checkVCCCalibration(); // The window depends on VCC
+  //float allowanceFraction = map(allowedPercent, 0, 100, 0, 1.0); //Scale int to a fraction of 1.0
+  //Grrrr! map doesn't work with floats at all
+
+  float allowanceFraction = allowedPercent / 100.0; //Scale the allowedPercent to a float
+  float minimumVoltage = expectedVoltage * (1.0 - allowanceFraction);
+  float maximumVoltage = expectedVoltage * (1.0 + allowanceFraction);
+
+  //Start with the constexpr estimate, then move the limits by a count if float rounding puts them in a different place
+  float reference = getADCReferenceVoltage();
+  FJ2_AdcWindow estimate = FJ2_adcWindow(expectedVoltage, allowedPercent, reference);
+  int lo = estimate.lo;
+  int hi = estimate.hi;
+  while ((lo > 0) && _fj2VoltageAtLeast(reference, lo - 1, minimumVoltage))
+    lo--;
+  while ((lo <= 1023) && !_fj2VoltageAtLeast(reference, lo, minimumVoltage))
+    lo++;
+  while ((hi < 1023) && _fj2VoltageAtMost(reference, hi + 1, maximumVoltage))
+    hi++;
+  while ((hi >= 0) && !_fj2VoltageAtMost(reference, hi, maximumVoltage))
+    hi--;
+
+  FJ2_AdcWindow window;
+  window.lo = lo;
+  if (hi < 0) // Nothing passes
+  {
+    window.lo = 1;
+    window.hi = 0;
+  }
+  else
+    window.hi = hi;
+  return (window);
+}
+
+//Returns true if the averaged reading on pin is inside window
+//The window can come from makeAdcWindow or FJ2_adcWindow
+boolean FlyingJalapeno2::verifyCounts(int pin, FJ2_AdcWindow window)
+{
+  boolean result = verifyWindow(pin, window);
+
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_VERIFY_COUNTS, window.lo, window.hi, getLastAveragedRead(), result);
+  }
+
+  return (result);
+}
+
+//PRIVATE: Make pin an input, wait for it to settle, take the samples and compare the total against window
+boolean FlyingJalapeno2::verifyWindow(int pin, FJ2_AdcWindow window)
+{
+  FJ2_STAT_SCOPE(FJ2_STAT_VERIFY_VOLTAGE);
+
+  pinMode(pin, INPUT); //Make sure pin is an input
+
+  waitForSettle(pin); //Wait for voltage to settle before taking a ADC reading
+
+  long count;
+  long total = readAnalogSum(pin, 0, &count, &window);
+
+  return (FJ2_isSumInWindow(total, count, window));
+}
+
+//PRIVATE: Print the verifyVoltage debug messages - for the most recent reading
+void FlyingJalapeno2::printVerifyDebug(float expectedVoltage, float allowanceFraction, boolean result)
+{
+  int reading = getLastAveragedRead();
+  debugLog(FJ2_MSG_VERIFY_EXPECTED, expectedVoltage);
+  debugLog(FJ2_MSG_VERIFY_ALLOWANCE, allowanceFraction);
+  debugLog(FJ2_MSG_VERIFY_READING, reading);
+  debugLog(FJ2_MSG_VERIFY_VOLTAGE, getADCReferenceVoltage() / 1023 * reading);
+  debugLog(FJ2_MSG_VERIFY_RESULT, result);
+}
+
+boolean FlyingJalapeno2::verifyValue(float input_value, float correct_val, float allowance_percent)
+{
+  float allowanceFraction = allowance_percent / 100.0; //Scale the allowedPercent to a float
+
+  if ((input_value <= (correct_val * (1.0 + allowanceFraction))) && (input_value >= (correct_val * (1.0 - allowanceFraction))))
+    return true; // good value
+  return false;
+}
+
+//Enable or disable regulator #1
+void FlyingJalapeno2::enableV1(void)
+{
+  if (_V1_setting == 0.0) // Check if setVoltageV1 has been called
+  {
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_ENABLE_V1_NOT_SET);
+    }
+    return;
+  }
+
+  switchOnRail(1);
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_ENABLE_V1);
+  }
+}
+
+//PRIVATE: Turn V1 or V2 on - without any checks or debug messages, so it can be done inside a timed window
+void FlyingJalapeno2::switchOnRail(byte select)
+{
+  if (select == 1)
+  {
+    FJ2_Pin<FJ2_V1_POWER_CONTROL>::outputHigh(); // turn on the high side switch
+    _V1_actual = _V1_setting;
+    _V1Window = _V1SettingWindow;
+  }
+  else
+  {
+    FJ2_Pin<FJ2_V2_POWER_CONTROL>::outputHigh(); // turn on the high side switch
+    _V2_actual = _V2_setting;
+    _V2Window = _V2SettingWindow;
+  }
+}
+
+void FlyingJalapeno2::disableV1(void)
+{
+  //Do not do Serial prints here as disableV1 is called when the class is instantiated - before Serial is begun
+  FJ2_Pin<FJ2_V1_POWER_CONTROL>::outputLow(); // turn off the high side switch
+  _V1_actual = 0.0;
+  _V1Window.lo = 0; // testVoltage(1) expects zero
+  _V1Window.hi = 0;
+}
+
+//Enable or disable regulator #2
+void FlyingJalapeno2::enableV2(void)
+{
+  if (_V2_setting == 0.0) // Check if setVoltageV2 has been called
+  {
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_ENABLE_V2_NOT_SET);
+    }
+    return;
+  }
+
+  switchOnRail(2);
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_ENABLE_V2);
+  }
+}
+
+void FlyingJalapeno2::disableV2(void)
+{
+  //Do not do Serial prints here as disableV2 is called when the class is instantiated - before Serial is begun
+  FJ2_Pin<FJ2_V2_POWER_CONTROL>::outputLow(); // turn off the high side switch
+  _V2_actual = 0.0;
+  _V2Window.lo = 0; // testVoltage(2) expects zero
+  _V2Window.hi = 0;
+}
+
+//Enable V1 or V2 and capture the ramp on FJ2_PT_READ_V1/V2. This replaces enableV1/V2 plus testVoltage
+//A sample is taken every sampleIntervalMicros (0 = as fast as the ADC can go) until the buffer is full
+//If the reading has not risen past risePercent of the expected reading within cutOffMicros, the rail is disabled straight away
+//Returns true if the rail rose and - once it has settled - the averaged reading is inside the testVoltage window
+boolean FlyingJalapeno2::enableV1WithCapture(FJ2_RampCapture *capture, uint8_t risePercent, unsigned long cutOffMicros, unsigned long sampleIntervalMicros)
+{
+  return (enableWithCapture(1, capture, risePercent, cutOffMicros, sampleIntervalMicros));
+}
+
+boolean FlyingJalapeno2::enableV2WithCapture(FJ2_RampCapture *capture, uint8_t risePercent, unsigned long cutOffMicros, unsigned long sampleIntervalMicros)
+{
+  return (enableWithCapture(2, capture, risePercent, cutOffMicros, sampleIntervalMicros));
+}
+
+//PRIVATE: Enable V1 or V2 and capture the ramp. See enableV1WithCapture
+boolean FlyingJalapeno2::enableWithCapture(byte select, FJ2_RampCapture *capture, uint8_t risePercent, unsigned long cutOffMicros, unsigned long sampleIntervalMicros)
+{
+  memset(capture, 0, sizeof(FJ2_RampCapture));
+
+  checkVCCCalibration(); // Update the windows if VCC needs measuring
+
+  byte read_pin = (select == 1) ? FJ2_PT_READ_V1 : FJ2_PT_READ_V2;
+  FJ2_AdcWindow window = (select == 1) ? _V1SettingWindow : _V2SettingWindow;
+  if ((window.lo == 0) && (window.hi == 0)) // setVoltageV1/V2 has not been called
+  {
+    if (_printDebug == true)
+    {
+      debugLog((select == 1) ? FJ2_MSG_ENABLE_V1_NOT_SET : FJ2_MSG_ENABLE_V2_NOT_SET);
+    }
+    return (false);
+  }
+
+  //The rail has risen once the reading passes risePercent of the bottom of the window
+  long riseCounts = ((long)window.lo * risePercent) / 100;
+
+  pinMode(read_pin, INPUT);
+  FJ2_Pin<FJ2_POWER_TEST_CONTROL>::input(); // Make sure the power test network is off
+
+  boolean risen = false;
+  uint8_t numSamples = 0;
+  unsigned long firstSampleMicros = 0; // When the first and last samples were taken (since startMicros)
+  unsigned long lastSampleMicros = 0;
+  unsigned long startMicros = micros();
+  switchOnRail(select); // Not enableV1/V2 - they could print the debug message inside the capture
+
+  while (numSamples < FJ2_RAMP_MAX_SAMPLES)
+  {
+    //Wait for the next sample time
+    while ((sampleIntervalMicros > 0) && ((micros() - startMicros) < (numSamples * sampleIntervalMicros)))
+      ;
+
+    uint16_t sample = analogRead(read_pin);
+    unsigned long elapsed = micros() - startMicros;
+    if (numSamples == 0) firstSampleMicros = elapsed;
+    lastSampleMicros = elapsed;
+    capture->samples[numSamples++] = sample;
+
+    if (sample >= riseCounts)
+      risen = true;
+    else if ((!risen) && (elapsed >= cutOffMicros))
+    {
+      //The rail is not rising. Probably a short. Disable it now
+      if (select == 1) disableV1();
+      else disableV2();
+      capture->cutOff = true;
+      break;
+    }
+  }
+
+  capture->numSamples = numSamples;
+  capture->captureMicros = micros() - startMicros;
+
+  if (_printDebug == true)
+  {
+    debugLog((select == 1) ? FJ2_MSG_ENABLE_V1 : FJ2_MSG_ENABLE_V2);
+  }
+
+  //The final reading: the mean (and the spread) of the last FJ2_RAMP_FINAL_SAMPLES samples
+  uint8_t first = (numSamples > FJ2_RAMP_FINAL_SAMPLES) ? numSamples - FJ2_RAMP_FINAL_SAMPLES : 0;
+  long total = 0;
+  capture->finalMin = 1023;
+  for (uint8_t i = first; i < numSamples; i++)
+  {
+    uint16_t sample = capture->samples[i];
+    total += sample;
+    if (sample < capture->finalMin) capture->finalMin = sample;
+    if (sample > capture->finalMax) capture->finalMax = sample;
+  }
+  long count = numSamples - first;
+  capture->finalReading = (count == 0) ? 0 : (int)(total / count);
+
+  //The rise time: from 10% to 90% of the final reading
+  if (risen && (capture->finalReading > 0))
+  {
+    int from = -1;
+    int to = -1;
+    for (uint8_t i = 0; i < numSamples; i++)
+    {
+      long tenTimes = (long)capture->samples[i] * 10;
+      if ((from < 0) && (tenTimes >= capture->finalReading)) from = i;
+      if ((to < 0) && (tenTimes >= ((long)capture->finalReading * 9))) to = i;
+    }
+    if ((from >= 0) && (to >= from))
+    {
+      //The samples are sampleIntervalMicros apart. With no interval, they are back to back - use the measured spacing
+      if (sampleIntervalMicros > 0)
+        capture->riseMicros = sampleIntervalMicros * (unsigned long)(to - from);
+      else if (numSamples > 1)
+        capture->riseMicros = ((lastSampleMicros - firstSampleMicros) * (unsigned long)(to - from)) / (numSamples - 1);
+    }
+  }
+
+  //The capture may end before the rail has settled. Decide pass with the normal settle and windowed read - like testVoltage
+  if (risen && (!capture->cutOff))
+    capture->pass = verifyWindow(read_pin, window);
+
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_RAMP_CAPTURE, select, capture->finalReading, capture->riseMicros, capture->cutOff, capture->pass);
+  }
+
+  return (capture->pass);
+}
+
+//Setup the first power supply to the chosen voltage level
+//Leaves MOSFET off so regulator is configured but not connected to target
+void FlyingJalapeno2::setVoltageV1(float voltage)
+{
+  // Turn the V1 voltage control pins off
+  FJ2_PinGroup<FJ2_V1_CONTROL_TO_3V3, FJ2_V1_CONTROL_TO_5V0>::input();
+
+  if ((voltage >= 3.25) && (voltage <= 3.35))
+  {
+    FJ2_Pin<FJ2_V1_CONTROL_TO_3V3>::outputLow();
+    _V1_setting = 3.3;
+  }
+  else if ((voltage >= 4.95) && (voltage <= 5.05))
+  {
+    FJ2_Pin<FJ2_V1_CONTROL_TO_5V0>::outputLow();
+    _V1_setting = 5.0;
+  }
+  else
+  {
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_SET_V1_INVALID, voltage);
+    }
+    FJ2_Pin<FJ2_V1_CONTROL_TO_3V3>::outputLow(); // default to 3.3V - even when the high side switch is turn off.
+    _V1_setting = 3.3;
+  }
+
+  _V1SettingWindow = makeAdcWindow(railReadVoltage(_V1_setting), 5); // The testVoltage(1) window - once V1 is enabled
+
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_SET_V1, _V1_setting);
+  }
+}
+
+//Setup the second power supply to the chosen voltage level
+//Leaves MOSFET off so regulator is configured but not connected to target
+void FlyingJalapeno2::setVoltageV2(float voltage)
+{
+  // Turn the V2 voltage control pins off
+  FJ2_PinGroup<FJ2_V2_CONTROL_TO_3V3, FJ2_V2_CONTROL_TO_3V7, FJ2_V2_CONTROL_TO_4V2, FJ2_V2_CONTROL_TO_5V0>::input();
+
+  if ((voltage >= 3.25) && (voltage <= 3.35))
+  {
+    FJ2_Pin<FJ2_V2_CONTROL_TO_3V3>::outputLow();
+    _V2_setting = 3.3;
+  }
+  else if ((voltage >= 3.65) && (voltage <= 3.75))
+  {
+    FJ2_Pin<FJ2_V2_CONTROL_TO_3V7>::outputLow();
+    _V2_setting = 3.7;
+  }
+  else if ((voltage >= 4.15) && (voltage <= 4.25))
+  {
+    FJ2_Pin<FJ2_V2_CONTROL_TO_4V2>::outputLow();
+    _V2_setting = 4.2;
+  }
+  else if ((voltage >= 4.95) && (voltage <= 5.05))
+  {
+    FJ2_Pin<FJ2_V2_CONTROL_TO_5V0>::outputLow();
+    _V2_setting = 5.0;
+  }
+  else
+  {
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_SET_V2_INVALID, voltage);
+    }
+    FJ2_Pin<FJ2_V2_CONTROL_TO_3V3>::outputLow(); // default to 3.3V
+    _V2_setting = 3.3;
+  }
+
+  _V2SettingWindow = makeAdcWindow(railReadVoltage(_V2_setting), 5); // The testVoltage(2) window - once V2 is enabled
+
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_SET_V2, _V2_setting);
+  }
+}
+
+//The V2 settings, and the index of voltage in _v2Settings (-1 if it is not a valid setting). Shared by sweepV2 and switchVoltageV2
+static const float _v2Settings[4] = { 3.3, 3.7, 4.2, 5.0 };
+static int8_t _v2SettingIndex(float voltage)
+{
+  for (int8_t i = 0; i < 4; i++)
+  {
+    if ((voltage >= (_v2Settings[i] - 0.05)) && (voltage <= (_v2Settings[i] + 0.05)))
+      return (i);
+  }
+  return (-1);
+}
+
+//Step V2 through numSettings settings (3.3, 3.7, 4.2 or 5.0V) in one pass and measure each one
+//V2 stays enabled: the control resistors are switched under power, settling is detected adaptively
+//(see setSettleMode) and the rail is measured. V2 is left enabled at the last setting
+//Returns true if every setting passed (the testVoltage window). The results are stored in results
+//Note: due to the 10k/11k divider on FJ2_PT_READ_V2, only voltages lower than VCC * 0.9 can be verified
+boolean FlyingJalapeno2::sweepV2(const float *settings, FJ2_SweepResult *results, uint8_t numSettings)
+{
+  boolean allPassed = true;
+  boolean adaptiveSettle = _adaptiveSettle;
+  _adaptiveSettle = true; // The sweep always uses adaptive settle detection
+
+  checkVCCCalibration(); // Update the windows if VCC needs measuring
+  pinMode(FJ2_PT_READ_V2, INPUT);
+  FJ2_Pin<FJ2_POWER_TEST_CONTROL>::input(); // Make sure the power test network is off
+
+  for (uint8_t i = 0; i < numSettings; i++)
+  {
+    FJ2_SweepResult *result = &results[i];
+    memset(result, 0, sizeof(FJ2_SweepResult));
+    result->setting = settings[i];
+
+    if (_v2SettingIndex(settings[i]) < 0) // Check the setting before touching the rail. ran and pass stay false
+    {
+      if (_printDebug == true)
+      {
+        debugLog(FJ2_MSG_SET_V2_INVALID, settings[i]);
+      }
+      allPassed = false;
+      continue;
+    }
+
+    unsigned long startMillis = millis();
+    if (_V2_actual == 0.0) // V2 is disabled. Select the first setting and enable it
+    {
+      setVoltageV2(settings[i]);
+      enableV2();
+    }
+    else
+      switchVoltageV2(settings[i]);
+    result->ran = true;
+
+    waitForSettle(FJ2_PT_READ_V2);
+    result->settleMillis = millis() - startMillis;
+    result->settleTimedOut = _lastSettleTimedOut;
+
+    long count;
+    long total = readAnalogSum(FJ2_PT_READ_V2, 0, &count, &_V2Window);
+    result->rawMean = (count == 0) ? 0 : (int)(total / count);
+    result->volts = getADCReferenceVoltage() / 1023 * result->rawMean / railReadVoltage(1.0); // Undo the divider and the fiddle factor
+    result->pass = FJ2_isSumInWindow(total, count, _V2Window);
+    if (!result->pass)
+      allPassed = false;
+
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_SWEEP_STEP, _V2_setting, result->volts, result->settleMillis, result->pass);
+    }
+  }
+
+  _adaptiveSettle = adaptiveSettle;
+  return (allPassed);
+}
+
+//PRIVATE: Change the V2 setting while V2 is enabled. Returns false if voltage is not 3.3, 3.7, 4.2 or 5.0V
+//The new control resistor is selected before the old one is released (make before break), so the regulator feedback is never open.
+//The two resistors are only in parallel for a few clock cycles, which the regulator output capacitance absorbs
+boolean FlyingJalapeno2::switchVoltageV2(float voltage)
+{
+  switch (_v2SettingIndex(voltage))
+  {
+    case 0:
+      FJ2_Pin<FJ2_V2_CONTROL_TO_3V3>::outputLow();
+      FJ2_PinGroup<FJ2_V2_CONTROL_TO_3V7, FJ2_V2_CONTROL_TO_4V2, FJ2_V2_CONTROL_TO_5V0>::input();
+      break;
+    case 1:
+      FJ2_Pin<FJ2_V2_CONTROL_TO_3V7>::outputLow();
+      FJ2_PinGroup<FJ2_V2_CONTROL_TO_3V3, FJ2_V2_CONTROL_TO_4V2, FJ2_V2_CONTROL_TO_5V0>::input();
+      break;
+    case 2:
+      FJ2_Pin<FJ2_V2_CONTROL_TO_4V2>::outputLow();
+      FJ2_PinGroup<FJ2_V2_CONTROL_TO_3V3, FJ2_V2_CONTROL_TO_3V7, FJ2_V2_CONTROL_TO_5V0>::input();
+      break;
+    case 3:
+      FJ2_Pin<FJ2_V2_CONTROL_TO_5V0>::outputLow();
+      FJ2_PinGroup<FJ2_V2_CONTROL_TO_3V3, FJ2_V2_CONTROL_TO_3V7, FJ2_V2_CONTROL_TO_4V2>::input();
+      break;
+    default:
+      return (false);
+  }
+
+  _V2_setting = _v2Settings[_v2SettingIndex(voltage)];
+  _V2_actual = _V2_setting;
+  _V2SettingWindow = makeAdcWindow(railReadVoltage(_V2_setting), 5);
+  _V2Window = _V2SettingWindow;
+  return (true);
+}
+
+//Return _V1_setting - i.e. what V1 will be when enabled
+float FlyingJalapeno2::getVoltageSettingV1()
+{
+  return (_V1_setting);
+}
+
+//Return _V2_setting - i.e. what V2 will be when enabled
+float FlyingJalapeno2::getVoltageSettingV2()
+{
+ return (_V2_setting);
+}
+
+
+//PRIVATE: Return the voltage expected on FJ2_PT_READ_V1 / FJ2_PT_READ_V2 when V1 / V2 is enabled
+//Returns zero if select is not 1 or 2 (or if the regulator is not enabled)
+float FlyingJalapeno2::expectedRailVoltage(byte select) // select is either "1" or "2"
+{
+  if (select == 1)
+    return (railReadVoltage(_V1_actual));
+  else if (select == 2)
+    return (railReadVoltage(_V2_actual));
+  return (0.0);
+}
+
+//PRIVATE: Return the voltage expected on FJ2_PT_READ_V1 / FJ2_PT_READ_V2 when V1 / V2 is at railVoltage
+float FlyingJalapeno2::railReadVoltage(float railVoltage)
+{
+  float expectedVoltage = railVoltage * 10.0 / 11.0; // Compensate for resistor divider
+
+  //If VCC is 5.0V and V1/V2 are also 5.0V, the ADC reading is ~950
+  // which converts to 4.64V. So, for 5V, the fiddle factor should be 1.02
+  //If VCC is 3.3V and V1/V2 are also 3.3V, the ADC reading is ~970
+  // which converts to 3.13V. So, for 3.3V, the fiddle factor should be 1.04
+  //Let's split the difference and use a fiddle factor of 1.03
+  expectedVoltage *= FJ2_RAIL_FIDDLE_FACTOR; // Fiddle factor - from FJ2 testing
+  return (expectedVoltage);
+}
+
+//Test if the voltage on V1/V2 is OK. Returns false if the voltage is out of range
+//Note: due to the 10k/11k divider on the PT_READ pins, we can only verify voltages which are lower than VCC * 0.9
+boolean FlyingJalapeno2::testVoltage(byte select) // select is either "1" or "2"
+{
+  checkVCCCalibration(); // Update the windows if VCC needs measuring
+  //Specify the read_pin and the ADC window (the expected voltage +/- 5%. See setVoltageV1/V2)
+  byte read_pin;
+  FJ2_AdcWindow window;
+  if (select == 1)
+  {
+    read_pin = FJ2_PT_READ_V1;
+    window = _V1Window;
+  }
+  else if (select == 2)
+  {
+    read_pin = FJ2_PT_READ_V2;
+    window = _V2Window;
+  }
+  else
+  {
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_TEST_VOLTAGE_SELECT);
+    }
+    return (false);
+  }
+
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_TEST_VOLTAGE, select, expectedRailVoltage(select));
+  }
+
+  //Verify the voltage is within 5%
+  boolean result = verifyWindow(read_pin, window);
+
+  if (_printDebug == true)
+  {
+    printVerifyDebug(expectedRailVoltage(select), 0.05, result);
+  }
+
+  return (result);
+}
+
+//Test if the FJ2 VCC has been set correctly (using the 3.3V Zener diode on FJ2_BRAIN_VCC_A0)
+//Return true if FJ2_BRAIN_VCC_A0 matches _FJ_VCC
+boolean FlyingJalapeno2::testVCC()
+{
+  //Check VCC by reading the 3.3V zener connected to A0
+  //If VCC is 3.3V, the signal on A0 will be close to full range
+  //If VCC is 5V, the signal on A0 will be (roughly) 3.3V/5V * 1023 = 675
+
+  checkVCCCalibration(); // Update _vccWindow if VCC needs measuring
+
+  boolean vccIs3V3 = (_FJ_VCC >= 3.29) && (_FJ_VCC <= 3.31); // Is VCC supposed to be 3.3V?
+  FJ2_AdcWindow window = { 800, 1023 }; // The 3.3V test below - so the early exit can use it
+  long count;
+  long total = readAnalogSum(FJ2_BRAIN_VCC_A0, 0, &count, vccIs3V3 ? &window : NULL);
+  int val = (count == 0) ? 0 : (int)(total / count);
+
+  if (_printDebug == true)
+  {
+    debugLog(FJ2_MSG_VCC_EXPECTED, _FJ_VCC);
+    debugLog(FJ2_MSG_VCC_READING, val);
+  }
+
+  if (vccIs3V3)
+  {
+    // val should be close to 1023. Return false if it isn't (i.e. VCC is higher than 3.3V!)
+    // Note: on the one FJ2 I have tested so far, val is: ~900 for 3.3V; and ~700 for 5.0V
+    if (val < 800)
+    {
+      if (_printDebug == true)
+      {
+        debugLog(FJ2_MSG_VCC_HIGH);
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // else: _FJ_VCC must be 5.0V so check diode voltage reads as 3.3V (+/- 10%. _vccWindow is set by the constructor)
+  boolean result = verifyWindow(FJ2_BRAIN_VCC_A0, _vccWindow);
+
+  if (_printDebug == true)
+  {
+    printVerifyDebug(3.3, 0.10, result);
+  }
+
+  if ((!result) && (_printDebug == true))
+  {
+    debugLog(FJ2_MSG_VCC_OUT_OF_BOUNDS);
+  }
+
+  return (result);
+}
+
+//Measure all of the channels in batch in one pass
+//The pins share a single settle window and the ADC conversions are interleaved across the pins
+//The results are stored in batch. Returns true if all of the channels passed
+boolean FlyingJalapeno2::measureBatch(MeasurementBatch &batch)
+{
+  byte pins[FJ2_BATCH_MAX_CHANNELS];
+  FJ2_AdcWindow windows[FJ2_BATCH_MAX_CHANNELS];
+  uint8_t numChannels = batch.size();
+
+  checkVCCCalibration(); // Update the windows if VCC needs measuring
+
+  //Work out the pin, expected voltage, tolerance and ADC window for each channel
+  for (uint8_t i = 0; i < numChannels; i++)
+  {
+    FJ2_BatchChannel *channel = &batch.channels[i];
+    if (channel->type == FJ2_BATCH_V1)
+    {
+      channel->pin = FJ2_PT_READ_V1;
+      channel->expectedVoltage = expectedRailVoltage(1);
+      channel->allowedPercent = 5; // The same as testVoltage
+      windows[i] = _V1Window;
+    }
+    else if (channel->type == FJ2_BATCH_V2)
+    {
+      channel->pin = FJ2_PT_READ_V2;
+      channel->expectedVoltage = expectedRailVoltage(2);
+      channel->allowedPercent = 5; // The same as testVoltage
+      windows[i] = _V2Window;
+    }
+    else if (channel->type == FJ2_BATCH_VCC)
+    {
+      channel->pin = FJ2_BRAIN_VCC_A0;
+      channel->expectedVoltage = 3.3; // The Zener voltage
+      channel->allowedPercent = 10; // The same as testVCC
+      windows[i] = _vccWindow;
+    }
+    else
+      windows[i] = makeAdcWindow(channel->expectedVoltage, channel->allowedPercent);
+    pins[i] = channel->pin;
+    pinMode(channel->pin, INPUT); //Make sure pin is an input
+  }
+
+  waitForSettle(pins, numChannels); //Wait for the voltages to settle before taking the ADC readings
+
+  startAveragedRead(pins, numChannels);
+  while (!isReadComplete())
+    run(); // Wait for the samples to be collected
+
+  boolean allPassed = true;
+
+  for (uint8_t i = 0; i < numChannels; i++)
+  {
+    FJ2_BatchChannel *channel = &batch.channels[i];
+    long count;
+    long total = getAnalogSum(i, &count);
+    channel->rawMean = (count == 0) ? 0 : (int)(total / count);
+    channel->volts = getADCReferenceVoltage() / 1023 * channel->rawMean; //Convert reading to voltage (for the results)
+
+    if ((channel->type == FJ2_BATCH_VCC) && (_FJ_VCC >= 3.29) && (_FJ_VCC <= 3.31))
+    {
+      //When VCC is 3.3V, the Zener reading should be close to full range. See testVCC
+      channel->pass = (channel->rawMean >= 800);
+    }
+    else
+    {
+      channel->pass = FJ2_isSumInWindow(total, count, windows[i]);
+    }
+
+    if (!channel->pass)
+      allPassed = false;
+
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_BATCH_CHANNEL, channel->pin, channel->expectedVoltage, channel->rawMean, channel->volts, channel->pass);
+    }
+  }
+
+  batch.passed = allPassed;
+  return (allPassed);
+}
+
+//Run the steps in sequence in order - recording the result and the time taken for each step
+//In fail-fast mode the sequence stops at the first step which fails. In run-all mode it only stops if a short is detected
+//reset(false) is called before the first step and after the last. Returns true if all of the steps passed
+boolean FlyingJalapeno2::runSequence(TestSequence &sequence)
+{
+  sequence.passed = true;
+  sequence.failedStep = -1;
+  for (uint8_t i = 0; i < sequence.numSteps; i++)
+  {
+    sequence.steps[i].ran = false;
+    sequence.steps[i].pass = false;
+    sequence.steps[i].elapsedMicros = 0;
+    sequence.steps[i].rawMean = -1;
+    sequence.steps[i].volts = 0.0;
+  }
+
+  reset(false); // Turn everything off except the LEDs
+
+  unsigned long sequenceStartMicros = micros();
+
+  for (uint8_t i = 0; i < sequence.numSteps; i++)
+  {
+    FJ2_TestStep *step = &sequence.steps[i];
+
+    _lastAnalogCount = 0; // So getLastAveragedRead returns -1 if the step does not take a reading
+    unsigned long stepStartMicros = micros();
+    step->pass = runStep(step);
+    step->elapsedMicros = micros() - stepStartMicros;
+    step->ran = true;
+    step->rawMean = getLastAveragedRead(); // The reading behind the result (if the step took one)
+    if (step->rawMean >= 0)
+      step->volts = getADCReferenceVoltage() / 1023 * step->rawMean;
+
+    if (_printDebug == true)
+    {
+      debugLog(FJ2_MSG_SEQUENCE_STEP, i, step->pass, step->elapsedMicros);
+    }
+
+    if (!step->pass)
+    {
+      if (sequence.passed)
+        sequence.failedStep = i;
+      sequence.passed = false;
+
+      if ((sequence.policy == FJ2_SEQUENCE_FAIL_FAST) || (step->type == FJ2_STEP_SHORT_V1) || (step->type == FJ2_STEP_SHORT_V2))
+        break;
+    }
+  }
+
+  sequence.elapsedMicros = micros() - sequenceStartMicros;
+
+  reset(false); // Always leave the board under test powered down
+
+  return (sequence.passed);
+}
+
+//PRIVATE: Run one step of a TestSequence. Returns true if it passed
+boolean FlyingJalapeno2::runStep(FJ2_TestStep *step)
+{
+  switch (step->type)
+  {
+    case FJ2_STEP_TEST_VCC:
+      return (testVCC());
+    case FJ2_STEP_SHORT_V1:
+      return (!isV1Shorted(step->parameter));
+    case FJ2_STEP_SHORT_V2:
+      return (!isV2Shorted(step->parameter));
+    case FJ2_STEP_SET_V1:
+      setVoltageV1(step->voltage);
+      return (true);
+    case FJ2_STEP_SET_V2:
+      setVoltageV2(step->voltage);
+      return (true);
+    case FJ2_STEP_ENABLE_V1:
+      enableV1();
+      return (_V1_setting != 0.0); // enableV1 aborts if setVoltageV1 has not been called
+    case FJ2_STEP_ENABLE_V2:
+      enableV2();
+      return (_V2_setting != 0.0);
+    case FJ2_STEP_TEST_VOLTAGE:
+      return (testVoltage(step->pin));
+    case FJ2_STEP_VERIFY_VOLTAGE:
+      return (verifyVoltage(step->pin, step->voltage, step->parameter));
+    case FJ2_STEP_VERIFY_I2C:
+      return (verifyI2Cdevice(step->parameter));
+    case FJ2_STEP_CUSTOM:
+      if (step->function == NULL)
+        return (false);
+      return (step->function(step->context));
+    default:
+      return (false);
+  }
+}
+
+//Enable the I2C buffer by pulling FJ2_I2C_EN high
+void FlyingJalapeno2::enableI2CBuffer()
+{
+  FJ2_Pin<FJ2_I2C_EN>::outputHigh(); // Enable the I2C buffer by pulling FJ2_I2C_EN high
+}
+//Disable the I2C buffer by pulling FJ2_I2C_EN low
+void FlyingJalapeno2::disableI2CBuffer()
+{
+  FJ2_Pin<FJ2_I2C_EN>::outputLow(); // Make sure the I2C buffer is disabled by pulling FJ2_I2C_EN low
+}
+
+//Enable the Serial buffer by pulling FJ2_SERIAL_EN high
+void FlyingJalapeno2::enableSerialBuffer()
+{
+  FJ2_Pin<FJ2_SERIAL_EN>::outputHigh(); // Enable the Serial buffer by pulling FJ2_SERIAL_EN high
+}
+//Disable the Serial buffer by pulling FJ2_SERIAL_EN low
+void FlyingJalapeno2::disableSerialBuffer()
+{
+  FJ2_Pin<FJ2_SERIAL_EN>::outputLow(); // Make sure the Serial buffer is disabled by pulling FJ2_SERIAL_EN low
+}
+
+//Enable the SPI buffer by pulling FJ2_SPI_EN high
+void FlyingJalapeno2::enableSPIBuffer()
+{
+  FJ2_Pin<FJ2_TARGET_CS>::outputHigh(); //Deselect the SPI target
+  FJ2_Pin<FJ2_SPI_EN>::outputHigh(); // Enable the SPI buffer is disabled by pulling FJ2_SPI_EN high
+}
+//Disable the SPI buffer by pulling FJ2_SPI_EN low
+void FlyingJalapeno2::disableSPIBuffer()
+{
+  FJ2_Pin<FJ2_SPI_EN>::outputLow(); // Make sure the SPI buffer is disabled by pulling FJ2_SPI_EN low
+  digitalWrite(FJ2_TARGET_CS, HIGH); //Prepare to deselect the SPI target (once the power is enabled)
+  pinMode(FJ2_TARGET_CS, INPUT);
+}
+
+//Enable the microSD buffer by pulling FJ2_MICROSD_EN high
+void FlyingJalapeno2::enableMicroSDBuffer()
+{
+  FJ2_Pin<FJ2_MICROSD_CS>::outputHigh(); // Deselect the microSD card
+  FJ2_Pin<FJ2_MICROSD_EN>::outputHigh(); // Pull FJ2_MICROSD_EN high
+}
+//Disable the microSD buffer by pulling FJ2_MICROSD_EN low
+void FlyingJalapeno2::disableMicroSDBuffer()
+{
+  FJ2_Pin<FJ2_MICROSD_EN>::outputLow(); // Make sure the microSD buffer is disabled by pulling FJ2_MICROSD_EN low
+  digitalWrite(FJ2_MICROSD_CS, HIGH); // Get ready to deselect the microSD
+  pinMode(FJ2_MICROSD_CS, INPUT);
+}
+
+//Enable the microSD power by pulling FJ2_MICROSD_PWR_EN high
+void FlyingJalapeno2::enableMicroSDPower()
+{
+  FJ2_Pin<FJ2_MICROSD_PWR_EN>::outputHigh(); // Pull FJ2_MICROSD_PWR_EN high
+}
+//Disable the microSD power by pulling FJ2_MICROSD_PWR_EN low
+void FlyingJalapeno2::disableMicroSDPower()
+{
+  FJ2_Pin<FJ2_MICROSD_PWR_EN>::outputLow(); // Make sure the microSD power is disabled by pulling FJ2_MICROSD_PWR_EN low
+}
+//Leave the microSD card powered and its buffer enabled when reset is called (or not)
+void FlyingJalapeno2::keepMicroSDEnabled(boolean keep)
+{
+  _keepMicroSD = keep;
+}
+
+//Verify the address of an I2C device
+//If address is zero, do a full scan
+//Return true if the specified address (or, for a full scan, any address) pings correctly
+//This is a wrapper for scanI2C. The I2C clock is only changed if setI2CScanClock has been called
+boolean FlyingJalapeno2::verifyI2Cdevice(byte address)
+{
+  FJ2_STAT_SCOPE(FJ2_STAT_VERIFY_I2C);
+
+  if (address > 126)
+    return (false);
+  if (_printDebug == true)
+    return (verifyI2CdeviceDebug(address)); // Collect the error codes so they can be printed
+
+  I2CAddressSet found;
+  if (address == 0)
+    return (scanI2C(found, 1, 126) > 0);
+  return (scanI2C(found, address, address) > 0);
+}
+
+//PRIVATE: verifyI2Cdevice with the error codes. This is a separate function so the 128 byte errors array
+//is only on the stack when debugging is enabled
+boolean FlyingJalapeno2::verifyI2CdeviceDebug(byte address)
+{
+  I2CAddressSet found;
+  uint8_t errors[128];
+
+  if (address == 0)
+    return (scanI2C(found, 1, 126, errors) > 0);
+  return (scanI2C(found, address, address, errors) > 0);
+}
+
+//Set the I2C clock used during a scan, and the clock to restore afterwards. Set scanClock to 0 to leave the clock alone (the default)
+void FlyingJalapeno2::setI2CScanClock(uint32_t scanClock, uint32_t normalClock)
+{
+  _i2cScanClock = scanClock;
+  _i2cNormalClock = normalClock;
+}
+
+//Probe firstAddress to lastAddress (inclusive). The addresses which respond are added to found
+//Returns the number of addresses found. errors (optional, 128 entries) receives the Wire.endTransmission result for each address
+uint8_t FlyingJalapeno2::scanI2C(I2CAddressSet &found, byte firstAddress, byte lastAddress, uint8_t *errors)
+{
+  unsigned long startMicros = micros();
+  uint8_t numFound = 0;
+
+  beginI2CScan(errors);
+
+  for (int address = firstAddress; (address <= lastAddress) && (address < 128); address++)
+  {
+    byte error = probeI2C(address);
+    if (errors != NULL)
+      errors[address] = error;
+    if (error == 0)
+    {
+      found.add(address);
+      numFound++;
+    }
+  }
+
+  endI2CScan();
+
+  printI2CScan(found, errors, micros() - startMicros); // Print the results now the timing-critical part is over
+
+  return (numFound);
+}
+
+//Probe a list of addresses. The addresses which respond are added to found
+//Returns the number of addresses found. errors (optional, 128 entries) receives the Wire.endTransmission result for each address
+uint8_t FlyingJalapeno2::scanI2C(I2CAddressSet &found, const byte *addresses, uint8_t numAddresses, uint8_t *errors)
+{
+  unsigned long startMicros = micros();
+  uint8_t numFound = 0;
+
+  beginI2CScan(errors);
+
+  for (uint8_t i = 0; i < numAddresses; i++)
+  {
+    byte address = addresses[i];
+    if (address >= 128)
+      continue;
+    byte error = probeI2C(address);
+    if (errors != NULL)
+      errors[address] = error;
+    if (error == 0)
+    {
+      found.add(address);
+      numFound++;
+    }
+  }
+
+  endI2CScan();
+
+  printI2CScan(found, errors, micros() - startMicros);
+
+  return (numFound);
+}
+
+//Return true if all of the expected devices are present
+//Only the expected addresses are probed, and the probing stops at the first missing device
+boolean FlyingJalapeno2::verifyI2Cdevices(const I2CAddressSet &expected, I2CAddressSet *found)
+{
+  unsigned long startMicros = micros();
+  boolean result = true;
+  I2CAddressSet present;
+
+  beginI2CScan(NULL);
+
+  for (byte address = 0; address < 128; address++)
+  {
+    if (expected.contains(address))
+    {
+      if (probeI2C(address) == 0)
+      {
+        present.add(address);
+      }
+      else
+      {
+        if (_printDebug == true)
+        {
+          debugLog(FJ2_MSG_I2C_MISSING, address);
+        }
+        result = false;
+        break;
+      }
+    }
+  }
+
+  endI2CScan();
+
+  printI2CScan(present, NULL, micros() - startMicros);
+
+  if (found != NULL)
+    *found = present;
+
+  return (result);
+}
+
+//PRIVATE: Raise the I2C clock for a scan. Mark all of the addresses as not probed
+void FlyingJalapeno2::beginI2CScan(uint8_t *errors)
+{
+  if (errors != NULL)
+    memset(errors, FJ2_I2C_NOT_PROBED, 128);
+  if (_i2cScanClock > 0)
+    Wire.setClock(_i2cScanClock);
+}
+
+//PRIVATE: Restore the I2C clock after a scan
+void FlyingJalapeno2::endI2CScan()
+{
+  if (_i2cScanClock > 0)
+    Wire.setClock(_i2cNormalClock);
+}
+
+//PRIVATE: Probe one address. Returns the Wire.endTransmission result: 0 = found; 2 = NACK on address; 4 = other error
+byte FlyingJalapeno2::probeI2C(byte address)
+{
+  Wire.beginTransmission(address);
+  return (Wire.endTransmission());
+}
+
+//PRIVATE: Print the result of a scan - if debugging is enabled
+//The addresses are printed after the scan, so the debug messages do not slow the scan down
+void FlyingJalapeno2::printI2CScan(const I2CAddressSet &found, const uint8_t *errors, unsigned long scanMicros)
+{
+  if (_printDebug == false)
+    return;
+
+  for (byte address = 0; address < 128; address++)
+  {
+    if (found.contains(address))
+    {
+      debugLog(FJ2_MSG_I2C_FOUND, address);
+    }
+    else if ((errors != NULL) && (errors[address] != 0) && (errors[address] != 2) && (errors[address] != FJ2_I2C_NOT_PROBED))
+    {
+      debugLog(FJ2_MSG_I2C_ERROR, errors[address], address);
+    }
+  }
+
+  debugLog(FJ2_MSG_I2C_SUMMARY, found.count(), scanMicros);
+}
+
+// ***** Debug Messages *****
+
+#ifndef FJ2_TOKENIZED_DEBUG
+
+//The text for each debug message, in program memory
+#define FJ2_DEBUG_MESSAGE_TEXT(id, text) static const char id##_text[] PROGMEM = text;
+FJ2_DEBUG_MESSAGES(FJ2_DEBUG_MESSAGE_TEXT)
+#undef FJ2_DEBUG_MESSAGE_TEXT
+
+#define FJ2_DEBUG_MESSAGE_POINTER(id, text) id##_text,
+static const char * const _debugText[FJ2_NUM_DEBUG_MESSAGES] PROGMEM = { FJ2_DEBUG_MESSAGES(FJ2_DEBUG_MESSAGE_POINTER) };
+#undef FJ2_DEBUG_MESSAGE_POINTER
+
+//A Print which writes into a char buffer. Used to turn a debug record into text
+class FJ2_LineWriter : public Print
+{
+  public:
+    FJ2_LineWriter(char *buffer, uint8_t size) { _buffer = buffer; _size = size; _length = 0; }
+    size_t write(uint8_t c)
+    {
+      if (_length >= _size)
+        return (0);
+      _buffer[_length++] = c;
+      return (1);
+    }
+    using Print::write;
+    uint8_t length() { return (_length); }
+  private:
+    char *_buffer;
+    uint8_t _size;
+    uint8_t _length;
+};
+
+#endif
+
+void FlyingJalapeno2::debugLog(FJ2_debug_message_e id)
+{
+  queueDebugRecord(id, NULL, 0);
+}
+void FlyingJalapeno2::debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0)
+{
+  queueDebugRecord(id, &arg0, 1);
+}
+void FlyingJalapeno2::debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1)
+{
+  FJ2_DebugArg args[2] = { arg0, arg1 };
+  queueDebugRecord(id, args, 2);
+}
+void FlyingJalapeno2::debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1, FJ2_DebugArg arg2)
+{
+  FJ2_DebugArg args[3] = { arg0, arg1, arg2 };
+  queueDebugRecord(id, args, 3);
+}
+void FlyingJalapeno2::debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1, FJ2_DebugArg arg2, FJ2_DebugArg arg3)
+{
+  FJ2_DebugArg args[4] = { arg0, arg1, arg2, arg3 };
+  queueDebugRecord(id, args, 4);
+}
+void FlyingJalapeno2::debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1, FJ2_DebugArg arg2, FJ2_DebugArg arg3, FJ2_DebugArg arg4)
+{
+  FJ2_DebugArg args[5] = { arg0, arg1, arg2, arg3, arg4 };
+  queueDebugRecord(id, args, 5);
+}
+
+//PRIVATE: Add a record to the ring: ID, number of arguments, then four bytes per argument
+//If the ring is full, the record is dropped (and counted)
+void FlyingJalapeno2::queueDebugRecord(FJ2_debug_message_e id, const FJ2_DebugArg *args, uint8_t numArgs)
+{
+  if (numArgs > FJ2_DEBUG_MAX_ARGS) numArgs = FJ2_DEBUG_MAX_ARGS;
+  uint16_t length = 2 + (4 * numArgs);
+
+  if ((FJ2_DEBUG_LOG_SIZE - _debugUsed) < length)
+  {
+    _debugDropped++;
+    _debugDroppedTotal++;
+  }
+  else
+  {
+    _debugRing[_debugHead] = id;
+    _debugHead = (_debugHead + 1) % FJ2_DEBUG_LOG_SIZE;
+    _debugRing[_debugHead] = numArgs;
+    _debugHead = (_debugHead + 1) % FJ2_DEBUG_LOG_SIZE;
+    for (uint8_t i = 0; i < numArgs; i++)
+    {
+      const uint8_t *bytes = (const uint8_t *)&args[i]._value;
+      for (uint8_t b = 0; b < 4; b++)
+      {
+        _debugRing[_debugHead] = bytes[b];
+        _debugHead = (_debugHead + 1) % FJ2_DEBUG_LOG_SIZE;
+      }
+    }
+    _debugUsed += length;
+  }
+
+  if (!_bufferedDebug)
+    drainDebug(true); // Print it now
+}
+
+#ifdef FJ2_TOKENIZED_DEBUG
+
+//PRIVATE: Turn a record into a token in _debugLine: the sync byte, the ID, then four bytes per argument. Returns the length
+uint8_t FlyingJalapeno2::formatDebugRecord(uint8_t id, const FJ2_DebugArg *args, uint8_t numArgs)
+{
+  uint8_t length = 0;
+  _debugLine[length++] = FJ2_DEBUG_TOKEN_SYNC;
+  _debugLine[length++] = id;
+  for (uint8_t i = 0; i < numArgs; i++)
+  {
+    const uint8_t *bytes = (const uint8_t *)&args[i]._value;
+    for (uint8_t b = 0; b < 4; b++)
+      _debugLine[length++] = bytes[b]; // AVR is little-endian
+  }
+  return (length);
+}
+
+#else
+
+//PRIVATE: Turn a record into text (with a line ending) in _debugLine. Returns the length
+uint8_t FlyingJalapeno2::formatDebugRecord(uint8_t id, const FJ2_DebugArg *args, uint8_t numArgs)
+{
+  FJ2_LineWriter line(_debugLine, FJ2_DEBUG_LINE_SIZE - 2); // Leave room for the line ending
+  uint8_t argIndex = 0;
+
+  if (id >= FJ2_NUM_DEBUG_MESSAGES)
+    return (0);
+
+  const char *text = (const char *)pgm_read_ptr(&_debugText[id]);
+  char c;
+  while ((c = pgm_read_byte(text++)) != 0)
+  {
+    if ((c != '%') || (argIndex >= numArgs))
+    {
+      line.write(c);
+      continue;
+    }
+
+    uint8_t decimals = 2;
+    c = pgm_read_byte(text++);
+    if (c == '.')
+    {
+      decimals = pgm_read_byte(text++) - '0';
+      c = pgm_read_byte(text++);
+    }
+
+    const FJ2_DebugArg *arg = &args[argIndex++];
+    if (c == 'u')
+      line.print((unsigned long)arg->_value.u);
+    else if (c == 'f')
+      line.print(arg->_value.f, decimals);
+    else if (c == 'x')
+    {
+      if (arg->_value.u < 16) line.print(F("0"));
+      line.print((unsigned long)arg->_value.u, HEX);
+    }
+    else
+      line.print((long)arg->_value.l);
+  }
+
+  uint8_t length = line.length();
+  _debugLine[length++] = '\r';
+  _debugLine[length++] = '\n';
+  return (length);
+}
+
+#endif
+
+//PRIVATE: Print the buffered debug messages
+//If wait is false, only print what the serial port can take without blocking (availableForWrite)
+void FlyingJalapeno2::drainDebug(boolean wait)
+{
+  if (_debugSerial == NULL)
+    return;
+
+  while (true)
+  {
+    //Finish printing the current message
+    if (_debugLinePos < _debugLineLength)
+    {
+      uint8_t remaining = _debugLineLength - _debugLinePos;
+      if (!wait)
+      {
+        int space = _debugSerial->availableForWrite();
+        if (space <= 0)
+          return;
+        if (remaining > space)
+          remaining = space;
+      }
+      _debugSerial->write((const uint8_t *)&_debugLine[_debugLinePos], remaining);
+      _debugLinePos += remaining;
+      if (_debugLinePos < _debugLineLength)
+        return; // Come back later for the rest
+    }
+
+    //Start the next message
+    _debugLinePos = 0;
+    _debugLineLength = 0;
+    if (_debugUsed > 0)
+    {
+      uint8_t id = _debugRing[_debugTail];
+      _debugTail = (_debugTail + 1) % FJ2_DEBUG_LOG_SIZE;
+      uint8_t numArgs = _debugRing[_debugTail];
+      _debugTail = (_debugTail + 1) % FJ2_DEBUG_LOG_SIZE;
+      FJ2_DebugArg args[FJ2_DEBUG_MAX_ARGS] = { 0L, 0L, 0L, 0L, 0L };
+      for (uint8_t i = 0; i < numArgs; i++)
+      {
+        uint8_t *bytes = (uint8_t *)&args[i]._value;
+        for (uint8_t b = 0; b < 4; b++)
+        {
+          bytes[b] = _debugRing[_debugTail];
+          _debugTail = (_debugTail + 1) % FJ2_DEBUG_LOG_SIZE;
+        }
+      }
+      _debugUsed -= 2 + (4 * numArgs);
+      _debugLineLength = formatDebugRecord(id, args, numArgs);
+    }
+    else if (_debugDropped > 0) // Report any dropped records once the ring is empty
+    {
+      FJ2_DebugArg dropped(_debugDropped);
+      _debugDropped = 0;
+      _debugLineLength = formatDebugRecord(FJ2_MSG_DROPPED, &dropped, 1);
+    }
+    else
+      return; // All done
+  }
+}
+
+//Print any buffered debug messages - without waiting for the serial port
+void FlyingJalapeno2::poll()
+{
+  drainDebug(false);
+}
+
+//Print all of the buffered debug messages
+void FlyingJalapeno2::flushDebug()
+{
+  drainDebug(true);
+}
+
+//Returns the number of debug messages dropped because the ring buffer was full
+unsigned long FlyingJalapeno2::getDebugDropped()
+{
+  return (_debugDroppedTotal);
+}
+
+//PRIVATE: delay - running the tasks (e.g. printing any buffered debug messages) while we wait
+//If the tasks have nothing to do, this is a plain delay
+void FlyingJalapeno2::idleDelay(unsigned long ms)
+{
+  boolean busy = _bufferedDebug && ((_debugUsed > 0) || (_debugLinePos < _debugLineLength) || (_debugDropped > 0));
+#ifndef FJ2_LED_USE_ISR
+  if (_ledNumPlaying > 0)
+    busy = true; // The LED patterns need updateLEDs
+#endif
+  for (uint8_t i = FJ2_TASK_BUTTONS; i < FJ2_MAX_TASKS; i++) // The button task and the sketch's tasks
+  {
+    if ((_tasks[i].function != NULL) && (_tasks[i].enabled))
+      busy = true;
+  }
+
+  if (!busy)
+  {
+    delay(ms); // Nothing to do
+    return;
+  }
+
+  runFor(ms);
+}
+
+// ***** The Scheduler *****
+
+static_assert(FJ2_MAX_TASKS <= 32, "run() keeps track of the tasks in a uint32_t");
+static_assert(FJ2_MAX_TASKS >= FJ2_NUM_BUILT_IN_TASKS, "FJ2_MAX_TASKS must include the built-in tasks");
+
+//Add a task. Returns the task number, or -1 if all of the slots are in use
+int FlyingJalapeno2::addTask(FJ2_TaskFunction function, void *context, unsigned long intervalMillis)
+{
+  if (function == NULL)
+    return (-1);
+
+  for (uint8_t i = FJ2_NUM_BUILT_IN_TASKS; i < FJ2_MAX_TASKS; i++)
+  {
+    FJ2_Task *task = &_tasks[i];
+    if (task->function == NULL) // Free slot?
+    {
+      task->function = function;
+      task->context = context;
+      task->intervalMillis = intervalMillis;
+      task->deadlineMillis = millis(); // Due straight away
+      task->resumeLine = 0;
+      task->enabled = true;
+      return (i);
+    }
+  }
+  return (-1);
+}
+
+//Free a task added by addTask
+void FlyingJalapeno2::removeTask(int task)
+{
+  if ((task < FJ2_NUM_BUILT_IN_TASKS) || (task >= FJ2_MAX_TASKS))
+    return;
+  _tasks[task].function = NULL;
+  _tasks[task].enabled = false;
+}
+
+//Enable or disable a task. An enabled task is due straight away
+void FlyingJalapeno2::enableTask(int task, boolean enable)
+{
+  if ((task < 0) || (task >= FJ2_MAX_TASKS) || (_tasks[task].function == NULL))
+    return;
+  if (enable && !_tasks[task].enabled)
+  {
+    _tasks[task].deadlineMillis = millis();
+    if (task == FJ2_TASK_BUTTONS)
+    {
+      buttonTracker.begin(); // Start tracking from scratch
+      _buttonTaskEvent = FJ2_BUTTON_EVENT_NONE;
+    }
+  }
+  _tasks[task].enabled = enable;
+}
+
+//Run the tasks which are due, the most overdue first. Each task runs at most once per call
+void FlyingJalapeno2::run()
+{
+  if (_schedulerRunning)
+    return; // A task has called a blocking function, which has called run. Don't run the tasks inside themselves
+
+  _schedulerRunning = true;
+  unsigned long now = millis(); // One millis for the whole call - the tasks are short
+  uint32_t ran = 0; // bit n is set once task n has run
+
+  while (true)
+  {
+    int next = -1;
+    long mostOverdue = -1; // A task is due if it is overdue by >= 0 millis
+    for (uint8_t i = 0; i < FJ2_MAX_TASKS; i++)
+    {
+      FJ2_Task *task = &_tasks[i];
+      if ((task->function == NULL) || (!task->enabled) || (ran & (1UL << i)))
+        continue;
+      long overdue = (long)(now - task->deadlineMillis);
+      if (overdue > mostOverdue)
       {
-        if (_printDebug == true)
-        {
-          _debugSerial->println(F("... Found!"));
-        }
-        result = true;
+        mostOverdue = overdue;
+        next = i;
       }
-      else if (error == 4)
+    }
+    if (next < 0)
+      break; // Nothing else is due
+
+    FJ2_Task *task = &_tasks[next];
+    ran |= (1UL << next);
+    unsigned long due = task->deadlineMillis;
+    task->function(task);
+    if (task->deadlineMillis == due) // The task did not set its own deadline (FJ2_TASK_SLEEP)
+    {
+      task->deadlineMillis = due + task->intervalMillis;
+      if ((long)(now - task->deadlineMillis) > 0) // Running late. Don't try to catch up
+        task->deadlineMillis = now + task->intervalMillis;
+    }
+  }
+
+  _schedulerRunning = false;
+}
+
+//delay - running the tasks while we wait
+void FlyingJalapeno2::runFor(unsigned long ms)
+{
+  unsigned long startMillis = millis();
+  do
+  {
+    run();
+  } while (millis() - startMillis < ms);
+}
+
+//Returns (and clears) the latest event found by the button task
+FJ2_button_event_e FlyingJalapeno2::getButtonEvent(uint8_t *button)
+{
+  FJ2_button_event_e event = _buttonTaskEvent;
+  if (button != NULL)
+    *button = _buttonTaskButton;
+  _buttonTaskEvent = FJ2_BUTTON_EVENT_NONE;
+  return (event);
+}
+
+//PRIVATE: The built-in tasks. context is the FlyingJalapeno2
+void FlyingJalapeno2::builtInTask(FJ2_Task *task)
+{
+  FlyingJalapeno2 *fj2 = (FlyingJalapeno2 *)task->context;
+
+  switch (task - fj2->_tasks)
+  {
+    case FJ2_TASK_ADC:
+      fj2->isReadComplete(); // Takes the next sample (if the ADC interrupt is not available)
+      break;
+    case FJ2_TASK_LEDS:
+      fj2->updateLEDs();
+      break;
+    case FJ2_TASK_DEBUG:
+      if (fj2->_bufferedDebug)
+        fj2->poll();
+      break;
+    case FJ2_TASK_BUTTONS:
+      if (!fj2->_pollingButtons) // Don't read the buttons again underneath pollButtons (e.g. while waitForButtonPress is running)
       {
-        if (_printDebug == true)
+        FJ2_button_event_e event = fj2->pollButtons();
+        if (event != FJ2_BUTTON_EVENT_NONE)
         {
-          _debugSerial->println(F("... Unknown error!"));
+          fj2->_buttonTaskEvent = event;
+          fj2->_buttonTaskButton = fj2->buttonTracker.getEventButton();
         }
       }
-      else
+      break;
+    default:
+      break;
+  }
+}
+
+// ***** Statistics *****
+
+//Zero all of the statistics
+void FlyingJalapeno2::resetStats()
+{
+#ifdef FJ2_ENABLE_STATS
+  memset(_fj2Stats, 0, sizeof(_fj2Stats));
+#endif
+}
+
+//Print the statistics as a table. The times are in micros
+//Note: the times for powerTest and verifyVoltage include their averagedAnalogRead
+void FlyingJalapeno2::dumpStats(Stream &port)
+{
+#ifdef FJ2_ENABLE_STATS
+  static const char name0[] PROGMEM = "averagedAnalogRead";
+  static const char name1[] PROGMEM = "powerTest";
+  static const char name2[] PROGMEM = "verifyVoltage";
+  static const char name3[] PROGMEM = "capacitiveSensor";
+  static const char name4[] PROGMEM = "verifyI2Cdevice";
+  static const char name5[] PROGMEM = "reset";
+  static const char * const names[FJ2_STAT_NUM_OPS] = { name0, name1, name2, name3, name4, name5 };
+
+  port.print(F("Operation,Count,TotalMicros,MeanMicros,MaxMicros"));
+  uint32_t limit = FJ2_STAT_FIRST_BUCKET_MICROS;
+  for (uint8_t bucket = 0; bucket < (FJ2_STAT_NUM_BUCKETS - 1); bucket++)
+  {
+    port.print(F(",<"));
+    port.print(limit);
+    limit <<= 2;
+  }
+  port.println(F(",More"));
+
+  for (uint8_t op = 0; op < FJ2_STAT_NUM_OPS; op++)
+  {
+    FJ2_OpStats *stats = &_fj2Stats[op];
+    port.print((const __FlashStringHelper *)names[op]);
+    port.print(F(","));
+    port.print(stats->count);
+    port.print(F(","));
+    port.print(stats->totalMicros);
+    port.print(F(","));
+    port.print(stats->count > 0 ? stats->totalMicros / stats->count : 0);
+    port.print(F(","));
+    port.print(stats->maxMicros);
+    for (uint8_t bucket = 0; bucket < FJ2_STAT_NUM_BUCKETS; bucket++)
+    {
+      port.print(F(","));
+      port.print(stats->buckets[bucket]);
+    }
+    port.println();
+  }
+#else
+  port.println(F("FlyingJalapeno2::dumpStats: the statistics are disabled. Uncomment #define FJ2_ENABLE_STATS in SparkFun_Flying_Jalapeno_2_Arduino_Library.h"));
+#endif
+}
+
+//Return the statistics for one operation. NULL if op is invalid or the statistics are disabled
+const FJ2_OpStats *FlyingJalapeno2::getStats(FJ2_stat_op_e op)
+{
+#ifdef FJ2_ENABLE_STATS
+  if (op < FJ2_STAT_NUM_OPS)
+    return (&_fj2Stats[op]);
+#else
+  (void)op;
+#endif
+  return (NULL);
+}
+
+//Copy a compact binary snapshot of the statistics into buffer. See FJ2_STATS_SNAPSHOT_SIZE for the format
+//Returns the number of bytes written, or 0 if buffer is too small or the statistics are disabled
+size_t FlyingJalapeno2::getStatsSnapshot(uint8_t *buffer, size_t bufferSize)
+{
+#ifdef FJ2_ENABLE_STATS
+  if ((buffer == NULL) || (bufferSize < FJ2_STATS_SNAPSHOT_SIZE))
+    return (0);
+
+  size_t index = 0;
+  buffer[index++] = FJ2_STATS_SNAPSHOT_VERSION;
+  buffer[index++] = FJ2_STAT_NUM_OPS;
+  buffer[index++] = FJ2_STAT_NUM_BUCKETS;
+
+  for (uint8_t op = 0; op < FJ2_STAT_NUM_OPS; op++)
+  {
+    FJ2_OpStats *stats = &_fj2Stats[op];
+    uint32_t values[3] = { stats->count, stats->totalMicros, stats->maxMicros };
+    for (uint8_t v = 0; v < 3; v++)
+    {
+      for (uint8_t b = 0; b < 4; b++)
+        buffer[index++] = (uint8_t)(values[v] >> (8 * b));
+    }
+    for (uint8_t bucket = 0; bucket < FJ2_STAT_NUM_BUCKETS; bucket++)
+    {
+      buffer[index++] = (uint8_t)(stats->buckets[bucket] & 0xFF);
+      buffer[index++] = (uint8_t)(stats->buckets[bucket] >> 8);
+    }
+  }
+
+  return (index);
+#else
+  (void)buffer;
+  (void)bufferSize;
+  return (0);
+#endif
+}
+
+// ***** The Measurement Batch *****
+
+MeasurementBatch::MeasurementBatch()
+{
+  clear();
+}
+
+//Remove all of the channels from the batch
+void MeasurementBatch::clear()
+{
+  numChannels = 0;
+  passed = false;
+}
+
+//PRIVATE: Add a channel to the batch. Returns false if the batch is full
+boolean MeasurementBatch::add(FJ2_batch_channel_e type, byte pin, float expectedVoltage, int allowedPercent)
+{
+  if (numChannels >= FJ2_BATCH_MAX_CHANNELS)
+    return (false);
+
+  FJ2_BatchChannel *channel = &channels[numChannels++];
+  channel->type = type;
+  channel->pin = pin;
+  channel->expectedVoltage = expectedVoltage;
+  channel->allowedPercent = allowedPercent;
+  channel->rawMean = 0;
+  channel->volts = 0.0;
+  channel->pass = false;
+  return (true);
+}
+
+//Add a custom pin. The pass / fail test is the same as verifyVoltage
+boolean MeasurementBatch::addPin(byte pin, float expectedVoltage, int allowedPercent)
+{
+  return (add(FJ2_BATCH_PIN, pin, expectedVoltage, allowedPercent));
+}
+
+//Add V1. The expected voltage is set by measureBatch - the same as testVoltage(1)
+boolean MeasurementBatch::addV1()
+{
+  return (add(FJ2_BATCH_V1, FJ2_PT_READ_V1, 0.0, 5));
+}
+
+//Add V2. The expected voltage is set by measureBatch - the same as testVoltage(2)
+boolean MeasurementBatch::addV2()
+{
+  return (add(FJ2_BATCH_V2, FJ2_PT_READ_V2, 0.0, 5));
+}
+
+//Add the 3.3V Zener on FJ2_BRAIN_VCC_A0. The pass / fail test is the same as testVCC
+boolean MeasurementBatch::addVCC()
+{
+  return (add(FJ2_BATCH_VCC, FJ2_BRAIN_VCC_A0, 3.3, 10));
+}
+
+//Return the number of channels in the batch
+uint8_t MeasurementBatch::size()
+{
+  return (numChannels);
+}
+
+//Return the results for channel index (in the order the channels were added)
+FJ2_BatchChannel *MeasurementBatch::result(uint8_t index)
+{
+  if (index >= numChannels)
+    return (NULL);
+  return (&channels[index]);
+}
+
+//Return true if all of the channels passed (when the batch was last measured)
+boolean MeasurementBatch::allPassed()
+{
+  return (passed);
+}
+
+// ***** The Test Sequence *****
+
+//The names printed by printResults for steps which were not given a name
+static const char _stepTestVCCName[] PROGMEM = "testVCC";
+static const char _stepShortV1Name[] PROGMEM = "isV1Shorted";
+static const char _stepShortV2Name[] PROGMEM = "isV2Shorted";
+static const char _stepSetV1Name[] PROGMEM = "setVoltageV1";
+static const char _stepSetV2Name[] PROGMEM = "setVoltageV2";
+static const char _stepEnableV1Name[] PROGMEM = "enableV1";
+static const char _stepEnableV2Name[] PROGMEM = "enableV2";
+static const char _stepTestVoltageName[] PROGMEM = "testVoltage";
+static const char _stepVerifyVoltageName[] PROGMEM = "verifyVoltage";
+static const char _stepVerifyI2CName[] PROGMEM = "verifyI2Cdevice";
+static const char _stepCustomName[] PROGMEM = "custom";
+static const char * const _stepNames[FJ2_NUM_STEP_TYPES] PROGMEM = {
+  _stepTestVCCName, _stepShortV1Name, _stepShortV2Name, _stepSetV1Name, _stepSetV2Name, _stepEnableV1Name,
+  _stepEnableV2Name, _stepTestVoltageName, _stepVerifyVoltageName, _stepVerifyI2CName, _stepCustomName
+};
+
+TestSequence::TestSequence(FJ2_sequence_policy_e policy)
+{
+  setPolicy(policy);
+  clear();
+}
+
+//Remove all of the steps from the sequence
+void TestSequence::clear()
+{
+  numSteps = 0;
+  passed = false;
+  failedStep = -1;
+  elapsedMicros = 0;
+}
+
+//Fail-fast: stop at the first step which fails. Run-all: keep going (unless a short is detected)
+void TestSequence::setPolicy(FJ2_sequence_policy_e policy)
+{
+  this->policy = policy;
+}
+
+//PRIVATE: Add a step to the sequence. Returns NULL if the sequence is full
+FJ2_TestStep *TestSequence::add(FJ2_step_type_e type, const __FlashStringHelper *name)
+{
+  if (numSteps >= FJ2_SEQUENCE_MAX_STEPS)
+    return (NULL);
+
+  FJ2_TestStep *step = &steps[numSteps++];
+  step->type = type;
+  step->name = name;
+  step->pin = 0;
+  step->voltage = 0.0;
+  step->parameter = 0;
+  step->function = NULL;
+  step->context = NULL;
+  step->ran = false;
+  step->pass = false;
+  step->elapsedMicros = 0;
+  step->rawMean = -1;
+  step->volts = 0.0;
+  return (step);
+}
+
+//Check the FJ2 VCC (like testVCC)
+boolean TestSequence::addTestVCC(const __FlashStringHelper *name)
+{
+  return (add(FJ2_STEP_TEST_VCC, name) != NULL);
+}
+
+//Check V1 for a short (like isV1Shorted). The step passes if there is no short
+boolean TestSequence::addShortTestV1(int shortThreshold, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_SHORT_V1, name);
+  if (step == NULL)
+    return (false);
+  step->parameter = shortThreshold;
+  return (true);
+}
+
+//Check V2 for a short (like isV2Shorted). The step passes if there is no short
+boolean TestSequence::addShortTestV2(int shortThreshold, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_SHORT_V2, name);
+  if (step == NULL)
+    return (false);
+  step->parameter = shortThreshold;
+  return (true);
+}
+
+//Set the V1 voltage (like setVoltageV1)
+boolean TestSequence::addSetVoltageV1(float voltage, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_SET_V1, name);
+  if (step == NULL)
+    return (false);
+  step->voltage = voltage;
+  return (true);
+}
+
+//Set the V2 voltage (like setVoltageV2)
+boolean TestSequence::addSetVoltageV2(float voltage, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_SET_V2, name);
+  if (step == NULL)
+    return (false);
+  step->voltage = voltage;
+  return (true);
+}
+
+//Enable V1 (like enableV1). The step fails if the V1 voltage has not been set
+boolean TestSequence::addEnableV1(const __FlashStringHelper *name)
+{
+  return (add(FJ2_STEP_ENABLE_V1, name) != NULL);
+}
+
+//Enable V2 (like enableV2). The step fails if the V2 voltage has not been set
+boolean TestSequence::addEnableV2(const __FlashStringHelper *name)
+{
+  return (add(FJ2_STEP_ENABLE_V2, name) != NULL);
+}
+
+//Test V1 or V2 (like testVoltage)
+boolean TestSequence::addTestVoltage(byte select, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_TEST_VOLTAGE, name);
+  if (step == NULL)
+    return (false);
+  step->pin = select;
+  return (true);
+}
+
+//Test a custom pin (like verifyVoltage)
+boolean TestSequence::addVerifyVoltage(byte pin, float expectedVoltage, int allowedPercent, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_VERIFY_VOLTAGE, name);
+  if (step == NULL)
+    return (false);
+  step->pin = pin;
+  step->voltage = expectedVoltage;
+  step->parameter = allowedPercent;
+  return (true);
+}
+
+//Check for an I2C device (like verifyI2Cdevice). If address is zero, any device will do
+//The I2C buffer must be enabled and Wire.begin called first (e.g. by a custom step)
+boolean TestSequence::addVerifyI2Cdevice(byte address, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_VERIFY_I2C, name);
+  if (step == NULL)
+    return (false);
+  step->parameter = address;
+  return (true);
+}
+
+//Call a function provided by the sketch. The function returns true if the step passed
+boolean TestSequence::addCustom(FJ2_StepFunction function, void *context, const __FlashStringHelper *name)
+{
+  FJ2_TestStep *step = add(FJ2_STEP_CUSTOM, name);
+  if (step == NULL)
+    return (false);
+  step->function = function;
+  step->context = context;
+  return (true);
+}
+
+//Return the number of steps in the sequence
+uint8_t TestSequence::size()
+{
+  return (numSteps);
+}
+
+//Return the results for step index (in the order the steps were added)
+FJ2_TestStep *TestSequence::result(uint8_t index)
+{
+  if (index >= numSteps)
+    return (NULL);
+  return (&steps[index]);
+}
+
+//Return true if all of the steps passed (when the sequence was last run)
+boolean TestSequence::allPassed()
+{
+  return (passed);
+}
+
+//Return the index of the first step which failed (when the sequence was last run). -1 if none failed
+int TestSequence::getFailedStep()
+{
+  return (failedStep);
+}
+
+//Return how long the sequence took to run (micros). This includes the time between the steps
+unsigned long TestSequence::getElapsedMicros()
+{
+  return (elapsedMicros);
+}
+
+//Print the result and time of each step. E.g.:
+//  Step 1: testVCC: pass (54321us)
+void TestSequence::printResults(Print &port)
+{
+  for (uint8_t i = 0; i < numSteps; i++)
+  {
+    FJ2_TestStep *step = &steps[i];
+    port.print(F("Step "));
+    port.print(i + 1);
+    port.print(F(": "));
+    if (step->name != NULL)
+      port.print(step->name);
+    else if (step->type < FJ2_NUM_STEP_TYPES)
+      port.print((const __FlashStringHelper *)pgm_read_ptr(&_stepNames[step->type]));
+    port.print(F(": "));
+    if (!step->ran)
+    {
+      port.println(F("not run"));
+      continue;
+    }
+    port.print(step->pass ? F("pass (") : F("FAIL ("));
+    port.print(step->elapsedMicros);
+    port.println(F("us)"));
+  }
+  port.print(passed ? F("Sequence: pass (") : F("Sequence: FAIL ("));
+  port.print(elapsedMicros);
+  port.println(F("us)"));
+}
+
+// ***** The Button Tracker *****
+
+ButtonTracker::ButtonTracker()
+{
+  setTiming();
+  begin();
+}
+
+//Set the timing rules. These are the same as the waitForButton functions
+//holdEventMillis is measured from the start of the press
+void ButtonTracker::setTiming(unsigned long minimumHoldMillis, unsigned long minimumReleaseMillis, unsigned long holdEventMillis, unsigned long minimumPreReleaseMillis)
+{
+  _minimumHoldMillis = minimumHoldMillis;
+  _minimumReleaseMillis = minimumReleaseMillis;
+  _holdEventMillis = holdEventMillis;
+  _minimumPreReleaseMillis = minimumPreReleaseMillis;
+}
+
+//(Re)start tracking
+//If requireRelease is true, neither button must be pressed for minimumPreReleaseMillis before a press is accepted
+void ButtonTracker::begin(boolean requireRelease)
+{
+  _state = requireRelease ? FJ2_BUTTON_STATE_WAIT_RELEASE : FJ2_BUTTON_STATE_IDLE;
+  _button = 0;
+  _releaseMillis = 0; // Zero indicates there is no release in progress (FJ2_BUTTON_STATE_WAIT_RELEASE)
+}
+
+//Returns the button (1 or 2) for the latest event
+uint8_t ButtonTracker::getEventButton()
+{
+  return (_button);
+}
+
+//Returns which buttons update needs. bit 0 is button 1; bit 1 is button 2
+uint8_t ButtonTracker::watchedButtons()
+{
+  if ((_state == FJ2_BUTTON_STATE_WAIT_RELEASE) || (_state == FJ2_BUTTON_STATE_IDLE))
+    return (0x03);
+  return (_button == 1 ? 0x01 : 0x02);
+}
+
+//Returns true if begin(true) was called and the buttons have not yet been released for long enough
+boolean ButtonTracker::isWaitingForRelease()
+{
+  return (_state == FJ2_BUTTON_STATE_WAIT_RELEASE);
+}
+
+//Advance the state machine. pressedButtons: bit 0 is button 1; bit 1 is button 2
+//Returns the event (if any)
+FJ2_button_event_e ButtonTracker::update(unsigned long nowMillis, uint8_t pressedButtons)
+{
+  boolean buttonPressed = (_button == 1) ? ((pressedButtons & 0x01) != 0) : ((pressedButtons & 0x02) != 0);
+
+  switch (_state)
+  {
+    case FJ2_BUTTON_STATE_WAIT_RELEASE:
+      if ((pressedButtons & 0x03) != 0) // Is either being pressed?
       {
-        if (_printDebug == true)
-        {
-          _debugSerial->println();
-        }
+        _releaseMillis = 0; // At least one button is being pressed
       }
-    }
+      else if (_releaseMillis == 0) // Check if this is a fresh release
+      {
+        _releaseMillis = nowMillis; // Record the time of the release
+      }
+      else if (nowMillis > (_releaseMillis + _minimumPreReleaseMillis))
+      {
+        _state = FJ2_BUTTON_STATE_IDLE; // Buttons have been released for long enough
+      }
+      break;
+
+    case FJ2_BUTTON_STATE_IDLE:
+      if (pressedButtons & 0x01) // Check if button 1 is pressed. 1 takes priority over 2
+      {
+        _button = 1;
+        _pressMillis = nowMillis; // Record the time of the latest button press
+        _state = FJ2_BUTTON_STATE_DEBOUNCE;
+      }
+      else if (pressedButtons & 0x02) // Check if button 2 is pressed
+      {
+        _button = 2;
+        _pressMillis = nowMillis; // Record the time of the latest button press
+        _state = FJ2_BUTTON_STATE_DEBOUNCE;
+      }
+      break;
+
+    case FJ2_BUTTON_STATE_DEBOUNCE:
+      if (!buttonPressed)
+      {
+        _state = FJ2_BUTTON_STATE_IDLE; // The button has been released. Go back to looking for a fresh press
+      }
+      else if (nowMillis > (_pressMillis + _minimumHoldMillis)) // Has the button been held for minimumHoldMillis?
+      {
+        _state = FJ2_BUTTON_STATE_PRESSED;
+        _holdReported = false;
+        return (FJ2_BUTTON_EVENT_PRESS);
+      }
+      break;
+
+    case FJ2_BUTTON_STATE_PRESSED:
+      if (!buttonPressed)
+      {
+        _releaseMillis = nowMillis; // Record the time of the release
+        _state = FJ2_BUTTON_STATE_RELEASING;
+        return (FJ2_BUTTON_EVENT_RELEASE);
+      }
+      else if ((!_holdReported) && (nowMillis > (_pressMillis + _holdEventMillis)))
+      {
+        _holdReported = true;
+        return (FJ2_BUTTON_EVENT_HOLD);
+      }
+      break;
+
+    case FJ2_BUTTON_STATE_RELEASING:
+      if (buttonPressed)
+      {
+        _state = FJ2_BUTTON_STATE_PRESSED; // Button is being pressed again
+      }
+      else if (nowMillis > (_releaseMillis + _minimumReleaseMillis)) // Has the button been released for long enough?
+      {
+        _state = FJ2_BUTTON_STATE_IDLE;
+        return (FJ2_BUTTON_EVENT_PRESS_RELEASE);
+      }
+      break;
   }
 
-  return (result);
+  return (FJ2_BUTTON_EVENT_NONE);
+}
+
+// ***** The I2C Address Set *****
+
+I2CAddressSet::I2CAddressSet()
+{
+  clear();
+}
+
+//Remove all of the addresses from the set
+void I2CAddressSet::clear()
+{
+  memset(bitmap, 0, sizeof(bitmap));
+}
+
+//Add an address to the set. Addresses above 127 are ignored
+void I2CAddressSet::add(byte address)
+{
+  if (address < 128)
+    bitmap[address >> 3] |= (1 << (address & 7));
+}
+
+//Remove an address from the set
+void I2CAddressSet::remove(byte address)
+{
+  if (address < 128)
+    bitmap[address >> 3] &= ~(1 << (address & 7));
 }
 
+//Return true if the address is in the set
+boolean I2CAddressSet::contains(byte address) const
+{
+  if (address >= 128)
+    return (false);
+  return ((bitmap[address >> 3] & (1 << (address & 7))) != 0);
+}
+
+//Return the number of addresses in the set
+uint8_t I2CAddressSet::count() const
+{
+  uint8_t total = 0;
+  for (uint8_t i = 0; i < sizeof(bitmap); i++)
+  {
+    for (uint8_t bits = bitmap[i]; bits != 0; bits &= (bits - 1)) // Clear the lowest set bit each time
+      total++;
+  }
+  return (total);
+}
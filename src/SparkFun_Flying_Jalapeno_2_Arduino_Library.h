@@ -10,7 +10,19 @@
 
 #include <Wire.h>
 
+//Uncomment the next line if the FJ2 has AT42QT1011 buttons (or no buttons) instead of the cap sense buttons.
+//The CapacitiveSensor library is not needed, and the cap sense code and data are compiled out: the buttons are always read
+//as AT42QT1011 outputs and the useCapSense constructor parameter is ignored. FJ2button1 / FJ2button2 do not exist
+//
+//RAM: the CapacitiveSensor objects are stored inside the FlyingJalapeno2 object - nothing is allocated on the heap.
+//With cap sense, the object includes 2 * sizeof(CapacitiveSensor) for the sensors (used or not) plus 30 bytes (on AVR)
+//for the button pointers, the incremental filters and their settings. FJ2_NO_CAP_SENSE removes all of these.
+//Example11_Benchmark prints sizeof(FlyingJalapeno2) for the chosen configuration
+//#define FJ2_NO_CAP_SENSE
+
+#ifndef FJ2_NO_CAP_SENSE
 #include <CapacitiveSensor.h> //Click here to get the library: http://librarymanager/All#CapacitiveSensor_Arduino
+#endif
 
 // ***** FJ2 Pin Definitions *****
 
@@ -70,6 +82,556 @@
 #define FJ2_SCK 52
 #define FJ2_TARGET_CS 53
 
+// ***** FJ2 ADC Engine *****
+
+//The averaging ADC engine keeps the most recent samples in a ring buffer
+//On AVR the conversions are interrupt-driven (ADC_vect). On other platforms isReadComplete takes one sample per call
+#define FJ2_ADC_RING_SIZE 32
+
+//The maximum number of pins which can be read (interleaved) in one pass
+#define FJ2_ADC_MAX_CHANNELS 10
+
+//The early exit (setEarlyExit) keeps a sum of the squared samples. Reads of more samples than this always take every sample
+#define FJ2_EARLY_EXIT_MAX_SAMPLES 4096
+
+//The averaged read filters (setAnalogFilter)
+typedef enum {
+  FJ2_FILTER_MEAN = 0, // The mean of all the samples (the default)
+  FJ2_FILTER_OVERSAMPLE, // Oversample and decimate: take 4^bits samples for bits extra bits of resolution (getLastOversampledRead)
+  FJ2_FILTER_TRIMMED_MEAN, // Sort the samples and discard the trim highest and trim lowest before taking the mean
+  FJ2_FILTER_MEDIAN // The median of the samples
+} FJ2_adc_filter_e;
+
+//The trimmed mean and median sort the samples in a FJ2_ADC_RING_SIZE buffer on the stack, so they take at most FJ2_ADC_RING_SIZE samples
+#define FJ2_OVERSAMPLE_MAX_BITS 4 // 256 samples
+
+//How VCC (the ADC reference) is found (setVCCCalibration)
+typedef enum {
+  FJ2_VCC_NOMINAL = 0, // Use the FJ_VCC passed to the constructor (the default)
+  FJ2_VCC_FROM_ZENER, // Measure the 3.3V Zener on FJ2_BRAIN_VCC_A0. VCC must be 5V
+  FJ2_VCC_FROM_BANDGAP // Measure the ATmega2560 1.1V bandgap (AVR only)
+} FJ2_vcc_source_e;
+
+#define FJ2_VCC_CALIBRATION_LIMIT 10 // The measured VCC is ignored if it is more than this many percent from the nominal VCC
+
+// ***** FJ2 ADC Windows *****
+
+//An ADC-count window. A reading passes if lo <= reading <= hi. (If lo > hi, nothing passes)
+//Testing counts instead of volts means no float maths is needed while the test is running
+typedef struct {
+  uint16_t lo;
+  uint16_t hi;
+} FJ2_AdcWindow;
+
+#define FJ2_RAIL_FIDDLE_FACTOR 1.03 // The FJ2_PT_READ_V1/V2 readings are ~3% higher than the 10k/11k divider predicts (from FJ2 testing)
+
+//These are constexpr, so a window made from constant values is calculated by the compiler. E.g.:
+//  const FJ2_AdcWindow interruptPinWindow = FJ2_adcWindow(1.65, 10, 3.3); // 1.65V +/- 10% with a 3.3V FJ2 VCC
+constexpr long FJ2_countsFloor(float counts) { return ((counts <= 0.0) ? 0 : ((counts >= 1023.0) ? 1023 : (long)counts)); }
+constexpr long FJ2_countsCeil(float counts) { return ((counts <= 0.0) ? 0 : ((counts > 1023.0) ? 1024 : ((long)counts + ((counts > (float)(long)counts) ? 1 : 0)))); }
+
+//The window for expectedVoltage +/- allowedPercent when the FJ2 VCC (the ADC reference) is vcc
+constexpr FJ2_AdcWindow FJ2_adcWindow(float expectedVoltage, int allowedPercent, float vcc)
+{
+  return (FJ2_AdcWindow{ (uint16_t)FJ2_countsCeil(expectedVoltage * (100 - allowedPercent) / 100.0 * 1023.0 / vcc),
+                         (uint16_t)FJ2_countsFloor(expectedVoltage * (100 + allowedPercent) / 100.0 * 1023.0 / vcc) });
+}
+
+//The window testVoltage uses for V1/V2 when the regulator is set to railVoltage (the divider, the fiddle factor and 5%)
+constexpr FJ2_AdcWindow FJ2_railWindow(float railVoltage, float vcc)
+{
+  return (FJ2_adcWindow(railVoltage * 10.0 / 11.0 * FJ2_RAIL_FIDDLE_FACTOR, 5, vcc));
+}
+
+//Returns true if the mean of count samples (total / count, rounded down - like averagedAnalogRead) is inside window
+//There is no division: lo * count <= total < (hi + 1) * count
+inline boolean FJ2_isSumInWindow(long total, long count, FJ2_AdcWindow window)
+{
+  return ((total >= ((long)window.lo * count)) && (total < (((long)window.hi + 1) * count)));
+}
+
+
+// ***** FJ2 Short Test *****
+
+//The results of areV1V2Shorted
+typedef struct {
+  boolean v1Shorted; // True if V1 is shorted
+  boolean v2Shorted; // True if V2 is shorted
+  int v1Reading; // The averaged FJ2_PT_READ_V1 reading
+  int v2Reading; // The averaged FJ2_PT_READ_V2 reading
+} FJ2_ShortTestResult;
+
+
+// ***** FJ2 Ramp Capture *****
+
+#define FJ2_RAMP_MAX_SAMPLES 64 // The size of the ramp buffer
+#define FJ2_RAMP_FINAL_SAMPLES 8 // The final reading is the mean of this many samples (at the end of the ramp)
+
+//The ramp captured by enableV1WithCapture / enableV2WithCapture
+typedef struct {
+  uint16_t samples[FJ2_RAMP_MAX_SAMPLES]; // The FJ2_PT_READ_V1/V2 readings, from when the rail was enabled
+  uint8_t numSamples; // The number of samples in the buffer
+  unsigned long captureMicros; // How long the capture took
+  unsigned long riseMicros; // The time the reading took to rise from 10% to 90% of the final reading. 0 if it did not rise
+  int finalReading; // The mean of the last FJ2_RAMP_FINAL_SAMPLES samples
+  uint16_t finalMin; // The lowest of the last FJ2_RAMP_FINAL_SAMPLES samples
+  uint16_t finalMax; // The highest of the last FJ2_RAMP_FINAL_SAMPLES samples
+  boolean cutOff; // True if the rail did not rise and was disabled
+  boolean pass; // True if the rail rose and - after the normal settle - the averaged reading is inside the testVoltage window
+} FJ2_RampCapture;
+
+
+// ***** FJ2 V2 Sweep *****
+
+//The result of each step of sweepV2
+typedef struct {
+  float setting; // The V2 setting (3.3, 3.7, 4.2 or 5.0V)
+  int rawMean; // The averaged FJ2_PT_READ_V2 reading
+  float volts; // The V2 voltage (from the reading)
+  unsigned long settleMillis; // How long the rail took to settle after the switch
+  boolean settleTimedOut; // True if the rail did not settle within maxSettleMillis (setSettleMode)
+  boolean pass; // True if the reading is inside the testVoltage window
+  boolean ran; // False if the setting is not valid (not 3.3, 3.7, 4.2 or 5.0V). The setting was not applied or measured
+} FJ2_SweepResult;
+
+
+// ***** FJ2 Measurement Batch *****
+
+//The maximum number of channels in a MeasurementBatch
+#define FJ2_BATCH_MAX_CHANNELS FJ2_ADC_MAX_CHANNELS
+
+typedef enum {
+  FJ2_BATCH_PIN = 0, // A custom pin with its own expected voltage and tolerance (like verifyVoltage)
+  FJ2_BATCH_V1, // FJ2_PT_READ_V1 (like testVoltage(1))
+  FJ2_BATCH_V2, // FJ2_PT_READ_V2 (like testVoltage(2))
+  FJ2_BATCH_VCC // The 3.3V Zener on FJ2_BRAIN_VCC_A0 (like testVCC)
+} FJ2_batch_channel_e;
+
+typedef struct {
+  FJ2_batch_channel_e type;
+  byte pin; // The pin to test
+  float expectedVoltage; // The voltage we expect. 0.0 to 5.0
+  int allowedPercent; // The allowed window. 0 to 100
+  // The results - these are set by FlyingJalapeno2::measureBatch
+  int rawMean; // The averaged ADC reading
+  float volts; // The reading converted to volts
+  boolean pass; // True if the voltage is within the window
+} FJ2_BatchChannel;
+
+//A list of pins (and their expected voltages) to be measured together by FlyingJalapeno2::measureBatch
+class MeasurementBatch
+{
+  public:
+
+    MeasurementBatch();
+
+    void clear(); //Remove all of the channels from the batch
+
+    //Add a channel to the batch. These return false if the batch is full
+    boolean addPin(byte pin, float expectedVoltage, int allowedPercent = 10); //Test a custom pin (like verifyVoltage)
+    boolean addV1(); //Test V1 (like testVoltage(1))
+    boolean addV2(); //Test V2 (like testVoltage(2))
+    boolean addVCC(); //Test the FJ2 VCC (like testVCC)
+
+    uint8_t size(); //Return the number of channels in the batch
+    FJ2_BatchChannel *result(uint8_t index); //Return the results for a channel (in the order they were added). NULL if index is invalid
+    boolean allPassed(); //Return true if all of the channels passed
+
+    FJ2_BatchChannel channels[FJ2_BATCH_MAX_CHANNELS];
+    uint8_t numChannels;
+    boolean passed;
+
+  private:
+
+    boolean add(FJ2_batch_channel_e type, byte pin, float expectedVoltage, int allowedPercent);
+};
+
+// ***** FJ2 I2C Scan *****
+
+#define FJ2_I2C_SCAN_CLOCK 400000 // The I2C clock setI2CScanClock uses during a scan by default (Hz)
+#define FJ2_I2C_NORMAL_CLOCK 100000 // The default I2C clock the scan restores (Hz). This is the Wire library default
+#define FJ2_I2C_NOT_PROBED 0xFF // The error code for an address which was not probed
+
+//A set of 7-bit I2C addresses, stored as a 128-bit bitmap
+class I2CAddressSet
+{
+  public:
+
+    I2CAddressSet();
+
+    void clear(); //Remove all of the addresses from the set
+    void add(byte address); //Add an address to the set. Addresses above 127 are ignored
+    void remove(byte address); //Remove an address from the set
+    boolean contains(byte address) const; //Return true if the address is in the set
+    uint8_t count() const; //Return the number of addresses in the set
+
+    uint8_t bitmap[16]; // Bit (address & 7) of bitmap[address >> 3] is set if address is in the set
+};
+
+// ***** FJ2 Test Sequence *****
+
+//The maximum number of steps in a TestSequence
+#define FJ2_SEQUENCE_MAX_STEPS 16
+
+typedef enum {
+  FJ2_STEP_TEST_VCC = 0, // testVCC
+  FJ2_STEP_SHORT_V1, // isV1Shorted. Passes if there is no short
+  FJ2_STEP_SHORT_V2, // isV2Shorted. Passes if there is no short
+  FJ2_STEP_SET_V1, // setVoltageV1
+  FJ2_STEP_SET_V2, // setVoltageV2
+  FJ2_STEP_ENABLE_V1, // enableV1. Fails if setVoltageV1 has not been called
+  FJ2_STEP_ENABLE_V2, // enableV2. Fails if setVoltageV2 has not been called
+  FJ2_STEP_TEST_VOLTAGE, // testVoltage(1 or 2)
+  FJ2_STEP_VERIFY_VOLTAGE, // verifyVoltage
+  FJ2_STEP_VERIFY_I2C, // verifyI2Cdevice
+  FJ2_STEP_CUSTOM, // A function provided by the sketch
+  FJ2_NUM_STEP_TYPES
+} FJ2_step_type_e;
+
+typedef enum {
+  FJ2_SEQUENCE_FAIL_FAST = 0, // Stop at the first step which fails
+  FJ2_SEQUENCE_RUN_ALL // Run all of the steps - except after a short (it is not safe to power a shorted board)
+} FJ2_sequence_policy_e;
+
+//A custom step. Return true if the step passed. context is the pointer passed to TestSequence::addCustom
+typedef boolean (*FJ2_StepFunction)(void *context);
+
+typedef struct {
+  FJ2_step_type_e type;
+  const __FlashStringHelper *name; // The name printed by printResults. If NULL, the name of the library function is printed
+  byte pin; // The pin for FJ2_STEP_VERIFY_VOLTAGE. The select (1 or 2) for FJ2_STEP_TEST_VOLTAGE
+  float voltage; // The voltage for FJ2_STEP_SET_V1/V2 and FJ2_STEP_VERIFY_VOLTAGE
+  int parameter; // The shortThreshold, allowedPercent or I2C address
+  FJ2_StepFunction function; // The function for FJ2_STEP_CUSTOM
+  void *context; // Passed to function
+  // The results - these are set by FlyingJalapeno2::runSequence
+  boolean ran; // True if the step was run
+  boolean pass; // True if the step passed
+  unsigned long elapsedMicros; // How long the step took
+  int rawMean; // The last averaged ADC reading taken by the step. -1 if the step did not take one
+  float volts; // rawMean converted to volts
+} FJ2_TestStep;
+
+//A list of test steps, to be run in order by FlyingJalapeno2::runSequence
+//The add functions return false if the sequence is full
+class TestSequence
+{
+  public:
+
+    TestSequence(FJ2_sequence_policy_e policy = FJ2_SEQUENCE_FAIL_FAST);
+
+    void clear(); //Remove all of the steps from the sequence
+    void setPolicy(FJ2_sequence_policy_e policy); //Fail-fast or run-all
+
+    boolean addTestVCC(const __FlashStringHelper *name = NULL);
+    boolean addShortTestV1(int shortThreshold = 550, const __FlashStringHelper *name = NULL);
+    boolean addShortTestV2(int shortThreshold = 550, const __FlashStringHelper *name = NULL);
+    boolean addSetVoltageV1(float voltage, const __FlashStringHelper *name = NULL);
+    boolean addSetVoltageV2(float voltage, const __FlashStringHelper *name = NULL);
+    boolean addEnableV1(const __FlashStringHelper *name = NULL);
+    boolean addEnableV2(const __FlashStringHelper *name = NULL);
+    boolean addTestVoltage(byte select, const __FlashStringHelper *name = NULL);
+    boolean addVerifyVoltage(byte pin, float expectedVoltage, int allowedPercent = 10, const __FlashStringHelper *name = NULL);
+    boolean addVerifyI2Cdevice(byte address = 0, const __FlashStringHelper *name = NULL);
+    boolean addCustom(FJ2_StepFunction function, void *context = NULL, const __FlashStringHelper *name = NULL);
+
+    uint8_t size(); //Return the number of steps in the sequence
+    FJ2_TestStep *result(uint8_t index); //Return the results for a step (in the order they were added). NULL if index is invalid
+    boolean allPassed(); //Return true if all of the steps passed
+    int getFailedStep(); //Return the index of the first step which failed. -1 if none failed
+    unsigned long getElapsedMicros(); //Return how long the whole sequence took
+    void printResults(Print &port = Serial); //Print the result and time of each step
+
+    FJ2_TestStep steps[FJ2_SEQUENCE_MAX_STEPS];
+    uint8_t numSteps;
+    FJ2_sequence_policy_e policy;
+    boolean passed;
+    int failedStep;
+    unsigned long elapsedMicros;
+
+  private:
+
+    FJ2_TestStep *add(FJ2_step_type_e type, const __FlashStringHelper *name);
+};
+
+// ***** FJ2 Incremental Cap Sense *****
+
+//The state of the incremental cap sense filter for one button
+typedef struct {
+  long filtered; // EWMA of the raw readings - scaled to _capSenseSamples samples
+  long baseline; // The auto-calibrated baseline. Presses are detected relative to this
+  boolean pressed; // The debounced (hysteresis) button state
+  boolean initialised; // False until the first reading has been taken
+} FJ2_CapSenseFilter;
+
+// ***** FJ2 Button Tracker *****
+
+typedef enum {
+  FJ2_BUTTON_EVENT_NONE = 0,
+  FJ2_BUTTON_EVENT_PRESS, // The button has been held for at least minimumHoldMillis
+  FJ2_BUTTON_EVENT_HOLD, // The button has been held for at least holdEventMillis
+  FJ2_BUTTON_EVENT_RELEASE, // The button has been released (after a valid press)
+  FJ2_BUTTON_EVENT_PRESS_RELEASE // The button has been released for at least minimumReleaseMillis (after a valid press)
+} FJ2_button_event_e;
+
+//A non-blocking button state machine. Call update regularly with the time and the button states
+//The timing rules are the same as the waitForButton functions: button 1 takes priority over button 2;
+//a press is only valid once the button has been held for more than minimumHoldMillis;
+//a press-release is only valid once the button has been released for more than minimumReleaseMillis.
+//update only needs the states of the buttons in watchedButtons() - reading the others is a waste of time
+class ButtonTracker
+{
+  public:
+
+    ButtonTracker();
+
+    //Set the timing rules. holdEventMillis is measured from the start of the press
+    void setTiming(unsigned long minimumHoldMillis = 50, unsigned long minimumReleaseMillis = 100, unsigned long holdEventMillis = 1000, unsigned long minimumPreReleaseMillis = 100);
+
+    //(Re)start tracking. If requireRelease is true, neither button must be pressed for minimumPreReleaseMillis before a press is accepted
+    void begin(boolean requireRelease = false);
+
+    //Advance the state machine. pressedButtons: bit 0 is button 1; bit 1 is button 2
+    //Returns the event (if any). getEventButton returns which button the event is for
+    FJ2_button_event_e update(unsigned long nowMillis, uint8_t pressedButtons);
+
+    uint8_t getEventButton(); //Returns the button (1 or 2) for the latest event
+    uint8_t watchedButtons(); //Returns which buttons update needs. bit 0 is button 1; bit 1 is button 2
+    boolean isWaitingForRelease(); //Returns true if begin(true) was called and the buttons have not yet been released for long enough
+
+  private:
+
+    typedef enum {
+      FJ2_BUTTON_STATE_WAIT_RELEASE = 0, // Waiting for both buttons to be released for minimumPreReleaseMillis
+      FJ2_BUTTON_STATE_IDLE, // Waiting for a press
+      FJ2_BUTTON_STATE_DEBOUNCE, // A button is pressed but has not been held for minimumHoldMillis
+      FJ2_BUTTON_STATE_PRESSED, // A valid press
+      FJ2_BUTTON_STATE_RELEASING // Released after a valid press, but not for minimumReleaseMillis
+    } FJ2_button_state_e;
+
+    FJ2_button_state_e _state;
+    uint8_t _button; // The button being tracked (1 or 2)
+    unsigned long _pressMillis; // When the press started
+    unsigned long _releaseMillis; // When the release started
+    boolean _holdReported; // True once the hold event has been returned
+    unsigned long _minimumHoldMillis;
+    unsigned long _minimumReleaseMillis;
+    unsigned long _holdEventMillis;
+    unsigned long _minimumPreReleaseMillis;
+};
+
+// ***** FJ2 LED Patterns *****
+
+//An LED pattern is a list of steps in program memory. Each step is one byte:
+//  bit 7 is the LED state (FJ2_LED_ON = on); bits 0-6 are the duration in units of FJ2_LED_PATTERN_UNIT_MILLIS
+//A zero byte ends the pattern. E.g. a dot is { FJ2_LED_ON | 1, 1, 0 } : on for 250ms, off for 250ms
+#define FJ2_LED_PATTERN_UNIT_MILLIS 250
+#define FJ2_LED_ON 0x80
+#define FJ2_MAX_LED_PATTERNS 4 // The number of LEDs which can play a pattern at the same time
+#define FJ2_PATTERN_FOREVER 0 // Pass this as the repeat to play a pattern until stopPattern is called
+
+//By default the patterns are advanced by updateLEDs - which run() calls through FJ2_TASK_LEDS, so the patterns keep going
+//while the library waits for ADC readings and buttons. Uncomment the next line to advance them from the Timer0 compare A
+//interrupt (AVR only) instead, so they keep going through a plain delay too. Be aware that:
+//  the library then defines TIMER0_COMPA_vect - the sketch and the other libraries must not define it too
+//  OCR0A is the compare register analogWrite uses on pin 13 - the interrupt rate follows any analogWrite(13) duty cycle
+//  (and analogWrite(13, 0) or (13, 255) leaves the compare value where it was)
+//  the patterns call digitalWrite on the LED pins from the interrupt - do not drive those pins from the main code too
+//#define FJ2_LED_USE_TIMER0
+
+//The standard patterns. These have the same timing as dot, dash and SOS
+extern const uint8_t FJ2_PATTERN_DOT[] PROGMEM;
+extern const uint8_t FJ2_PATTERN_DASH[] PROGMEM;
+extern const uint8_t FJ2_PATTERN_SOS[] PROGMEM;
+extern const uint8_t FJ2_PATTERN_HEARTBEAT[] PROGMEM; // A short blink every second
+
+// ***** FJ2 Scheduler *****
+
+//A cooperative scheduler. run() calls each task which is due - the most overdue first - and then returns
+//Tasks must not block: each call does a little work and returns. A task is due again intervalMillis after it was due,
+//or when it asks to be (FJ2_TASK_SLEEP). The blocking library functions (the averaged reads, the settle and button waits)
+//call run() while they wait, so the tasks keep going underneath them. Sketches call run() from loop - or runFor instead of delay
+//
+//Tasks can be written as protothreads. The FJ2_TASK_ macros save where the task yielded (in resumeLine) so the next call
+//carries on from there. E.g.:
+//  void blinkTask(FJ2_Task *task)
+//  {
+//    FJ2_TASK_BEGIN(task);
+//    while (true)
+//    {
+//      digitalWrite(LED_BUILTIN, HIGH);
+//      FJ2_TASK_SLEEP(task, 100);
+//      digitalWrite(LED_BUILTIN, LOW);
+//      FJ2_TASK_SLEEP(task, 900);
+//    }
+//    FJ2_TASK_END(task);
+//  }
+//Local variables are lost when a protothread yields - keep the state in the context (or in statics).
+//Protothread tasks can not use switch statements and must not call blocking library functions
+#define FJ2_MAX_TASKS 8 // Including the built-in tasks
+#define FJ2_BUTTON_TASK_MILLIS 10 // How often the background button task reads the buttons
+
+//The built-in tasks. The button task is disabled until enableTask(FJ2_TASK_BUTTONS) is called
+typedef enum {
+  FJ2_TASK_ADC = 0, // Collects the averaged read samples (only needed on platforms without the ADC interrupt)
+  FJ2_TASK_LEDS, // Advances the LED patterns (not needed with FJ2_LED_USE_TIMER0)
+  FJ2_TASK_DEBUG, // Prints the buffered debug messages
+  FJ2_TASK_BUTTONS, // Advances buttonTracker in the background. getButtonEvent returns the latest event
+  FJ2_NUM_BUILT_IN_TASKS
+} FJ2_built_in_task_e;
+
+struct FJ2_Task;
+typedef void (*FJ2_TaskFunction)(struct FJ2_Task *task);
+
+typedef struct FJ2_Task {
+  FJ2_TaskFunction function; // NULL if the slot is free
+  void *context; // Passed to the task in the FJ2_Task. E.g. a pointer to the state of a protothread
+  unsigned long intervalMillis; // How often the task runs. 0 runs it on every call of run()
+  unsigned long deadlineMillis; // When the task is next due
+  uint16_t resumeLine; // Where a protothread resumes. 0 is the start
+  boolean enabled;
+} FJ2_Task;
+
+#define FJ2_TASK_BEGIN(task) switch ((task)->resumeLine) { case 0:
+#define FJ2_TASK_YIELD(task) do { (task)->resumeLine = __LINE__; return; case __LINE__:; } while (0) // Carry on at the next run
+#define FJ2_TASK_WAIT_UNTIL(task, condition) do { (task)->resumeLine = __LINE__; case __LINE__: if (!(condition)) return; } while (0)
+#define FJ2_TASK_SLEEP(task, ms) do { (task)->deadlineMillis = millis() + (ms); (task)->resumeLine = __LINE__; return; case __LINE__:; } while (0)
+#define FJ2_TASK_END(task) } (task)->resumeLine = 0 // The task starts again from FJ2_TASK_BEGIN at the next run
+
+// ***** FJ2 Statistics *****
+
+//Uncomment the next line to enable the timing statistics. When enabled, the library records the number of calls,
+//the cumulative and maximum micros, and a histogram of the call durations for each of the operations below.
+//The statistics are stored in a static table (FJ2_STAT_NUM_OPS * 28 bytes). When disabled, they take no RAM and no time
+//#define FJ2_ENABLE_STATS
+
+typedef enum {
+  FJ2_STAT_AVERAGED_READ = 0, // averagedAnalogRead
+  FJ2_STAT_POWER_TEST, // powerTest (isV1Shorted / isV2Shorted) and areV1V2Shorted - includes the averaged reads
+  FJ2_STAT_VERIFY_VOLTAGE, // verifyVoltage - includes its averagedAnalogRead
+  FJ2_STAT_CAP_SENSE, // Each CapacitiveSensor capacitiveSensor / capacitiveSensorRaw call
+  FJ2_STAT_VERIFY_I2C, // verifyI2Cdevice
+  FJ2_STAT_RESET, // reset - includes userReset
+  FJ2_STAT_NUM_OPS
+} FJ2_stat_op_e;
+
+//The histogram buckets are powers of 4: bucket 0 is < 64us, bucket 1 is < 256us, ... bucket 6 is < 262144us, bucket 7 is the rest
+#define FJ2_STAT_NUM_BUCKETS 8
+#define FJ2_STAT_FIRST_BUCKET_MICROS 64
+
+typedef struct {
+  uint32_t count; // The number of calls
+  uint32_t totalMicros; // The cumulative duration
+  uint32_t maxMicros; // The longest call
+  uint16_t buckets[FJ2_STAT_NUM_BUCKETS]; // The histogram. The counts stop at 65535
+} FJ2_OpStats;
+
+//The size of the binary snapshot written by getStatsSnapshot:
+//  a version byte, FJ2_STAT_NUM_OPS, FJ2_STAT_NUM_BUCKETS, then for each operation:
+//  count, totalMicros, maxMicros (uint32_t) and the buckets (uint16_t). All little-endian
+#define FJ2_STATS_SNAPSHOT_VERSION 1
+#define FJ2_STATS_SNAPSHOT_SIZE (3 + (FJ2_STAT_NUM_OPS * (12 + (2 * FJ2_STAT_NUM_BUCKETS))))
+
+// ***** FJ2 Debug Messages *****
+
+//Each debug message is stored as a compact record - its ID and its binary arguments - in a ring buffer,
+//and is only turned into text when it is printed. By default each message is printed straight away (like Serial.print).
+//In buffered mode (enableDebugging(Serial, true)) the messages are printed by poll(), and while the library is waiting
+//(for the ADC, a settle delay or a button), so the debug prints do not change the timing of the tests.
+//Buffered mode needs a port which supports availableForWrite (e.g. Serial). If the ring buffer fills up, messages are dropped
+//(and the number dropped is printed). flushDebug prints everything - waiting for the port if necessary
+//The format codes are: %d (signed), %u (unsigned), %.Nf (float with N decimal places) and %x (two hex digits)
+//Messages must only be added to the end of the list, so that the tokenized IDs (below) do not change
+
+//Uncomment the next line to print the debug messages as binary tokens instead of text. Each message is printed as
+//FJ2_DEBUG_TOKEN_SYNC, the message ID, then four bytes (little-endian) per argument - e.g. 6 bytes instead of 55 for
+//"FlyingJalapeno2::verifyVoltage: expectedVoltage: 1.65". The message text (~2.7KB) is not compiled into flash.
+//extras/tools/fj2_debug_decode.py turns the tokens back into text, using the FJ2_DEBUG_MESSAGES list in this file
+//#define FJ2_TOKENIZED_DEBUG
+
+#define FJ2_DEBUG_TOKEN_SYNC 0x1E // The first byte of each tokenized message (ASCII Record Separator)
+
+#define FJ2_DEBUG_MESSAGES(X) \
+  X(FJ2_MSG_DROPPED, "FlyingJalapeno2::debug: %u debug message(s) dropped") \
+  X(FJ2_MSG_CAP_SENSE_RAW, "FlyingJalapeno2::incrementalCapSense: capacitiveSensorRaw returned %d") \
+  X(FJ2_MSG_CAP_SENSE_1, "FlyingJalapeno2::isPretestPressed: FJ2button1.capacitiveSensor returned %d") \
+  X(FJ2_MSG_CAP_SENSE_2, "FlyingJalapeno2::isTestPressed: FJ2button2.capacitiveSensor returned %d") \
+  X(FJ2_MSG_PRESS_TIMEOUT, "FlyingJalapeno2::waitForButtonPress: timed out!") \
+  X(FJ2_MSG_PRESS_BUTTON, "FlyingJalapeno2::waitForButtonPress: button %d pressed") \
+  X(FJ2_MSG_PRESS_RELEASE_CALLING, "FlyingJalapeno2::waitForButtonPressRelease: calling waitForButtonPress") \
+  X(FJ2_MSG_PRESS_RELEASE_BUTTON, "FlyingJalapeno2::waitForButtonPressRelease: button %d has been released") \
+  X(FJ2_MSG_PRESS_RELEASE_TIMEOUT, "FlyingJalapeno2::waitForButtonPressRelease: timed out!") \
+  X(FJ2_MSG_RELEASE_PRESS_RELEASE_CALLING, "FlyingJalapeno2::waitForButtonReleasePressRelease: neither button pressed. Calling waitForButtonPressRelease") \
+  X(FJ2_MSG_RELEASE_PRESS_RELEASE_TIMEOUT, "FlyingJalapeno2::waitForButtonReleasePressRelease: timed out!") \
+  X(FJ2_MSG_PATTERN_FULL, "FlyingJalapeno2::playPattern: too many patterns are playing") \
+  X(FJ2_MSG_PRETEST_READING, "FlyingJalapeno2::PreTest_Custom: jumper test reading: %d") \
+  X(FJ2_MSG_SHORT_READING, "FlyingJalapeno2::isShortToGround_Custom: jumper test reading: %d") \
+  X(FJ2_MSG_POWER_TEST_SELECT, "FlyingJalapeno2::powerTest: Error! select must be 1 or 2.") \
+  X(FJ2_MSG_POWER_TEST_READING, "FlyingJalapeno2::powerTest: power test reading: %d") \
+  X(FJ2_MSG_SETTLE, "FlyingJalapeno2::waitForSettle: settle time (ms): %u") \
+  X(FJ2_MSG_SETTLE_TIMEOUT, "FlyingJalapeno2::waitForSettle: settle time (ms): %u (timed out)") \
+  X(FJ2_MSG_VERIFY_EXPECTED, "FlyingJalapeno2::verifyVoltage: expectedVoltage: %.2f") \
+  X(FJ2_MSG_VERIFY_ALLOWANCE, "FlyingJalapeno2::verifyVoltage: allowanceFraction: %.2f") \
+  X(FJ2_MSG_VERIFY_READING, "FlyingJalapeno2::verifyVoltage: reading: %d") \
+  X(FJ2_MSG_VERIFY_VOLTAGE, "FlyingJalapeno2::verifyVoltage: voltage: %.2f") \
+  X(FJ2_MSG_VERIFY_RESULT, "FlyingJalapeno2::verifyVoltage: result: %d") \
+  X(FJ2_MSG_ENABLE_V1_NOT_SET, "FlyingJalapeno2::enableV1: setVoltageV1 has not been called. Aborting...") \
+  X(FJ2_MSG_ENABLE_V1, "FlyingJalapeno2::enableV1: V1 enabled!") \
+  X(FJ2_MSG_ENABLE_V2_NOT_SET, "FlyingJalapeno2::enableV2: setVoltageV2 has not been called. Aborting...") \
+  X(FJ2_MSG_ENABLE_V2, "FlyingJalapeno2::enableV2: V2 enabled!") \
+  X(FJ2_MSG_SET_V1_INVALID, "FlyingJalapeno2::setVoltageV1: invalid voltage specified: %.2f. Defaulting to 3.3V") \
+  X(FJ2_MSG_SET_V1, "FlyingJalapeno2::setVoltageV1: V1 will be %.1fV when enabled") \
+  X(FJ2_MSG_SET_V2_INVALID, "FlyingJalapeno2::setVoltageV2: invalid voltage specified: %.2f. Defaulting to 3.3V") \
+  X(FJ2_MSG_SET_V2, "FlyingJalapeno2::setVoltageV2: V2 will be %.1fV when enabled") \
+  X(FJ2_MSG_TEST_VOLTAGE_SELECT, "FlyingJalapeno2::testVoltage: Error! select must be 1 or 2.") \
+  X(FJ2_MSG_TEST_VOLTAGE, "FlyingJalapeno2::testVoltage: Testing V%d. The expected voltage (from the resistor divider) is %.2fV") \
+  X(FJ2_MSG_VCC_EXPECTED, "FlyingJalapeno2::testVCC: VCC should be %.2fV") \
+  X(FJ2_MSG_VCC_READING, "FlyingJalapeno2::testVCC: val is: %d") \
+  X(FJ2_MSG_VCC_HIGH, "FlyingJalapeno2::testVCC: PANIC! VCC appears to be higher than 3.3V!") \
+  X(FJ2_MSG_VCC_OUT_OF_BOUNDS, "FlyingJalapeno2::testVCC: PANIC! VCC appears to be out of bounds!") \
+  X(FJ2_MSG_BATCH_CHANNEL, "FlyingJalapeno2::measureBatch: pin %d: expectedVoltage: %.2f reading: %d voltage: %.2f result: %d") \
+  X(FJ2_MSG_I2C_MISSING, "FlyingJalapeno2::verifyI2Cdevices: missing device 0x%x") \
+  X(FJ2_MSG_I2C_FOUND, "FlyingJalapeno2::scanI2C: Found device at address 0x%x") \
+  X(FJ2_MSG_I2C_ERROR, "FlyingJalapeno2::scanI2C: Unknown error %d at address 0x%x") \
+  X(FJ2_MSG_I2C_SUMMARY, "FlyingJalapeno2::scanI2C: %d device(s) found in %uus") \
+  X(FJ2_MSG_SEQUENCE_STEP, "FlyingJalapeno2::runSequence: step %d: result: %d in %uus") \
+  X(FJ2_MSG_VERIFY_COUNTS, "FlyingJalapeno2::verifyCounts: window: %d to %d reading: %d result: %d") \
+  X(FJ2_MSG_EARLY_EXIT, "FlyingJalapeno2::readAnalogSum: verdict certain after %d of %d samples") \
+  X(FJ2_MSG_VCC_CALIBRATION, "FlyingJalapeno2::calibrateVCC: measured VCC: %.3f result: %d") \
+  X(FJ2_MSG_SHORT_TEST_READINGS, "FlyingJalapeno2::areV1V2Shorted: V1 reading: %d V2 reading: %d") \
+  X(FJ2_MSG_RAMP_CAPTURE, "FlyingJalapeno2::enableWithCapture: V%d final reading: %d rise time: %uus cut off: %d result: %d") \
+  X(FJ2_MSG_SWEEP_STEP, "FlyingJalapeno2::sweepV2: setting: %.1fV voltage: %.2fV settle: %ums result: %d")
+
+typedef enum {
+#define FJ2_DEBUG_MESSAGE_ID(id, text) id,
+  FJ2_DEBUG_MESSAGES(FJ2_DEBUG_MESSAGE_ID)
+#undef FJ2_DEBUG_MESSAGE_ID
+  FJ2_NUM_DEBUG_MESSAGES
+} FJ2_debug_message_e;
+
+#define FJ2_DEBUG_LOG_SIZE 256 // The size of the debug record ring buffer (bytes). Each record is 2 bytes plus 4 per argument
+#define FJ2_DEBUG_LINE_SIZE 128 // The maximum length of a debug message once it has been turned into text (or a token)
+#define FJ2_DEBUG_MAX_ARGS 5 // The maximum number of arguments per debug message
+
+//One debug message argument. Integers and floats are both stored in four bytes
+class FJ2_DebugArg
+{
+  public:
+    FJ2_DebugArg(long value) { _value.l = (int32_t)value; }
+    FJ2_DebugArg(int value) { _value.l = value; }
+    FJ2_DebugArg(unsigned long value) { _value.u = (uint32_t)value; }
+    FJ2_DebugArg(unsigned int value) { _value.u = value; }
+    FJ2_DebugArg(uint8_t value) { _value.l = value; }
+    FJ2_DebugArg(bool value) { _value.l = value; }
+    FJ2_DebugArg(float value) { _value.f = value; }
+    FJ2_DebugArg(double value) { _value.f = (float)value; }
+    union {
+      int32_t l; // Not long - that is eight bytes on the host
+      uint32_t u;
+      float f;
+    } _value;
+    static_assert(sizeof(_value) == 4, "The debug records store four bytes per argument");
+};
 
 // ***** The FJ2 Class *****
 
@@ -79,15 +641,21 @@ class FlyingJalapeno2
 
     FlyingJalapeno2(int statLED, float FJ_VCC = 3.3, bool useCapSense = true);
 
-    void enableDebugging(Stream &debugPort = Serial); // Enable helpful debug messages on the chosen serial port
+    void enableDebugging(Stream &debugPort = Serial, boolean buffered = false); // Enable helpful debug messages on the chosen serial port. See FJ2_DEBUG_MESSAGES for buffered
     void disableDebugging(); // Turn off debug messages
+    void poll(); //Print any buffered debug messages - without waiting for the serial port. Call this when the code is idle
+    void flushDebug(); //Print all of the buffered debug messages (waits for the serial port)
+    unsigned long getDebugDropped(); //Returns the number of debug messages dropped because the ring buffer was full
 
     void reset(boolean resetLEDs = true); //Reset the FJ2. Turn everything off. Also calls userReset
     void userReset(boolean resetLEDs = true) __attribute__((weak)); //The user can overwrite this with a custom reset function for the board being tested
 
     // ***** FJ2 Buttons *****
-    CapacitiveSensor *FJ2button1;
-    CapacitiveSensor *FJ2button2;
+#ifndef FJ2_NO_CAP_SENSE
+    //The cap sense buttons. These point into _capSenseStorage - or are NULL if useCapSense is false
+    CapacitiveSensor *FJ2button1 = NULL;
+    CapacitiveSensor *FJ2button2 = NULL;
+#endif
 
     long _capSenseThreshold = 2000; // The user can change the default threshold by calling setCapSenseThreshold
     void setCapSenseThreshold(long threshold = 2000); //Allow the user to override the default cap sense threshold
@@ -95,6 +663,18 @@ class FlyingJalapeno2
     uint8_t _capSenseSamples = 30; // The user can change the number of samples by calling setCapSenseSamples
     void setCapSenseSamples(uint8_t samples = 30); //Allow the user to override the number of cap sense samples
 	
+    //Incremental cap sense. Instead of taking _capSenseSamples samples on every call, isPretestPressed / isTestPressed
+    //take samplesPerPoll samples and fold them into a running filter (an EWMA: filtered += (reading - filtered) >> filterShift).
+    //Each button has an auto-calibrated baseline which tracks slow drift (baseline += (filtered - baseline) >> baselineShift)
+    //while the button is not pressed. A press is detected when filtered - baseline exceeds the threshold.
+    //The press is released when filtered - baseline falls below threshold * (100 - hysteresisPercent) / 100
+    //The filter is scaled to _capSenseSamples, so the threshold means the same thing in both modes
+    void enableIncrementalCapSense(uint8_t samplesPerPoll = 3, uint8_t filterShift = 2, uint8_t baselineShift = 6, uint8_t hysteresisPercent = 25);
+    void disableIncrementalCapSense();
+    void recalibrateCapSense(); //Restart the incremental filters. The baselines are taken from the next readings - so don't touch the buttons!
+    long getCapSenseBaseline(uint8_t button); //Returns the incremental baseline for button 1 or 2
+    long getCapSenseFiltered(uint8_t button); //Returns the incremental filtered reading for button 1 or 2
+
     boolean isPretestPressed(long threshold = 0); //Returns true if cap sense button 1 is being pressed. _capSenseThreshold is used if threshold is 0
     boolean isProgramAndTestPressed(long threshold = 0); //Helper function: calls isPretestPressed. _capSenseThreshold is used if threshold is 0
     boolean isButton1Pressed(long threshold = 0); //Helper function: calls isPretestPressed. _capSenseThreshold is used if threshold is 0
@@ -112,19 +692,76 @@ class FlyingJalapeno2
     //waitForButtonPress will return 1 or 2 if the button is held for at least minimumHoldMillis. 1 takes priority over 2 (if both are being pressed)
     //waitForButtonPressRelease will return 1 or 2 after the button has been pressed and released for minimumReleaseMillis
     //waitForButtonReleasePressRelease will only return 1 or 2 if neither button was pressed initially (when the function was called)
+    //These use their own ButtonTracker, so they do not change the buttonTracker timing or state
     int waitForButtonPress(unsigned long timeoutMillis = 5000, unsigned long minimumHoldMillis = 50, unsigned long overrideStartMillis = 0);
     int waitForButtonPressRelease(unsigned long timeoutMillis = 5000, unsigned long minimumHoldMillis = 50, unsigned long minimumReleaseMillis = 100, unsigned long overrideStartMillis = 0);
     int waitForButtonReleasePressRelease(unsigned long timeoutMillis = 5000, unsigned long minimumPreReleaseMillis = 100, unsigned long minimumHoldMillis = 50, unsigned long minimumPostReleaseMillis = 100);
 
+    //Non-blocking button events. Call pollButtons regularly. It reads the buttons and advances buttonTracker
+    //Change the timing rules with buttonTracker.setTiming. Call buttonTracker.begin to start again
+    ButtonTracker buttonTracker;
+    FJ2_button_event_e pollButtons(); //Returns the event (if any). buttonTracker.getEventButton() returns which button
+
     void statOn(); //Turn the stat LED on
     void statOff();
 
     long _numAnalogSamples = 25; //The user can change this by calling setAnalogReadSamples
     void setAnalogReadSamples(long samples = 25); //Set the number of analog reads to average
-    int averagedAnalogRead(byte analogPin); //Average the analog reading to minimise noise
+    int averagedAnalogRead(byte analogPin, long numSamples = 0); //Average the analog reading to minimise noise. _numAnalogSamples is used if numSamples is 0. Blocking wrapper for the functions below
+    int getLastAveragedRead(); //Returns the result of the most recent averaged read (e.g. the reading taken by verifyVoltage). -1 if there has not been one
+
+    //Non-blocking averaged read. Start a read of _numAnalogSamples samples, then poll isReadComplete until it returns true
+    //On AVR the samples are collected by the ADC interrupt, so the code can do other things while the read is in progress
+    //Note: do not call analogRead while an averaged read is in progress
+    void startAveragedRead(byte analogPin, long numSamples = 0); //Start a non-blocking averaged read. _numAnalogSamples is used if numSamples is 0
+    void startAveragedRead(const byte *analogPins, uint8_t numPins, long numSamples = 0); //Interleaved read of up to FJ2_ADC_MAX_CHANNELS pins
+    boolean isReadComplete(); //Returns true when all the samples have been collected
+    int getAveragedRead(uint8_t channel = 0); //Returns the average of the samples collected so far. channel is the index into analogPins
+    uint8_t getRecentSamples(uint16_t *samples, uint8_t maxSamples); //Copy up to FJ2_ADC_RING_SIZE of the most recent samples (oldest first). Returns the number copied
+
+    //Early exit. verifyVoltage, verifyCounts, testVoltage, testVCC and isV1/V2Shorted stop sampling as soon as the running mean is
+    //more than confidenceSigma standard errors inside (or outside) the window. Clearly good or clearly bad boards need only a few samples;
+    //borderline boards still take all _numAnalogSamples. At least minimumSamples are always taken. Disabled by default
+    void setEarlyExit(boolean enable = true, uint8_t confidenceSigma = 4, long minimumSamples = 8);
+    long getLastSampleCount(); //Returns the number of samples used by the most recent averaged read
+
+    //Averaged read filters. The trimmed mean and median reject glitches (e.g. relay bounce) which would pull a plain mean off, so fewer samples
+    //are needed. Oversampling takes 4^parameter samples. The filters apply to single pin reads (not measureBatch). The default is FJ2_FILTER_MEAN
+    //parameter is: the number of extra bits for FJ2_FILTER_OVERSAMPLE (1 to FJ2_OVERSAMPLE_MAX_BITS); the number of samples trimmed from each end for FJ2_FILTER_TRIMMED_MEAN
+    void setAnalogFilter(FJ2_adc_filter_e filter, uint8_t parameter = 2);
+    long getLastOversampledRead(); //Returns the most recent averaged read with the extra oversampled bits (e.g. 0 to 4095 with 2 extra bits). -1 if there has not been one
+
+    //ADC configuration. The prescaler sets the conversion time: 128 = 104us (the Arduino default); 64 = 52us; 32 = 26us; 16 = 13us
+    //The ATmega2560 gives full 10-bit accuracy up to a 200kHz ADC clock (prescaler 128); expect ~9 bits at 64 and 32 and ~8 bits at 16.
+    //Oversampling (setAnalogFilter) can win some of that back. reference is DEFAULT (VCC), INTERNAL1V1 (bandgap), INTERNAL2V56 or EXTERNAL.
+    //Note: testVoltage, testVCC and isV1/V2Shorted need the DEFAULT reference - the rail and Zener voltages are higher than the internal references.
+    //discardFirst throws away the first conversion after the ADC pin changes (every conversion of an interleaved read). The default is no discard
+    void configureADC(uint8_t prescaler = 128, uint8_t reference = DEFAULT, boolean discardFirst = false, float externalReferenceVoltage = 0.0);
+    float getADCReferenceVoltage(); //Returns the reference voltage used to convert the ADC counts to volts
+    float getADCConversionMicros(); //Returns the time each conversion takes with the configured prescaler
+
+    //VCC calibration. Measure the actual VCC from the 3.3V Zener (5V VCC only) or the 1.1V bandgap, so the voltage tests don't depend on
+    //the USB supply. VCC is measured by the first test after each reset. The measured VCC is used for all conversions (with the DEFAULT reference)
+    void setVCCCalibration(FJ2_vcc_source_e source, float referenceVoltage = 0.0); //referenceVoltage: the actual Zener / bandgap voltage. 0.0 = nominal
+    boolean calibrateVCC(); //Measure VCC now. Returns false if the measurement failed (the nominal VCC is used)
+    float getMeasuredVCC(); //Returns the VCC used for the conversions
+
+    //Settle detection. By default, powerTest, verifyVoltage, PreTest_Custom and isShortToGround_Custom wait a fixed 200ms before sampling
+    //In adaptive mode the pin is sampled repeatedly (settleWindowSamples samples, every settleIntervalMillis) and the signal
+    //is declared settled once successive windowed means have stayed within toleranceCounts for settleStableWindows windows.
+    //maxSettleMillis is the timeout. Slow rails need a longer settleIntervalMillis, so a slow ramp is not mistaken for a settled signal
+    void setSettleMode(boolean adaptive, int toleranceCounts = 3, unsigned long maxSettleMillis = 200, unsigned long settleIntervalMillis = 10, uint8_t settleWindowSamples = 8, uint8_t settleStableWindows = 2);
+    unsigned long getLastSettleMillis(); //Returns the settle time used by the most recent test (in millis)
+    boolean lastSettleTimedOut(); //Returns true if the most recent adaptive settle reached maxSettleMillis
 
     //Returns true if pin voltage is within a given window of the value we are looking for
+    //This is a wrapper for verifyCounts. If the same voltage is tested many times, make the window once and call verifyCounts
     boolean verifyVoltage(int pin, float expectedVoltage, int allowedPercent = 10); 
+
+    //Integer tests. Make the window once - with makeAdcWindow (e.g. in setup) or FJ2_adcWindow (at compile time) - then
+    //verifyCounts compares the sum of the ADC samples against the window, with no float maths and no division
+    FJ2_AdcWindow makeAdcWindow(float expectedVoltage, int allowedPercent = 10); //The window which matches verifyVoltage(pin, expectedVoltage, allowedPercent) exactly
+    boolean verifyCounts(int pin, FJ2_AdcWindow window); //Returns true if the averaged reading on pin is inside window
     
     boolean verifyValue(float input_value, float correct_val, float allowance_percent);
 
@@ -132,6 +769,7 @@ class FlyingJalapeno2
     
     boolean isV1Shorted(int shortThreshold = 550); //Test V1 for shorts. Returns true if short detected.
     boolean isV2Shorted(int shortThreshold = 550); //Test V2 for shorts. Returns true if short detected.
+    boolean areV1V2Shorted(int shortThreshold = 550, FJ2_ShortTestResult *result = NULL); //Test V1 and V2 together (in about half the time). Returns true if either is shorted
     boolean isShortToGround_Custom(byte control_pin, byte read_pin); // test for a short to gnd on a custom set of pins
 
     void setVoltageV1(float voltage); //Set V1 voltage (5 or 3.3V)
@@ -141,18 +779,60 @@ class FlyingJalapeno2
 
     boolean testVoltage(byte select); //Test if the voltage on V1/V2 is OK. Returns false if the voltage is out of range
 
+    //Enable V1/V2 and capture the ramp on FJ2_PT_READ_V1/V2 - instead of enableV1/V2, a settle delay and testVoltage
+    //The rail is disabled within cutOffMicros if it does not rise past risePercent of the expected reading (a short which got past the short test)
+    //Returns true if the rail rose and - after the capture, the normal settle and an averaged read - the reading is inside the testVoltage window
+    //The ramp and its statistics are stored in capture
+    boolean enableV1WithCapture(FJ2_RampCapture *capture, uint8_t risePercent = 50, unsigned long cutOffMicros = 5000, unsigned long sampleIntervalMicros = 250);
+    boolean enableV2WithCapture(FJ2_RampCapture *capture, uint8_t risePercent = 50, unsigned long cutOffMicros = 5000, unsigned long sampleIntervalMicros = 250);
+
+    //Step V2 through a list of settings (3.3, 3.7, 4.2, 5.0V) without turning it off. Each setting is settled (adaptively) and measured
+    //Returns true if every setting passed. V2 is left enabled at the last valid setting. Invalid settings are skipped (ran is false) and fail
+    boolean sweepV2(const float *settings, FJ2_SweepResult *results, uint8_t numSettings);
+
     boolean testVCC(); //Test if the FJ2 VCC has been set correctly (using the 3.3V Zener diode on FJ2_BRAIN_VCC_A0)
 
+    //Measure all of the channels in a MeasurementBatch in one pass - with a single settle window and interleaved ADC conversions
+    //Returns true if all of the channels passed. The results for each channel are stored in the batch
+    boolean measureBatch(MeasurementBatch &batch);
+
+    //Run the steps in a TestSequence in order. The time each step takes is recorded in the sequence
+    //reset(false) is called before the first step and after the last, so the board under test is always left powered down
+    //(The LEDs are not changed.) Returns true if all of the steps passed
+    boolean runSequence(TestSequence &sequence);
+
     //Enable or disable the power regulators
     void enableV1();
     void disableV1();
     void enableV2();
     void disableV2();
 
+    //Blocking blinks. dot takes 0.5s, dash takes 1s and SOS takes 7.75s. The tasks keep running. Use playPattern if the code needs to keep running
     void dot(int pin = -1); // If pin is -1, _statLED is blinked
     void dash(int pin = -1); // If pin is -1, _statLED is blinked
     void SOS(int pin = -1); // If pin is -1, _statLED is blinked
 
+    //Non-blocking LED patterns. The pattern plays on pin while the code keeps running. If pin is -1, _statLED is used
+    //The patterns are advanced by updateLEDs. run() calls it (FJ2_TASK_LEDS), and so does the library while it is waiting for
+    //ADC readings and buttons - call run() regularly from loop. With FJ2_LED_USE_TIMER0 (see above), the Timer0 interrupt does it instead
+    //playPattern replaces any pattern already playing on pin. Returns false if FJ2_MAX_LED_PATTERNS are already playing
+    //repeat is the number of times to play the pattern. FJ2_PATTERN_FOREVER (0) plays it until stopPattern is called
+    //reset(true) stops all of the patterns
+    boolean playPattern(int pin, const uint8_t *pattern, uint8_t repeat = 1);
+    void stopPattern(int pin = -1); //Stop the pattern on pin and turn the LED off
+    boolean isPlaying(int pin = -1); //Returns true if a pattern is playing on pin
+    void updateLEDs(); //Advance the patterns. Does nothing with FJ2_LED_USE_TIMER0
+
+    //The cooperative scheduler. See FJ2_Task
+    //addTask returns the task number (use it with enableTask and removeTask), or -1 if all FJ2_MAX_TASKS are in use
+    //The task is first due straight away. context is stored in the FJ2_Task for the task to use
+    int addTask(FJ2_TaskFunction function, void *context = NULL, unsigned long intervalMillis = 0);
+    void removeTask(int task); //Free a task added by addTask. The built-in tasks can only be disabled
+    void enableTask(int task, boolean enable = true); //Enable or disable a task (or a built-in task - see FJ2_built_in_task_e)
+    void run(); //Run the tasks which are due. Returns straight away if called from inside a task
+    void runFor(unsigned long ms); //delay - running the tasks while we wait
+    FJ2_button_event_e getButtonEvent(uint8_t *button = NULL); //Returns (and clears) the latest event found by the FJ2_TASK_BUTTONS task. button is set to 1 or 2
+
     void enableI2CBuffer(); //Enable the I2C buffer by pulling FJ2_I2C_EN high
     void disableI2CBuffer(); //Disable the I2C buffer by pulling FJ2_I2C_EN low
     void enableSerialBuffer(); //Enable the Serial buffer by pulling FJ2_SERIAL_EN high
@@ -163,13 +843,54 @@ class FlyingJalapeno2
     void disableMicroSDBuffer(); //Disable the microSD buffer by pulling FJ2_MICROSD_EN low
     void enableMicroSDPower(); //Enable the microSD power by pulling FJ2_MICROSD_PWR_EN high
     void disableMicroSDPower(); //Disable the microSD power by pulling FJ2_MICROSD_PWR_EN low
-
-    boolean verifyI2Cdevice(byte address = 0); // If address is zero, do a full scan
+    void keepMicroSDEnabled(boolean keep = true); //If keep is true, reset leaves the microSD power and buffer alone (e.g. while logging results)
+
+    boolean verifyI2Cdevice(byte address = 0); // If address is zero, do a full scan. Returns true if the device (or any device) was found
+
+    //Fast I2C scans. Call Wire.begin first. By default the scans leave the I2C clock alone
+    //After setI2CScanClock, the clock is raised to scanClock during each scan (including verifyI2Cdevice) and then set back to normalClock
+    //(The Wire library can not tell us what the clock was, so it needs to be told.) Only use this if the devices can run at scanClock
+    void setI2CScanClock(uint32_t scanClock = FJ2_I2C_SCAN_CLOCK, uint32_t normalClock = FJ2_I2C_NORMAL_CLOCK);
+    //Probe a range (or list) of addresses. The addresses which respond are added to found. Returns the number found
+    //errors is optional. If provided, it must have 128 entries. errors[address] is set to the Wire.endTransmission result
+    //for each address probed (0 = found, 2 = NACK, 4 = other error, ...) and FJ2_I2C_NOT_PROBED for the others
+    uint8_t scanI2C(I2CAddressSet &found, byte firstAddress = 1, byte lastAddress = 126, uint8_t *errors = NULL);
+    uint8_t scanI2C(I2CAddressSet &found, const byte *addresses, uint8_t numAddresses, uint8_t *errors = NULL);
+    //Return true if all of the expected devices are present. Only the expected addresses are probed,
+    //and the probing stops at the first missing device. found is optional
+    boolean verifyI2Cdevices(const I2CAddressSet &expected, I2CAddressSet *found = NULL);
+
+    //Timing statistics. These need FJ2_ENABLE_STATS (see above). Without it, dumpStats prints a note and getStats returns NULL
+    void resetStats(); //Zero all of the statistics
+    void dumpStats(Stream &port = Serial); //Print the statistics as a table
+    const FJ2_OpStats *getStats(FJ2_stat_op_e op); //Return the statistics for one operation. NULL if op is invalid or the statistics are disabled
+    size_t getStatsSnapshot(uint8_t *buffer, size_t bufferSize); //Copy a compact binary snapshot into buffer. Returns the number of bytes written (FJ2_STATS_SNAPSHOT_SIZE), or 0 if buffer is too small or the statistics are disabled
 
   private:
 
-  	Stream *_debugSerial;			//The stream to send debug messages to if enabled
+  	Stream *_debugSerial = NULL;			//The stream to send debug messages to if enabled
   	boolean _printDebug = false;		//Flag to print the serial commands we are sending to the Serial port for debug
+    boolean _bufferedDebug = false; // True: debug messages are printed by poll. False: they are printed straight away
+    uint8_t _debugRing[FJ2_DEBUG_LOG_SIZE]; // The debug records: ID, number of arguments, arguments
+    uint16_t _debugHead = 0; // Where the next record will be written
+    uint16_t _debugTail = 0; // The oldest record
+    uint16_t _debugUsed = 0; // The number of bytes in the ring
+    unsigned long _debugDropped = 0; // The number of records dropped since the last dropped message
+    unsigned long _debugDroppedTotal = 0; // The total number of records dropped
+    char _debugLine[FJ2_DEBUG_LINE_SIZE]; // The message being printed
+    uint8_t _debugLineLength = 0; // The length of the message being printed
+    uint8_t _debugLinePos = 0; // How much of the message has been printed
+    //Add a debug message to the ring (and print it if the debugging is not buffered)
+    void debugLog(FJ2_debug_message_e id);
+    void debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0);
+    void debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1);
+    void debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1, FJ2_DebugArg arg2);
+    void debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1, FJ2_DebugArg arg2, FJ2_DebugArg arg3);
+    void debugLog(FJ2_debug_message_e id, FJ2_DebugArg arg0, FJ2_DebugArg arg1, FJ2_DebugArg arg2, FJ2_DebugArg arg3, FJ2_DebugArg arg4);
+    void queueDebugRecord(FJ2_debug_message_e id, const FJ2_DebugArg *args, uint8_t numArgs);
+    uint8_t formatDebugRecord(uint8_t id, const FJ2_DebugArg *args, uint8_t numArgs); //Turn a record into text (or a token) in _debugLine. Returns the length
+    void drainDebug(boolean wait); //Print the buffered debug messages. If wait is false, only print what the serial port can take now
+    void idleDelay(unsigned long ms); //delay - running the tasks (e.g. printing buffered debug messages) while we wait
 
     int _statLED; // Define which status LED to use. Usually FJ2_STAT_LED, but can be custom if needed
 	  float _FJ_VCC; // The FJ2 VCC. Used in A2D voltage calculations
@@ -177,9 +898,89 @@ class FlyingJalapeno2
     float _V2_actual = 0.0; // The actual V2 voltage. Used by testVoltage
     float _V1_setting = 0.0; // What V1 will be when enabled
     float _V2_setting = 0.0; // What V2 will be when enabled
+#ifndef FJ2_NO_CAP_SENSE
     bool _useCapSense = true; // True: use CapacitiveSensor. False: use (e.g.) external AT42QT1011 buttons
+    alignas(CapacitiveSensor) uint8_t _capSenseStorage[2][sizeof(CapacitiveSensor)]; // The CapacitiveSensor objects (placement new) - no heap
+#endif
+    boolean _keepMicroSD = false; // True: reset does not disable the microSD power and buffer
+    long _lastAnalogTotal = 0; // The sum of the samples taken by the most recent averaged read
+    long _lastAnalogCount = 0; // The number of samples in the total (after filtering). Zero if there has not been a read
+    long _lastSamplesTaken = 0; // The number of samples taken by the most recent averaged read
+    void updateAdcWindows(); //Work out the cached windows again (after the reference or VCC has changed)
+    FJ2_vcc_source_e _vccSource = FJ2_VCC_NOMINAL; // How VCC is found
+    float _vccCalibrationReference = 0.0; // The Zener / bandgap voltage. 0.0 = nominal
+    boolean _vccCalibrated = false; // True once VCC has been measured (or the measurement failed) since the last reset
+    float _measuredVCC = 0.0; // The measured VCC. 0.0 if VCC has not been measured
+    void checkVCCCalibration(); //Measure VCC if it needs measuring
+    FJ2_adc_filter_e _analogFilter = FJ2_FILTER_MEAN; // The averaged read filter
+    uint8_t _analogFilterParameter = 2; // The oversample bits or trimmed mean trim
+    long readAnalogSum(byte analogPin, long numSamples, long *count, const FJ2_AdcWindow *window = NULL); //Take numSamples samples. Returns the total. count is set to the number of samples
+    long getAnalogSum(uint8_t channel, long *count); //Returns the total of the samples collected so far for a channel. count is set to the number of samples
+    boolean _earlyExit = false; // True: readAnalogSum stops once the verdict is certain
+    uint8_t _earlyExitSigma = 4; // The confidence, in standard errors of the mean
+    long _earlyExitMinSamples = 8; // Always take at least this many samples
+    boolean isVerdictCertain(long total, unsigned long squares, long count, FJ2_AdcWindow window); //Returns true if the mean is certainly inside or outside window
+
+    //The ADC windows for V1 / V2 and the Zener. These are worked out by the constructor and setVoltageV1/V2, so testVoltage and testVCC don't need float maths
+    FJ2_AdcWindow _V1SettingWindow = {0, 0}; // The testVoltage(1) window when V1 is enabled
+    FJ2_AdcWindow _V2SettingWindow = {0, 0}; // The testVoltage(2) window when V2 is enabled
+    FJ2_AdcWindow _V1Window = {0, 0}; // The testVoltage(1) window now. {0, 0} when V1 is disabled
+    FJ2_AdcWindow _V2Window = {0, 0}; // The testVoltage(2) window now. {0, 0} when V2 is disabled
+    FJ2_AdcWindow _vccWindow = {0, 0}; // The testVCC window (3.3V +/- 10%) when the FJ2 VCC is 5V
+    boolean verifyWindow(int pin, FJ2_AdcWindow window); //Settle, take the samples and compare the total against window
+    void printVerifyDebug(float expectedVoltage, float allowanceFraction, boolean result); //Print the verifyVoltage debug messages
+
+#ifndef FJ2_NO_CAP_SENSE
+    boolean _incrementalCapSense = false; // True: use the incremental cap sense filters
+    uint8_t _capSenseSamplesPerPoll = 3; // The number of cap sense samples taken per call in incremental mode
+    uint8_t _capSenseFilterShift = 2; // The EWMA filter coefficient (1 / 2^shift)
+    uint8_t _capSenseBaselineShift = 6; // The baseline tracking coefficient (1 / 2^shift)
+    uint8_t _capSenseHysteresisPercent = 25; // The release threshold is this much lower than the press threshold
+    FJ2_CapSenseFilter _capSenseFilter1 = {0, 0, false, false}; // The incremental filter for button 1
+    FJ2_CapSenseFilter _capSenseFilter2 = {0, 0, false, false}; // The incremental filter for button 2
+    boolean incrementalCapSense(CapacitiveSensor *button, FJ2_CapSenseFilter *filter, long threshold); //Take one incremental reading. Returns true if pressed
+#endif
 
     boolean powerTest(byte select, int shortThreshold = 550); //Test if V1/V2 pin is OK. Returns false if a short is detected
+
+    boolean _adaptiveSettle = false; // True: use adaptive settle detection. False: use a fixed 200ms delay
+    int _settleTolerance = 3; // Successive windowed means must be within this many ADC counts
+    unsigned long _maxSettleMillis = 200; // Settle timeout
+    unsigned long _settleIntervalMillis = 10; // Interval between the windowed means
+    uint8_t _settleWindowSamples = 8; // Number of samples in each windowed mean
+    uint8_t _settleStableWindows = 2; // Number of successive stable windows needed
+    unsigned long _lastSettleMillis = 0; // The settle time used by the most recent test
+    boolean _lastSettleTimedOut = false; // True if the most recent adaptive settle timed out
+    void waitForSettle(byte pin); //Wait for the voltage on pin to settle - using a fixed delay or adaptive settle detection
+    void waitForSettle(const byte *pins, uint8_t numPins); //Wait for the voltages on a set of pins to settle
+
+    float expectedRailVoltage(byte select); //The voltage expected on FJ2_PT_READ_V1/V2 when V1/V2 is enabled
+    float railReadVoltage(float railVoltage); //The voltage expected on FJ2_PT_READ_V1/V2 when the rail is at railVoltage
+
+    boolean runStep(FJ2_TestStep *step); //Run one step of a TestSequence. Returns true if it passed
+
+    boolean enableWithCapture(byte select, FJ2_RampCapture *capture, uint8_t risePercent, unsigned long cutOffMicros, unsigned long sampleIntervalMicros); //Enable V1/V2 and capture the ramp
+    void switchOnRail(byte select); //Turn V1 or V2 on - without the checks and debug messages of enableV1/V2
+    boolean switchVoltageV2(float voltage); //Change the V2 setting while V2 is enabled (make before break)
+
+    void stopAllPatterns(); //Stop all of the LED patterns (without changing the LEDs)
+
+    uint32_t _i2cScanClock = 0; // The I2C clock during a scan. 0 leaves the clock alone. Set by setI2CScanClock
+    uint32_t _i2cNormalClock = FJ2_I2C_NORMAL_CLOCK; // The I2C clock restored after a scan
+    boolean verifyI2CdeviceDebug(byte address) __attribute__((noinline)); //verifyI2Cdevice - collecting the error codes for the debug messages
+    void beginI2CScan(uint8_t *errors); //Raise the I2C clock and clear errors
+    void endI2CScan(); //Restore the I2C clock
+    byte probeI2C(byte address); //Probe one address. Returns the Wire.endTransmission result
+    void printI2CScan(const I2CAddressSet &found, const uint8_t *errors, unsigned long scanMicros); //Print the result of a scan
+
+    FJ2_Task _tasks[FJ2_MAX_TASKS]; // The built-in tasks come first
+    boolean _schedulerRunning = false; // True while run() is calling the tasks. Stops run() from being re-entered
+    boolean _pollingButtons = false; // True while pollButtons is running. The button task waits until it has finished
+    ButtonTracker _waitTracker; // The tracker for waitForButtonPress etc. - so they leave buttonTracker alone
+    FJ2_button_event_e pollButtons(ButtonTracker &tracker); //Read the buttons which tracker needs and advance it
+    FJ2_button_event_e _buttonTaskEvent = FJ2_BUTTON_EVENT_NONE; // The latest event found by the button task
+    uint8_t _buttonTaskButton = 0; // Which button _buttonTaskEvent is for
+    static void builtInTask(FJ2_Task *task); //The function for all of the built-in tasks
 };
 
 #endif
\ No newline at end of file